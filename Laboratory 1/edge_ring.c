@@ -0,0 +1,63 @@
+#include <string.h>
+#include "edge_ring.h"
+
+#ifdef ESP_PLATFORM
+#include "esp_attr.h"
+#else
+#define IRAM_ATTR
+#endif
+
+#define EDGE_RING_MASK (EDGE_RING_SIZE - 1)
+
+void edge_ring_init(edge_ring_t *r)
+{
+    memset(r, 0, sizeof(*r));
+}
+
+bool IRAM_ATTR edge_ring_push(edge_ring_t *r, uint32_t cycles, uint32_t levels, uint32_t changed)
+{
+    uint32_t head = r->head;
+    uint32_t tail = __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+    uint32_t used = head - tail;
+
+    if (used >= EDGE_RING_SIZE) {
+        r->overflows++;
+        return false;
+    }
+
+    edge_t *e = &r->buf[head & EDGE_RING_MASK];
+    e->cycles = cycles;
+    e->levels = levels;
+    e->changed = changed;
+
+    // publish the slot only after it has been written
+    __atomic_store_n(&r->head, head + 1, __ATOMIC_RELEASE);
+
+    if (used + 1 > r->high_water) {
+        r->high_water = used + 1;
+    }
+    return used == 0;
+}
+
+uint32_t edge_ring_pop_batch(edge_ring_t *r, edge_t *out, uint32_t max)
+{
+    uint32_t tail = r->tail;
+    uint32_t head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+    uint32_t n = head - tail;
+
+    if (n > max) {
+        n = max;
+    }
+    for (uint32_t i = 0; i < n; i++) {
+        out[i] = r->buf[(tail + i) & EDGE_RING_MASK];
+    }
+
+    // hand the slots back to the producer
+    __atomic_store_n(&r->tail, tail + n, __ATOMIC_RELEASE);
+    return n;
+}
+
+uint32_t edge_ring_count(const edge_ring_t *r)
+{
+    return __atomic_load_n(&r->head, __ATOMIC_ACQUIRE) - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+}
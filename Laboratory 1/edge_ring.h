@@ -0,0 +1,37 @@
+#ifndef _EDGE_RING_H_
+#define _EDGE_RING_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Must be a power of two
+#define EDGE_RING_SIZE 256
+
+typedef struct {
+    uint32_t cycles;    // CPU cycle counter at ISR entry
+    uint32_t levels;    // GPIO_IN_REG snapshot taken in the ISR
+    uint32_t changed;   // bitmask of pins that changed since the previous entry
+} edge_t;
+
+/* Single-producer (ISR) / single-consumer (task) ring of timestamped edges.
+ * head is only written by the producer, tail only by the consumer. */
+typedef struct {
+    edge_t buf[EDGE_RING_SIZE];
+    volatile uint32_t head;
+    volatile uint32_t tail;
+    volatile uint32_t overflows;    // edges dropped because the ring was full
+    volatile uint32_t high_water;   // max fill level seen by the producer
+} edge_ring_t;
+
+void edge_ring_init(edge_ring_t *r);
+
+/* Producer side. Returns true if the ring was empty before the push,
+ * i.e. the consumer may be sleeping and needs a wake-up. */
+bool edge_ring_push(edge_ring_t *r, uint32_t cycles, uint32_t levels, uint32_t changed);
+
+/* Consumer side. Copies up to max edges into out and returns how many. */
+uint32_t edge_ring_pop_batch(edge_ring_t *r, edge_t *out, uint32_t max);
+
+uint32_t edge_ring_count(const edge_ring_t *r);
+
+#endif
@@ -0,0 +1,104 @@
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "driver/gpio.h"
+#include "esp_cpu.h"
+#include "esp_intr_alloc.h"
+#include "soc/gpio_reg.h"
+
+#include "gpio_capture.h"
+
+static uint32_t s_pin_mask;
+static uint32_t s_last;
+static edge_ring_t *s_ring;
+static TaskHandle_t s_notify;
+static intr_handle_t s_intr;
+static uint32_t s_early;            // changed before their status bit was cleared
+static volatile uint32_t s_counts[32];
+static volatile uint32_t s_pulses[32];
+
+static void IRAM_ATTR capture_isr(void *arg)
+{
+    uint32_t cycles = esp_cpu_get_cycle_count();
+    uint32_t status = REG_READ(GPIO_STATUS_REG) & s_pin_mask;
+    REG_WRITE(GPIO_STATUS_W1TC_REG, status);
+
+    uint32_t levels = REG_READ(GPIO_IN_REG);
+    uint32_t changed = (levels ^ s_last) & s_pin_mask;
+    s_last = levels;
+
+    /* A pulse shorter than the ISR latency leaves the level unchanged. It
+     * is counted, but not pushed: the ring only carries real level changes.
+     * An edge that landed after the status clear above is already in
+     * changed, and its status bit brings us back here with no change. */
+    uint32_t pulsed = status & ~changed & ~s_early;
+    s_early = (s_early & ~status) | (changed & ~status);
+    for (uint32_t m = pulsed; m; m &= m - 1) {
+        s_pulses[__builtin_ctz(m)]++;
+    }
+    if (!changed) {
+        return;
+    }
+
+    for (uint32_t m = changed; m; m &= m - 1) {
+        s_counts[__builtin_ctz(m)]++;
+    }
+
+    if (edge_ring_push(s_ring, cycles, levels, changed)) {
+        BaseType_t woken = pdFALSE;
+        vTaskNotifyGiveFromISR(s_notify, &woken);
+        portYIELD_FROM_ISR(woken);
+    }
+}
+
+esp_err_t gpio_capture_start(uint32_t pin_mask, edge_ring_t *ring, TaskHandle_t notify)
+{
+    gpio_config_t io_conf = {};
+    io_conf.intr_type = GPIO_INTR_ANYEDGE;
+    io_conf.mode = GPIO_MODE_INPUT;
+    io_conf.pin_bit_mask = pin_mask;
+    io_conf.pull_down_en = 1;
+    io_conf.pull_up_en = 0;
+    esp_err_t err = gpio_config(&io_conf);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    s_pin_mask = pin_mask;
+    s_ring = ring;
+    s_notify = notify;
+    memset((void *)s_counts, 0, sizeof(s_counts));
+    memset((void *)s_pulses, 0, sizeof(s_pulses));
+    s_early = 0;
+    s_last = REG_READ(GPIO_IN_REG);
+
+    return gpio_isr_register(capture_isr, NULL, ESP_INTR_FLAG_IRAM, &s_intr);
+}
+
+void gpio_capture_stop(void)
+{
+    for (uint32_t m = s_pin_mask; m; m &= m - 1) {
+        gpio_intr_disable(__builtin_ctz(m));
+    }
+    if (s_intr) {
+        esp_intr_free(s_intr);
+        s_intr = NULL;
+    }
+    s_pin_mask = 0;
+}
+
+uint32_t gpio_capture_count(int pin)
+{
+    if (pin < 0 || pin >= 32) {
+        return 0;
+    }
+    return s_counts[pin];
+}
+
+uint32_t gpio_capture_pulses(int pin)
+{
+    if (pin < 0 || pin >= 32) {
+        return 0;
+    }
+    return s_pulses[pin];
+}
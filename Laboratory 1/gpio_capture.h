@@ -0,0 +1,29 @@
+#ifndef _GPIO_CAPTURE_H_
+#define _GPIO_CAPTURE_H_
+
+#include <stdint.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_err.h"
+
+#include "edge_ring.h"
+
+/* Multi-channel edge capture. One GPIO interrupt handler serves every pin
+ * in pin_mask: it reads GPIO_IN_REG once, diffs it against the previous
+ * snapshot and pushes a single timestamped entry with the mask of pins
+ * whose level changed.
+ * Only GPIO0..31 can be captured (a single input register).
+ *
+ * Replaces gpio_install_isr_service(), the two cannot be used together. */
+esp_err_t gpio_capture_start(uint32_t pin_mask, edge_ring_t *ring, TaskHandle_t notify);
+void gpio_capture_stop(void);
+
+// Edges seen on a pin since start, counted in the ISR (includes ring overflows)
+uint32_t gpio_capture_count(int pin);
+
+/* Pulses on a pin that came and went within one interrupt latency: the
+ * pin interrupted but its level had not changed. Each hides two edges,
+ * which are neither pushed to the ring nor in gpio_capture_count(). */
+uint32_t gpio_capture_pulses(int pin);
+
+#endif
@@ -0,0 +1,160 @@
+/* Host stress benchmark for edge_ring.c.
+ *
+ * A producer thread stands in for the GPIO ISR and pushes a synthetic edge
+ * train at a fixed rate, a consumer thread stands in for task1: it sleeps
+ * until the producer wakes it (push returned true, as the ISR notifies),
+ * then drains the ring in batches no faster than its own rate. Every edge
+ * carries its sequence number, so the consumer checks that edges arrive in
+ * order and untorn, and at the end that every edge was either consumed or
+ * counted as an overflow.
+ *
+ *   ./edge_ring_bench [-n edges] [-p producer edges/s] [-c consumer edges/s] [-b batch]
+ *
+ * A rate of 0 means as fast as possible. */
+#include <inttypes.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "edge_ring.h"
+
+static edge_ring_t ring;
+static sem_t wake;
+static volatile int done;
+
+static uint32_t n_edges = 1000000;
+static uint32_t producer_rate = 200000;
+static uint32_t consumer_rate = 0;
+static uint32_t batch_len = 32;
+
+static uint32_t wakeups;
+static uint32_t popped;
+static uint32_t gaps;           // edges missing between two consumed ones
+static uint32_t errors;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Waits until edge i of a train at rate per second is due
+static void pace(uint64_t start, uint32_t i, uint32_t rate)
+{
+    if (!rate) {
+        return;
+    }
+    uint64_t due = start + (uint64_t)i * 1000000000ULL / rate;
+    while (now_ns() < due) {
+    }
+}
+
+static uint32_t levels_of(uint32_t seq)
+{
+    return seq * 2654435761u;
+}
+
+static void *producer(void *arg)
+{
+    (void)arg;
+    uint64_t start = now_ns();
+
+    for (uint32_t i = 0; i < n_edges; i++) {
+        pace(start, i, producer_rate);
+        if (edge_ring_push(&ring, i, levels_of(i), ~i)) {
+            sem_post(&wake);
+        }
+    }
+    __atomic_store_n(&done, 1, __ATOMIC_RELEASE);
+    sem_post(&wake);
+    return NULL;
+}
+
+static void *consumer(void *arg)
+{
+    (void)arg;
+    edge_t *batch = malloc(batch_len * sizeof(edge_t));
+    uint64_t start = now_ns();
+    int64_t last = -1;
+
+    for (;;) {
+        int finished = __atomic_load_n(&done, __ATOMIC_ACQUIRE);
+        uint32_t n;
+
+        while ((n = edge_ring_pop_batch(&ring, batch, batch_len)) > 0) {
+            for (uint32_t i = 0; i < n; i++) {
+                const edge_t *e = &batch[i];
+                if (e->levels != levels_of(e->cycles) || e->changed != ~e->cycles) {
+                    errors++;
+                    fprintf(stderr, "torn edge %" PRIu32 "\n", e->cycles);
+                }
+                if ((int64_t)e->cycles <= last) {
+                    errors++;
+                    fprintf(stderr, "edge %" PRIu32 " after %" PRId64 "\n", e->cycles, last);
+                } else {
+                    gaps += (uint32_t)(e->cycles - last - 1);
+                }
+                last = e->cycles;
+            }
+            popped += n;
+            pace(start, popped, consumer_rate);
+        }
+        if (finished) {
+            break;
+        }
+        sem_wait(&wake);
+        wakeups++;
+    }
+    // edges lost at the end of the train never show up as a gap
+    gaps += (uint32_t)(n_edges - 1 - last);
+    free(batch);
+    return NULL;
+}
+
+int main(int argc, char **argv)
+{
+    int opt;
+    while ((opt = getopt(argc, argv, "n:p:c:b:")) != -1) {
+        uint32_t v = (uint32_t)strtoul(optarg, NULL, 0);
+        switch (opt) {
+        case 'n': n_edges = v; break;
+        case 'p': producer_rate = v; break;
+        case 'c': consumer_rate = v; break;
+        case 'b': batch_len = v ? v : 1; break;
+        default:
+            fprintf(stderr, "usage: %s [-n edges] [-p producer/s] [-c consumer/s] [-b batch]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    edge_ring_init(&ring);
+    sem_init(&wake, 0, 0);
+
+    pthread_t p, c;
+    uint64_t t = now_ns();
+    pthread_create(&c, NULL, consumer, NULL);
+    pthread_create(&p, NULL, producer, NULL);
+    pthread_join(p, NULL);
+    pthread_join(c, NULL);
+    t = now_ns() - t;
+
+    if (popped + ring.overflows != n_edges) {
+        errors++;
+        fprintf(stderr, "%" PRIu32 " consumed + %" PRIu32 " overflows != %" PRIu32 " pushed\n",
+                popped, ring.overflows, n_edges);
+    }
+    if (gaps != ring.overflows) {
+        errors++;
+        fprintf(stderr, "%" PRIu32 " edges missing, %" PRIu32 " overflows counted\n", gaps, ring.overflows);
+    }
+
+    printf("edges %" PRIu32 " producer %" PRIu32 "/s consumer %" PRIu32 "/s batch %" PRIu32 ": "
+           "%.0f edges/s, %" PRIu32 " wake-ups, %" PRIu32 " overflows, high water %" PRIu32 "/%d, %s\n",
+           n_edges, producer_rate, consumer_rate, batch_len, n_edges * 1e9 / t, wakeups,
+           ring.overflows, ring.high_water, EDGE_RING_SIZE, errors ? "FAIL" : "ok");
+    return errors ? 1 : 0;
+}
@@ -0,0 +1,196 @@
+/* Host test for the loopback benchmark's statistics pipeline
+ * (loopback_bench.c, latency_hist.c), run against mock HALs.
+ *
+ * The scripted HAL has a clock the test sets by hand, so each latency,
+ * drop and spurious edge is placed exactly. The threaded HAL wires the
+ * output back to an edge_ring the way the jumper does on the board: a
+ * timer thread toggles, a consumer thread drains the ring in batches the
+ * way task1 does, and at the end every toggle must be accounted for. */
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "edge_ring.h"
+#include "latency_hist.h"
+#include "loopback_bench.h"
+
+static int failures;
+
+#define CHECK(cond) do { \
+        if (!(cond)) { \
+            failures++; \
+            fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #cond); \
+        } \
+    } while (0)
+
+// Scripted HAL
+
+static uint32_t mock_clock;
+static uint32_t mock_level;
+static uint32_t mock_writes;
+
+static void mock_set_output(uint32_t level)
+{
+    mock_level = level;
+    mock_writes++;
+}
+
+static uint32_t mock_now(void)
+{
+    return mock_clock;
+}
+
+static const loopback_hal_t mock_hal = {
+    .set_output = mock_set_output,
+    .now = mock_now,
+};
+
+static void test_latencies(void)
+{
+    static loopback_bench_t b;
+    loopback_bench_init(&b, &mock_hal, 1000000);
+    mock_clock = 0xfffff000;        // through the wrap
+
+    for (uint32_t i = 0; i < 100; i++) {
+        loopback_bench_toggle(&b);
+        CHECK(mock_level == ((i + 1) & 1));
+        uint32_t isr = mock_clock + 10 + i;
+        loopback_bench_edge(&b, isr, mock_level, isr + 50);
+        mock_clock += 1000;
+    }
+    CHECK(mock_writes == 100);
+    CHECK(b.toggles == 100);
+    CHECK(b.dropped == 0 && b.spurious == 0);
+    CHECK(b.isr_lat.samples == 100 && b.isr_lat.min == 10 && b.isr_lat.max == 109);
+    CHECK(b.wake_lat.min == 50 && b.wake_lat.max == 50);
+    // within the histogram's 1/8 relative resolution
+    uint32_t p50 = latency_hist_percentile(&b.isr_lat, 50);
+    CHECK(p50 >= 59 && p50 <= 59 + 59 / 8);
+    CHECK(latency_hist_percentile(&b.isr_lat, 100) == 109);
+}
+
+static void test_drops_and_spurious(void)
+{
+    static loopback_bench_t b;
+    loopback_bench_init(&b, &mock_hal, 1000000);
+    mock_clock = 1000;
+
+    // an edge with no toggle
+    loopback_bench_edge(&b, 900, 1, 950);
+    CHECK(b.spurious == 1);
+
+    // a toggle whose edge never comes: counted at the next toggle
+    loopback_bench_toggle(&b);
+    mock_clock += 1000;
+    loopback_bench_toggle(&b);
+    CHECK(b.dropped == 1);
+
+    // the edge arrives with the old level
+    loopback_bench_edge(&b, mock_clock + 5, !mock_level, mock_clock + 10);
+    CHECK(b.dropped == 2);
+
+    // an edge older than the toggle it is matched to
+    mock_clock += 1000;
+    loopback_bench_toggle(&b);
+    loopback_bench_edge(&b, mock_clock - 1, mock_level, mock_clock + 10);
+    CHECK(b.dropped == 3);
+    CHECK(b.isr_lat.samples == 0);
+
+    // the same edge twice: the second has no toggle left
+    mock_clock += 1000;
+    loopback_bench_toggle(&b);
+    loopback_bench_edge(&b, mock_clock + 5, mock_level, mock_clock + 10);
+    loopback_bench_edge(&b, mock_clock + 6, mock_level, mock_clock + 10);
+    CHECK(b.isr_lat.samples == 1 && b.spurious == 2 && b.dropped == 3);
+
+    // wake_ts behind the edge is a consumer timestamping bug, not a lost edge
+    mock_clock += 1000;
+    loopback_bench_toggle(&b);
+    loopback_bench_edge(&b, mock_clock + 5, mock_level, mock_clock + 1);
+    CHECK(b.dropped == 3 && b.wake_lat.samples == 2 && b.wake_lat.min == 0);
+
+    loopback_bench_reset(&b);
+    CHECK(b.toggles == 0 && b.dropped == 0 && b.spurious == 0 && b.isr_lat.samples == 0);
+}
+
+// Threaded HAL: the output is looped back into a ring, as through the jumper
+
+#define TOGGLES 20000
+#define TOGGLE_PERIOD_NS 20000
+
+static edge_ring_t wire;
+static loopback_bench_t shared;
+static volatile int toggling;
+
+static uint32_t host_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)((uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec);
+}
+
+static void wire_set_output(uint32_t level)
+{
+    edge_ring_push(&wire, host_now(), level, 1);
+}
+
+static const loopback_hal_t wire_hal = {
+    .set_output = wire_set_output,
+    .now = host_now,
+};
+
+static void *consumer(void *arg)
+{
+    edge_t batch[32];
+    (void)arg;
+
+    for (;;) {
+        int last = !__atomic_load_n(&toggling, __ATOMIC_ACQUIRE);
+        uint32_t n;
+        while ((n = edge_ring_pop_batch(&wire, batch, 32)) > 0) {
+            uint32_t wake = host_now();
+            for (uint32_t i = 0; i < n; i++) {
+                loopback_bench_edge(&shared, batch[i].cycles, batch[i].levels, wake);
+            }
+        }
+        if (last) {
+            return NULL;
+        }
+    }
+}
+
+static void test_threaded(void)
+{
+    pthread_t th;
+
+    edge_ring_init(&wire);
+    loopback_bench_init(&shared, &wire_hal, 1000000000);
+    __atomic_store_n(&toggling, 1, __ATOMIC_RELEASE);
+    pthread_create(&th, NULL, consumer, NULL);
+    for (int i = 0; i < TOGGLES; i++) {
+        struct timespec period = { 0, TOGGLE_PERIOD_NS };
+        loopback_bench_toggle(&shared);
+        nanosleep(&period, NULL);
+    }
+    __atomic_store_n(&toggling, 0, __ATOMIC_RELEASE);
+    pthread_join(th, NULL);
+
+    // every toggle was measured, dropped or is still waiting for the edge that never came
+    uint32_t accounted = shared.isr_lat.samples + shared.dropped + shared.pending;
+    CHECK(shared.toggles == TOGGLES);
+    CHECK(accounted == TOGGLES);
+    CHECK(shared.isr_lat.samples == shared.wake_lat.samples);
+    CHECK(shared.spurious <= wire.overflows + shared.dropped);
+    printf("threaded: %" PRIu32 " measured, %" PRIu32 " dropped, %" PRIu32 " spurious, %" PRIu32 " ring overflows\n",
+           shared.isr_lat.samples, shared.dropped, shared.spurious, wire.overflows);
+}
+
+int main(void)
+{
+    test_latencies();
+    test_drops_and_spurious();
+    test_threaded();
+    printf("loopback_bench: %s\n", failures ? "FAIL" : "ok");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,246 @@
+/* Host test and benchmark for pulse_stats.c.
+ *
+ * Replays synthetic edge trains and checks every snapshot against a
+ * brute-force recomputation over the same window: min/max/average period,
+ * frequency, duty cycle and the jitter histogram. A reader thread takes
+ * snapshots while the writer runs to exercise the sequence lock. Last, it
+ * measures the cost of pulse_stats_edge() per edge.
+ *
+ *   ./pulse_stats_test [edges for the benchmark] */
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "pulse_stats.h"
+
+#define TICK_HZ 80000000
+#define BIN_TICKS 800
+
+static int failures;
+
+#define CHECK_EQ(what, got, want) do { \
+        if ((got) != (want)) { \
+            failures++; \
+            fprintf(stderr, "%s:%d %s: got %" PRIu32 " want %" PRIu32 "\n", \
+                    __FILE__, __LINE__, what, (uint32_t)(got), (uint32_t)(want)); \
+        } \
+    } while (0)
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static uint32_t rnd(uint32_t *state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+    return *state;
+}
+
+// The reference: every period and high time ever added, and its jitter bin
+static uint32_t ref_period[4096], ref_high[4096], ref_bin[4096];
+static uint32_t ref_n;
+
+static void ref_add(uint32_t period, uint32_t high)
+{
+    uint32_t first = ref_n > PULSE_STATS_WINDOW ? ref_n - PULSE_STATS_WINDOW : 0;
+    uint32_t bin = 0;
+    if (ref_n) {
+        uint64_t sum = 0;
+        for (uint32_t i = first; i < ref_n; i++) {
+            sum += ref_period[i];
+        }
+        uint32_t mean = (uint32_t)(sum / (ref_n - first));
+        uint32_t dev = period > mean ? period - mean : mean - period;
+        bin = dev / BIN_TICKS;
+        if (bin >= PULSE_STATS_JITTER_BINS) {
+            bin = PULSE_STATS_JITTER_BINS - 1;
+        }
+    }
+    ref_period[ref_n] = period;
+    ref_high[ref_n] = high;
+    ref_bin[ref_n] = bin;
+    ref_n++;
+}
+
+static void ref_check(const pulse_stats_t *s, uint32_t edges)
+{
+    pulse_snapshot_t snap;
+    pulse_stats_snapshot(s, &snap);
+
+    uint32_t first = ref_n > PULSE_STATS_WINDOW ? ref_n - PULSE_STATS_WINDOW : 0;
+    uint32_t n = ref_n - first;
+    uint32_t min = n ? UINT32_MAX : 0, max = 0;
+    uint64_t period_sum = 0, high_sum = 0;
+    uint32_t hist[PULSE_STATS_JITTER_BINS] = { 0 };
+    for (uint32_t i = first; i < ref_n; i++) {
+        min = ref_period[i] < min ? ref_period[i] : min;
+        max = ref_period[i] > max ? ref_period[i] : max;
+        period_sum += ref_period[i];
+        high_sum += ref_high[i];
+        hist[ref_bin[i]]++;
+    }
+
+    CHECK_EQ("edges", snap.edges, edges);
+    CHECK_EQ("periods", snap.periods, n);
+    CHECK_EQ("period_min", snap.period_min, min);
+    CHECK_EQ("period_max", snap.period_max, max);
+    CHECK_EQ("period_avg", snap.period_avg, n ? period_sum / n : 0);
+    CHECK_EQ("freq_mhz", snap.freq_mhz, period_sum ? (uint64_t)TICK_HZ * 1000 * n / period_sum : 0);
+    CHECK_EQ("duty_permille", snap.duty_permille, period_sum ? high_sum * 1000 / period_sum : 0);
+    for (int i = 0; i < PULSE_STATS_JITTER_BINS; i++) {
+        CHECK_EQ("jitter_hist", snap.jitter_hist[i], hist[i]);
+    }
+}
+
+/* Random periods and duty cycles, with runs of rising and falling periods
+ * so the min/max deques both grow and drain. Starts on a falling edge:
+ * nothing is counted before the first rising one. Ticks wrap. */
+static void test_against_brute_force(void)
+{
+    static pulse_stats_t s;
+    uint32_t seed = 12345;
+    uint32_t t = UINT32_MAX - 3 * TICK_HZ;
+    uint32_t base = 8000;
+    uint32_t edges = 0;
+    uint32_t prev_period = 0, prev_high = 0;
+
+    pulse_stats_init(&s, TICK_HZ, BIN_TICKS);
+    ref_n = 0;
+
+    pulse_stats_edge(&s, t, 0);
+    ref_check(&s, ++edges);
+    t += 100;
+
+    for (int i = 0; i < 4000; i++) {
+        if (i % 200 < 100) {
+            base += rnd(&seed) % 50;
+        } else {
+            base -= rnd(&seed) % 50;
+        }
+        uint32_t period = base + rnd(&seed) % (i % 3 ? 400 : 20000);
+        uint32_t high = 1 + rnd(&seed) % (period - 1);
+
+        // this rising edge closes the previous period
+        pulse_stats_edge(&s, t, 1);
+        if (i > 0) {
+            ref_add(prev_period, prev_high);
+        }
+        ref_check(&s, ++edges);
+        pulse_stats_edge(&s, t + high, 0);
+        ref_check(&s, ++edges);
+
+        prev_period = period;
+        prev_high = high;
+        t += period;
+    }
+}
+
+// A clean 1 kHz, 25 % square wave: exact frequency and duty
+static void test_square_wave(void)
+{
+    static pulse_stats_t s;
+    pulse_snapshot_t snap;
+    const uint32_t period = TICK_HZ / 1000;
+    uint32_t t = 0;
+
+    pulse_stats_init(&s, TICK_HZ, BIN_TICKS);
+    for (int i = 0; i < 3 * PULSE_STATS_WINDOW; i++) {
+        pulse_stats_edge(&s, t, 1);
+        pulse_stats_edge(&s, t + period / 4, 0);
+        t += period;
+    }
+    pulse_stats_edge(&s, t, 1);
+    pulse_stats_snapshot(&s, &snap);
+
+    CHECK_EQ("periods", snap.periods, PULSE_STATS_WINDOW);
+    CHECK_EQ("freq_mhz", snap.freq_mhz, 1000000);
+    CHECK_EQ("duty_permille", snap.duty_permille, 250);
+    CHECK_EQ("period_min", snap.period_min, period);
+    CHECK_EQ("period_max", snap.period_max, period);
+    CHECK_EQ("jitter_hist[0]", snap.jitter_hist[0], PULSE_STATS_WINDOW);
+}
+
+static pulse_stats_t shared;
+static volatile int writing;
+
+static void *reader(void *arg)
+{
+    pulse_snapshot_t snap;
+    uint32_t *torn = arg;
+
+    while (__atomic_load_n(&writing, __ATOMIC_ACQUIRE)) {
+        pulse_stats_snapshot(&shared, &snap);
+        uint32_t total = 0;
+        for (int i = 0; i < PULSE_STATS_JITTER_BINS; i++) {
+            total += snap.jitter_hist[i];
+        }
+        // a torn copy mixes windows: the histogram no longer sums to the count
+        if (total != snap.periods || (snap.periods && snap.period_min > snap.period_max)) {
+            (*torn)++;
+        }
+    }
+    return NULL;
+}
+
+// Snapshots taken while the writer runs are consistent
+static void test_concurrent_snapshot(void)
+{
+    pthread_t th;
+    uint32_t torn = 0;
+    uint32_t seed = 99;
+    uint32_t t = 0;
+
+    pulse_stats_init(&shared, TICK_HZ, BIN_TICKS);
+    __atomic_store_n(&writing, 1, __ATOMIC_RELEASE);
+    pthread_create(&th, NULL, reader, &torn);
+    for (int i = 0; i < 2000000; i++) {
+        pulse_stats_edge(&shared, t, i & 1 ? 0 : 1);
+        t += 1000 + rnd(&seed) % 1000;
+    }
+    __atomic_store_n(&writing, 0, __ATOMIC_RELEASE);
+    pthread_join(th, NULL);
+    CHECK_EQ("torn snapshots", torn, 0);
+}
+
+static void bench(uint32_t edges)
+{
+    static pulse_stats_t s;
+    uint32_t *ticks = malloc(edges * sizeof(uint32_t));
+    uint32_t seed = 7;
+    uint32_t t = 0;
+
+    for (uint32_t i = 0; i < edges; i++) {
+        t += 500 + rnd(&seed) % 100;
+        ticks[i] = t;
+    }
+    pulse_stats_init(&s, TICK_HZ, BIN_TICKS);
+    uint64_t start = now_ns();
+    for (uint32_t i = 0; i < edges; i++) {
+        pulse_stats_edge(&s, ticks[i], ~i & 1);
+    }
+    uint64_t ns = now_ns() - start;
+    printf("pulse_stats_edge: %" PRIu32 " edges, %.1f ns/edge\n", edges, (double)ns / edges);
+    free(ticks);
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t edges = argc > 1 ? (uint32_t)strtoul(argv[1], NULL, 0) : 10000000;
+
+    test_against_brute_force();
+    test_square_wave();
+    test_concurrent_snapshot();
+    printf("pulse_stats: %s\n", failures ? "FAIL" : "ok");
+    if (edges) {
+        bench(edges);
+    }
+    return failures ? 1 : 0;
+}
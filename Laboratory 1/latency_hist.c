@@ -0,0 +1,62 @@
+#include <string.h>
+#include "latency_hist.h"
+
+static uint32_t bucket_of(uint32_t v)
+{
+    if (v < LATENCY_HIST_SUB) {
+        return v;
+    }
+    uint32_t msb = 31 - __builtin_clz(v);
+    uint32_t shift = msb - LATENCY_HIST_SUB_BITS;
+    uint32_t sub = (v >> shift) & (LATENCY_HIST_SUB - 1);
+    return (shift + 1) * LATENCY_HIST_SUB + sub;
+}
+
+static uint32_t bucket_upper(uint32_t idx)
+{
+    if (idx < LATENCY_HIST_SUB) {
+        return idx;
+    }
+    uint32_t shift = idx / LATENCY_HIST_SUB - 1;
+    uint32_t sub = idx % LATENCY_HIST_SUB;
+    uint64_t upper = ((uint64_t)(LATENCY_HIST_SUB + sub + 1) << shift) - 1;
+    return upper > UINT32_MAX ? UINT32_MAX : (uint32_t)upper;
+}
+
+void latency_hist_reset(latency_hist_t *h)
+{
+    memset(h, 0, sizeof(*h));
+}
+
+void latency_hist_add(latency_hist_t *h, uint32_t value)
+{
+    h->buckets[bucket_of(value)]++;
+    if (!h->samples || value < h->min) {
+        h->min = value;
+    }
+    if (value > h->max) {
+        h->max = value;
+    }
+    h->samples++;
+}
+
+uint32_t latency_hist_percentile(const latency_hist_t *h, uint32_t pct)
+{
+    if (!h->samples) {
+        return 0;
+    }
+    uint64_t rank = ((uint64_t)h->samples * pct + 99) / 100;
+    if (!rank) {
+        rank = 1;
+    }
+
+    uint64_t seen = 0;
+    for (uint32_t i = 0; i < LATENCY_HIST_BUCKETS; i++) {
+        seen += h->buckets[i];
+        if (seen >= rank) {
+            uint32_t upper = bucket_upper(i);
+            return upper < h->max ? upper : h->max;
+        }
+    }
+    return h->max;
+}
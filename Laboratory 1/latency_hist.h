@@ -0,0 +1,26 @@
+#ifndef _LATENCY_HIST_H_
+#define _LATENCY_HIST_H_
+
+#include <stdint.h>
+
+/* Log-linear histogram: each power of two is split into
+ * LATENCY_HIST_SUB buckets, so the relative error of a percentile is
+ * bounded by 1/LATENCY_HIST_SUB whatever the magnitude. */
+#define LATENCY_HIST_SUB_BITS 3
+#define LATENCY_HIST_SUB (1 << LATENCY_HIST_SUB_BITS)
+#define LATENCY_HIST_BUCKETS ((32 - LATENCY_HIST_SUB_BITS + 1) * LATENCY_HIST_SUB)
+
+typedef struct {
+    uint32_t buckets[LATENCY_HIST_BUCKETS];
+    uint32_t samples;
+    uint32_t min;
+    uint32_t max;
+} latency_hist_t;
+
+void latency_hist_reset(latency_hist_t *h);
+void latency_hist_add(latency_hist_t *h, uint32_t value);
+
+// Upper bound of the bucket holding the given percentile (0..100)
+uint32_t latency_hist_percentile(const latency_hist_t *h, uint32_t pct);
+
+#endif
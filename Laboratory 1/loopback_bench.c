@@ -0,0 +1,80 @@
+#include <stdio.h>
+#include <string.h>
+#include "loopback_bench.h"
+
+void loopback_bench_init(loopback_bench_t *b, const loopback_hal_t *hal, uint32_t tick_hz)
+{
+    memset(b, 0, sizeof(*b));
+    b->hal = hal;
+    b->tick_hz = tick_hz;
+    latency_hist_reset(&b->isr_lat);
+    latency_hist_reset(&b->wake_lat);
+}
+
+void loopback_bench_reset(loopback_bench_t *b)
+{
+    latency_hist_reset(&b->isr_lat);
+    latency_hist_reset(&b->wake_lat);
+    b->toggles = 0;
+    __atomic_store_n(&b->dropped, 0, __ATOMIC_RELAXED);
+    b->spurious = 0;
+}
+
+void loopback_bench_toggle(loopback_bench_t *b)
+{
+    // the previous edge was not consumed before the next toggle
+    if (__atomic_exchange_n(&b->pending, 0, __ATOMIC_ACQ_REL)) {
+        __atomic_fetch_add(&b->dropped, 1, __ATOMIC_RELAXED);
+    }
+
+    uint32_t level = b->level ^ 1;
+    __atomic_store_n(&b->level, level, __ATOMIC_RELAXED);
+    __atomic_store_n(&b->toggle_ts, b->hal->now(), __ATOMIC_RELAXED);
+    b->hal->set_output(level);
+    b->toggles++;
+
+    __atomic_store_n(&b->pending, 1, __ATOMIC_RELEASE);
+}
+
+void loopback_bench_edge(loopback_bench_t *b, uint32_t isr_ts, uint32_t level, uint32_t wake_ts)
+{
+    if (!__atomic_exchange_n(&b->pending, 0, __ATOMIC_ACQ_REL)) {
+        b->spurious++;
+        return;
+    }
+
+    // a newer toggle may have replaced toggle_ts while we were preempted
+    int32_t isr_lat = (int32_t)(isr_ts - __atomic_load_n(&b->toggle_ts, __ATOMIC_RELAXED));
+    if (level != __atomic_load_n(&b->level, __ATOMIC_RELAXED) || isr_lat < 0) {
+        __atomic_fetch_add(&b->dropped, 1, __ATOMIC_RELAXED);
+        return;
+    }
+    // wake_ts is taken when the batch holding this edge was popped, so it is never earlier
+    int32_t wake_lat = (int32_t)(wake_ts - isr_ts);
+
+    latency_hist_add(&b->isr_lat, (uint32_t)isr_lat);
+    latency_hist_add(&b->wake_lat, wake_lat > 0 ? (uint32_t)wake_lat : 0);
+}
+
+static uint32_t to_ns(const loopback_bench_t *b, uint32_t ticks)
+{
+    return (uint32_t)((uint64_t)ticks * 1000000000ULL / b->tick_hz);
+}
+
+static void report_hist(const loopback_bench_t *b, const char *name, const latency_hist_t *h)
+{
+    printf("%s: n=%lu p50=%lu ns p99=%lu ns max=%lu ns\n", name,
+           (unsigned long)h->samples,
+           (unsigned long)to_ns(b, latency_hist_percentile(h, 50)),
+           (unsigned long)to_ns(b, latency_hist_percentile(h, 99)),
+           (unsigned long)to_ns(b, h->max));
+}
+
+void loopback_bench_report(const loopback_bench_t *b)
+{
+    printf("\nloopback: toggles=%lu dropped=%lu spurious=%lu\n",
+           (unsigned long)b->toggles, (unsigned long)__atomic_load_n(&b->dropped, __ATOMIC_RELAXED),
+           (unsigned long)b->spurious);
+    report_hist(b, "isr ", &b->isr_lat);
+    report_hist(b, "wake", &b->wake_lat);
+}
@@ -0,0 +1,45 @@
+#ifndef _LOOPBACK_BENCH_H_
+#define _LOOPBACK_BENCH_H_
+
+#include <stdint.h>
+
+#include "latency_hist.h"
+
+/* GPIO loopback latency benchmark (output pin wired to the input pin).
+ * The hardware is reached only through the HAL so the statistics pipeline
+ * can run against a mock on a host. All timestamps come from hal->now()
+ * and must share one time base (on the ESP32: the cycle counter of the
+ * core that runs the toggle timer, the GPIO ISR and the consumer task). */
+typedef struct {
+    void (*set_output)(uint32_t level);
+    uint32_t (*now)(void);
+} loopback_hal_t;
+
+typedef struct {
+    const loopback_hal_t *hal;
+    uint32_t tick_hz;
+
+    uint32_t level;                 // last level driven on the output
+    uint32_t toggle_ts;
+    volatile uint32_t pending;      // a toggle is waiting for its edge
+
+    latency_hist_t isr_lat;         // toggle -> ISR entry
+    latency_hist_t wake_lat;        // ISR entry -> consumer task popping the edge
+    uint32_t toggles;
+    uint32_t dropped;               // toggles whose edge never arrived in time (both sides, atomic)
+    uint32_t spurious;              // edges with no matching toggle
+} loopback_bench_t;
+
+void loopback_bench_init(loopback_bench_t *b, const loopback_hal_t *hal, uint32_t tick_hz);
+
+// Called at the programmed rate (timer context)
+void loopback_bench_toggle(loopback_bench_t *b);
+
+/* Called by the consumer for every captured edge. wake_ts is read right
+ * after popping the batch that held the edge. */
+void loopback_bench_edge(loopback_bench_t *b, uint32_t isr_ts, uint32_t level, uint32_t wake_ts);
+
+void loopback_bench_report(const loopback_bench_t *b);
+void loopback_bench_reset(loopback_bench_t *b);
+
+#endif
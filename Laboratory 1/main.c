@@ -2,6 +2,16 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "driver/gpio.h"
+#include "esp_cpu.h"
+#include "esp_timer.h"
+#include "soc/gpio_reg.h"
+
+#include "edge_ring.h"
+#include "pulse_stats.h"
+#include "gpio_capture.h"
+#include "wave_seq.h"
+#include "loopback_bench.h"
+#include "../dlog/include/dlog.h"
 
 #define GPIO_OUTPUT_IO 4
 #define GPIO_OUTPUT_PIN_SEL (1ULL<<GPIO_OUTPUT_IO)
@@ -9,31 +19,158 @@
 #define GPIO_INPUT_IO 2
 #define GPIO_INPUT_PIN_SEL (1ULL<<GPIO_INPUT_IO)
 
-static QueueHandle_t queue = NULL;
+// 1 = capture every pin in CAPTURE_PIN_MASK from a single GPIO interrupt
+#define MULTI_CHANNEL_CAPTURE 0
+#define CAPTURE_PIN_MASK ((1UL<<GPIO_INPUT_IO) | (1UL<<5) | (1UL<<18) | (1UL<<19) | \
+                          (1UL<<21) | (1UL<<22) | (1UL<<23) | (1UL<<25))
+
+// 1 = report sequencer step lateness together with the pulse statistics
+#define WAVE_JITTER_MODE 0
+
+// 1 = wire GPIO_OUTPUT_IO to GPIO_INPUT_IO and measure interrupt latency
+#define LOOPBACK_BENCH 0
+#define LOOPBACK_RATE_HZ 1000
+
+#define EDGE_BATCH 32
+#define CPU_TICK_HZ (CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ * 1000000)
+#define JITTER_BIN_TICKS (CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ * 10) // 10 us per bin
+
+static const char *TAG = "lab1";
+
+static edge_ring_t edges;
+static pulse_stats_t stats;
+static TaskHandle_t task1_handle = NULL;
 static unsigned int count = 0;
 static unsigned int last = 0;
 
+#if LOOPBACK_BENCH
+static loopback_bench_t bench;
+
+static void bench_set_output(uint32_t level)
+{
+    REG_WRITE(level ? GPIO_OUT_W1TS_REG : GPIO_OUT_W1TC_REG, GPIO_OUTPUT_PIN_SEL);
+}
+
+static uint32_t bench_now(void)
+{
+    return esp_cpu_get_cycle_count();
+}
+
+static const loopback_hal_t bench_hal = {
+    .set_output = bench_set_output,
+    .now = bench_now,
+};
+
+static void bench_timer_cb(void *arg)
+{
+    loopback_bench_toggle(&bench);
+}
+#endif
+
+static const wave_step_t blink_pattern[] = {
+    { 0,                    1UL<<GPIO_OUTPUT_IO, 1000000 },
+    { 1UL<<GPIO_OUTPUT_IO,  0,                   750000 },
+    { 0,                    1UL<<GPIO_OUTPUT_IO, 500000 },
+    { 1UL<<GPIO_OUTPUT_IO,  0,                   250000 },
+};
+
 static void IRAM_ATTR gpio_isr_handler(void *arg)
 {
     uint32_t gpio_num = (uint32_t) arg;
-    xQueueSendFromISR(queue, &gpio_num, NULL);
+    uint32_t cycles = esp_cpu_get_cycle_count();
+    uint32_t levels = REG_READ(GPIO_IN_REG);
+
+    // only wake the task when it may be sleeping on an empty ring
+    if (edge_ring_push(&edges, cycles, levels, 1UL << gpio_num))
+    {
+        BaseType_t woken = pdFALSE;
+        vTaskNotifyGiveFromISR(task1_handle, &woken);
+        portYIELD_FROM_ISR(woken);
+    }
 }
 
 static void task1(void *arg)
 {
-    uint32_t io_num;
+    edge_t batch[EDGE_BATCH];
+    uint32_t reported_overflows = 0;
     for(;;)
     {
-        if(xQueueReceive(queue, &io_num, portMAX_DELAY))
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        uint32_t n;
+        while ((n = edge_ring_pop_batch(&edges, batch, EDGE_BATCH)) > 0)
         {
-            uint32_t level = gpio_get_level(io_num);
-            if (level != last)
+#if LOOPBACK_BENCH
+            // per batch: edges pushed while draining arrive after the wake-up
+            uint32_t wake = esp_cpu_get_cycle_count();
+#endif
+            for (uint32_t i = 0; i < n; i++)
             {
-                last = level;
-                count++;
-                printf("\ncount: %d", count);
+                if (!(batch[i].changed & (1UL << GPIO_INPUT_IO)))
+                {
+                    continue;
+                }
+                uint32_t level = (batch[i].levels >> GPIO_INPUT_IO) & 1;
+                // compiled out unless DLOG_LEVEL is DLOG_DEBUG
+                DLOGD(TAG, "edge %lu @%lu", (unsigned long)level, (unsigned long)batch[i].cycles);
+                if (level != last)
+                {
+                    last = level;
+                    count++;
+                }
+                pulse_stats_edge(&stats, batch[i].cycles, level);
+#if LOOPBACK_BENCH
+                loopback_bench_edge(&bench, batch[i].cycles, level, wake);
+#endif
             }
         }
+
+        if (edges.overflows != reported_overflows)
+        {
+            reported_overflows = edges.overflows;
+            DLOGW(TAG, "overflows: %lu", (unsigned long)reported_overflows);
+        }
+    }
+}
+
+static void stats_task(void *arg)
+{
+    pulse_snapshot_t snap;
+    for(;;)
+    {
+        vTaskDelay(1000 / portTICK_PERIOD_MS);
+
+        pulse_stats_snapshot(&stats, &snap);
+        printf("\ncount: %d freq: %lu.%03lu Hz period: %lu/%lu/%lu us duty: %lu.%lu%%",
+               count,
+               (unsigned long)(snap.freq_mhz / 1000), (unsigned long)(snap.freq_mhz % 1000),
+               (unsigned long)(snap.period_min / CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ),
+               (unsigned long)(snap.period_avg / CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ),
+               (unsigned long)(snap.period_max / CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ),
+               (unsigned long)(snap.duty_permille / 10), (unsigned long)(snap.duty_permille % 10));
+        printf("\njitter:");
+        for (int i = 0; i < PULSE_STATS_JITTER_BINS; i++)
+        {
+            printf(" %lu", (unsigned long)snap.jitter_hist[i]);
+        }
+#if WAVE_JITTER_MODE
+        wave_jitter_t jit;
+        wave_seq_get_jitter(&jit);
+        printf("\nwave lateness: %ld/%ld/%ld us (%lu steps)",
+               (long)jit.min_us, (long)jit.avg_us, (long)jit.max_us, (unsigned long)jit.samples);
+#endif
+#if LOOPBACK_BENCH
+        loopback_bench_report(&bench);
+#endif
+#if MULTI_CHANNEL_CAPTURE
+        printf("\nchannels (edges/short pulses):");
+        for (uint32_t m = CAPTURE_PIN_MASK; m; m &= m - 1)
+        {
+            int pin = __builtin_ctz(m);
+            printf(" %d:%lu/%lu", pin, (unsigned long)gpio_capture_count(pin),
+                   (unsigned long)gpio_capture_pulses(pin));
+        }
+#endif
     }
 }
 
@@ -54,6 +191,22 @@ void app_main()
     //configure GPIO with the given settings
     gpio_config(&io_conf);
 
+    dlog_start();
+    edge_ring_init(&edges);
+    pulse_stats_init(&stats, CPU_TICK_HZ, JITTER_BIN_TICKS);
+
+#if LOOPBACK_BENCH
+    // ISR, toggle timer and task1 must share core 0's cycle counter
+    loopback_bench_init(&bench, &bench_hal, CPU_TICK_HZ);
+    xTaskCreatePinnedToCore(task1, "task1", 2048, NULL, 10, &task1_handle, 0);
+#else
+    xTaskCreate(task1, "task1", 2048, NULL, 10, &task1_handle);
+#endif
+    xTaskCreate(stats_task, "stats_task", 2048, NULL, 5, NULL);
+
+#if MULTI_CHANNEL_CAPTURE
+    gpio_capture_start(CAPTURE_PIN_MASK, &edges, task1_handle);
+#else
     io_conf.intr_type = GPIO_INTR_POSEDGE;
     io_conf.pin_bit_mask = GPIO_INPUT_PIN_SEL;
     io_conf.mode = GPIO_MODE_INPUT;
@@ -61,28 +214,23 @@ void app_main()
     gpio_config(&io_conf);
 
     gpio_set_intr_type(GPIO_INPUT_IO, GPIO_INTR_ANYEDGE);
-    
-    queue = xQueueCreate(10, sizeof(uint32_t));
-
-    xTaskCreate(task1, "task1", 2048, NULL, 10, NULL);
 
     gpio_install_isr_service(0);
     gpio_isr_handler_add(GPIO_INPUT_IO, gpio_isr_handler, (void *)GPIO_INPUT_IO);
-    gpio_isr_handler_remove(GPIO_INPUT_IO);
-
-    uint32_t cnt = 0;
-    for(;;)
-    {
-        gpio_set_level(GPIO_OUTPUT_IO, 0 | cnt % 2);
-        vTaskDelay(1000 / portTICK_PERIOD_MS);
-
-        gpio_set_level(GPIO_OUTPUT_IO, 1);
-        vTaskDelay(750 / portTICK_PERIOD_MS);
+#endif
 
-        gpio_set_level(GPIO_OUTPUT_IO, 0 | cnt % 2);
-        vTaskDelay(500 / portTICK_PERIOD_MS);
-
-        gpio_set_level(GPIO_OUTPUT_IO, 1);
-        vTaskDelay(250 / portTICK_PERIOD_MS);
-    }
-}
\ No newline at end of file
+#if LOOPBACK_BENCH
+    esp_timer_handle_t bench_timer;
+    esp_timer_create_args_t bench_args = {
+        .callback = bench_timer_cb,
+        .name = "loopback",
+    };
+    esp_timer_create(&bench_args, &bench_timer);
+    esp_timer_start_periodic(bench_timer, 1000000 / LOOPBACK_RATE_HZ);
+#else
+    wave_seq_init(GPIO_OUTPUT_PIN_SEL);
+    wave_seq_load(blink_pattern, sizeof(blink_pattern) / sizeof(blink_pattern[0]), 0);
+    wave_seq_jitter_enable(WAVE_JITTER_MODE);
+    wave_seq_start();
+#endif
+}
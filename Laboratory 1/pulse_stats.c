@@ -0,0 +1,116 @@
+#include <string.h>
+#include "pulse_stats.h"
+
+#define WIN_MASK (PULSE_STATS_WINDOW - 1)
+
+void pulse_stats_init(pulse_stats_t *s, uint32_t tick_hz, uint32_t jitter_bin_ticks)
+{
+    memset(s, 0, sizeof(*s));
+    s->tick_hz = tick_hz;
+    s->jitter_bin_ticks = jitter_bin_ticks ? jitter_bin_ticks : 1;
+}
+
+static void add_period(pulse_stats_t *s, uint32_t period, uint32_t high)
+{
+    uint32_t seq = s->seq;
+    uint32_t n = seq < PULSE_STATS_WINDOW ? seq : PULSE_STATS_WINDOW;
+
+    // jitter is the distance from the window mean before this sample
+    uint32_t bin = 0;
+    if (n) {
+        uint32_t mean = (uint32_t)(s->period_sum / n);
+        uint32_t dev = period > mean ? period - mean : mean - period;
+        bin = dev / s->jitter_bin_ticks;
+        if (bin >= PULSE_STATS_JITTER_BINS) {
+            bin = PULSE_STATS_JITTER_BINS - 1;
+        }
+    }
+
+    // evict the sample that falls out of the window
+    if (seq >= PULSE_STATS_WINDOW) {
+        uint32_t old = seq & WIN_MASK;
+        s->period_sum -= s->period[old];
+        s->high_sum -= s->high[old];
+        s->hist[s->bin[old]]--;
+
+        uint32_t expired = seq - PULSE_STATS_WINDOW;
+        if (s->min_head != s->min_tail && s->minq[s->min_head & WIN_MASK] == expired) {
+            s->min_head++;
+        }
+        if (s->max_head != s->max_tail && s->maxq[s->max_head & WIN_MASK] == expired) {
+            s->max_head++;
+        }
+    }
+
+    uint32_t slot = seq & WIN_MASK;
+    s->period[slot] = period;
+    s->high[slot] = high;
+    s->bin[slot] = (uint8_t)bin;
+    s->period_sum += period;
+    s->high_sum += high;
+    s->hist[bin]++;
+
+    while (s->min_head != s->min_tail &&
+           s->period[s->minq[(s->min_tail - 1) & WIN_MASK] & WIN_MASK] >= period) {
+        s->min_tail--;
+    }
+    s->minq[s->min_tail++ & WIN_MASK] = seq;
+
+    while (s->max_head != s->max_tail &&
+           s->period[s->maxq[(s->max_tail - 1) & WIN_MASK] & WIN_MASK] <= period) {
+        s->max_tail--;
+    }
+    s->maxq[s->max_tail++ & WIN_MASK] = seq;
+
+    s->seq = seq + 1;
+}
+
+void pulse_stats_edge(pulse_stats_t *s, uint32_t ticks, uint32_t level)
+{
+    uint32_t v = s->version;
+    __atomic_store_n(&s->version, v + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    s->edges++;
+    if (level) {
+        if (s->have_rise) {
+            add_period(s, ticks - s->last_rise, s->pending_high);
+        }
+        s->last_rise = ticks;
+        s->pending_high = 0;
+        s->have_rise = 1;
+    } else if (s->have_rise) {
+        s->pending_high = ticks - s->last_rise;
+    }
+
+    __atomic_store_n(&s->version, v + 2, __ATOMIC_RELEASE);
+}
+
+void pulse_stats_snapshot(const pulse_stats_t *s, pulse_snapshot_t *out)
+{
+    uint32_t v1, v2;
+    uint64_t period_sum, high_sum;
+    uint32_t seq;
+
+    do {
+        v1 = __atomic_load_n(&s->version, __ATOMIC_ACQUIRE);
+        if (v1 & 1) {
+            continue;
+        }
+        out->edges = s->edges;
+        seq = s->seq;
+        period_sum = s->period_sum;
+        high_sum = s->high_sum;
+        out->period_min = seq ? s->period[s->minq[s->min_head & WIN_MASK] & WIN_MASK] : 0;
+        out->period_max = seq ? s->period[s->maxq[s->max_head & WIN_MASK] & WIN_MASK] : 0;
+        memcpy(out->jitter_hist, s->hist, sizeof(out->jitter_hist));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        v2 = __atomic_load_n(&s->version, __ATOMIC_RELAXED);
+    } while ((v1 & 1) || v1 != v2);
+
+    uint32_t n = seq < PULSE_STATS_WINDOW ? seq : PULSE_STATS_WINDOW;
+    out->periods = n;
+    out->period_avg = n ? (uint32_t)(period_sum / n) : 0;
+    out->freq_mhz = period_sum ? (uint32_t)((uint64_t)s->tick_hz * 1000 * n / period_sum) : 0;
+    out->duty_permille = period_sum ? (uint32_t)(high_sum * 1000 / period_sum) : 0;
+}
@@ -0,0 +1,58 @@
+#ifndef _PULSE_STATS_H_
+#define _PULSE_STATS_H_
+
+#include <stdint.h>
+
+// Number of periods in the sliding window, must be a power of two
+#define PULSE_STATS_WINDOW 64
+#define PULSE_STATS_JITTER_BINS 16
+
+typedef struct {
+    uint32_t edges;             // total edges fed since init
+    uint32_t periods;           // periods currently in the window
+    uint32_t period_avg;        // ticks
+    uint32_t period_min;        // ticks
+    uint32_t period_max;        // ticks
+    uint32_t freq_mhz;          // frequency in milli-Hz
+    uint32_t duty_permille;     // high time / period, 0..1000
+    uint32_t jitter_hist[PULSE_STATS_JITTER_BINS];
+} pulse_snapshot_t;
+
+/* Running statistics over the last PULSE_STATS_WINDOW rising-to-rising
+ * periods. pulse_stats_edge() is O(1) amortized and must be called from a
+ * single writer; pulse_stats_snapshot() may be called from any other task
+ * and never blocks the writer (sequence lock). */
+typedef struct {
+    uint32_t tick_hz;
+    uint32_t jitter_bin_ticks;  // width of one jitter histogram bin
+
+    // edge tracking
+    uint32_t last_rise;
+    uint32_t pending_high;
+    uint8_t have_rise;
+
+    // window contents, indexed by period sequence number
+    uint32_t period[PULSE_STATS_WINDOW];
+    uint32_t high[PULSE_STATS_WINDOW];
+    uint8_t bin[PULSE_STATS_WINDOW];
+    uint32_t seq;
+    uint64_t period_sum;
+    uint64_t high_sum;
+
+    // monotonic deques of sequence numbers for window min/max
+    uint32_t minq[PULSE_STATS_WINDOW];
+    uint32_t maxq[PULSE_STATS_WINDOW];
+    uint32_t min_head, min_tail;
+    uint32_t max_head, max_tail;
+
+    uint32_t hist[PULSE_STATS_JITTER_BINS];
+    uint32_t edges;
+
+    volatile uint32_t version;
+} pulse_stats_t;
+
+void pulse_stats_init(pulse_stats_t *s, uint32_t tick_hz, uint32_t jitter_bin_ticks);
+void pulse_stats_edge(pulse_stats_t *s, uint32_t ticks, uint32_t level);
+void pulse_stats_snapshot(const pulse_stats_t *s, pulse_snapshot_t *out);
+
+#endif
@@ -0,0 +1,172 @@
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_timer.h"
+#include "esp_attr.h"
+#include "soc/gpio_reg.h"
+
+#include "wave_seq.h"
+
+#ifdef CONFIG_ESP_TIMER_SUPPORTS_ISR_DISPATCH_METHOD
+#define WAVE_DISPATCH ESP_TIMER_ISR
+#define WAVE_ATTR IRAM_ATTR
+#else
+#define WAVE_DISPATCH ESP_TIMER_TASK
+#define WAVE_ATTR
+#endif
+
+typedef struct {
+    wave_step_t steps[WAVE_SEQ_MAX_STEPS];
+    size_t count;
+    uint32_t loops;
+} wave_table_t;
+
+static wave_table_t s_tables[2];
+static wave_table_t *s_active = &s_tables[0];
+static wave_table_t *s_pending = NULL;
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static esp_timer_handle_t s_timer;
+static uint32_t s_out_mask;
+static size_t s_step;
+static uint32_t s_pass;
+static int64_t s_deadline;
+static volatile bool s_running;
+
+static bool s_jitter;
+static uint32_t s_j_samples;
+static int32_t s_j_min, s_j_max;
+static int64_t s_j_sum;
+
+// Called with s_lock held: one write, so every output of the step changes on the same cycle
+static void WAVE_ATTR apply_step(const wave_step_t *st)
+{
+    uint32_t out = REG_READ(GPIO_OUT_REG);
+    out |= st->set_mask & s_out_mask;
+    out &= ~(st->clr_mask & s_out_mask);
+    REG_WRITE(GPIO_OUT_REG, out);
+}
+
+static void WAVE_ATTR wave_timer_cb(void *arg)
+{
+    int64_t now = esp_timer_get_time();
+
+    portENTER_CRITICAL_SAFE(&s_lock);
+    if (!s_running) {
+        portEXIT_CRITICAL_SAFE(&s_lock);
+        return;
+    }
+
+    if (s_jitter) {
+        int32_t late = (int32_t)(now - s_deadline);
+        if (!s_j_samples || late < s_j_min) s_j_min = late;
+        if (!s_j_samples || late > s_j_max) s_j_max = late;
+        s_j_sum += late;
+        s_j_samples++;
+    }
+
+    if (++s_step >= s_active->count) {
+        s_step = 0;
+        s_pass++;
+        if (s_pending) {
+            // runtime reload takes effect on a pass boundary
+            s_active = s_pending;
+            s_pending = NULL;
+            s_pass = 0;
+        } else if (s_active->loops && s_pass >= s_active->loops) {
+            s_running = false;
+            portEXIT_CRITICAL_SAFE(&s_lock);
+            return;
+        }
+    }
+
+    const wave_step_t *st = &s_active->steps[s_step];
+    apply_step(st);
+    s_deadline += st->duration_us;
+    portEXIT_CRITICAL_SAFE(&s_lock);
+
+    int64_t wait = s_deadline - esp_timer_get_time();
+    esp_timer_start_once(s_timer, wait > 0 ? wait : 0);
+}
+
+esp_err_t wave_seq_init(uint32_t out_mask)
+{
+    esp_timer_create_args_t args = {
+        .callback = wave_timer_cb,
+        .dispatch_method = WAVE_DISPATCH,
+        .name = "wave_seq",
+    };
+    s_out_mask = out_mask;
+    return esp_timer_create(&args, &s_timer);
+}
+
+esp_err_t wave_seq_load(const wave_step_t *steps, size_t count, uint32_t loops)
+{
+    if (!count || count > WAVE_SEQ_MAX_STEPS) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    portENTER_CRITICAL(&s_lock);
+    wave_table_t *t = (s_active == &s_tables[0]) ? &s_tables[1] : &s_tables[0];
+    memcpy(t->steps, steps, count * sizeof(*steps));
+    t->count = count;
+    t->loops = loops;
+    if (s_running) {
+        s_pending = t;
+    } else {
+        s_active = t;
+        s_pending = NULL;
+    }
+    portEXIT_CRITICAL(&s_lock);
+    return ESP_OK;
+}
+
+esp_err_t wave_seq_start(void)
+{
+    if (!s_timer || !s_active->count) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    wave_seq_stop();
+
+    portENTER_CRITICAL(&s_lock);
+    s_step = 0;
+    s_pass = 0;
+    s_running = true;
+    apply_step(&s_active->steps[0]);
+    s_deadline = esp_timer_get_time() + s_active->steps[0].duration_us;
+    uint32_t first = s_active->steps[0].duration_us;
+    portEXIT_CRITICAL(&s_lock);
+
+    return esp_timer_start_once(s_timer, first);
+}
+
+void wave_seq_stop(void)
+{
+    s_running = false;
+    esp_timer_stop(s_timer);
+}
+
+bool wave_seq_running(void)
+{
+    return s_running;
+}
+
+void wave_seq_jitter_enable(bool enable)
+{
+    portENTER_CRITICAL(&s_lock);
+    s_jitter = enable;
+    s_j_samples = 0;
+    s_j_sum = 0;
+    s_j_min = 0;
+    s_j_max = 0;
+    portEXIT_CRITICAL(&s_lock);
+}
+
+void wave_seq_get_jitter(wave_jitter_t *out)
+{
+    portENTER_CRITICAL(&s_lock);
+    out->samples = s_j_samples;
+    out->min_us = s_j_min;
+    out->max_us = s_j_max;
+    out->avg_us = s_j_samples ? (int32_t)(s_j_sum / s_j_samples) : 0;
+    portEXIT_CRITICAL(&s_lock);
+}
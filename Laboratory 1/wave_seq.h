@@ -0,0 +1,44 @@
+#ifndef _WAVE_SEQ_H_
+#define _WAVE_SEQ_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+#define WAVE_SEQ_MAX_STEPS 32
+
+typedef struct {
+    uint32_t set_mask;      // outputs driven high when the step starts
+    uint32_t clr_mask;      // outputs driven low when the step starts
+    uint32_t duration_us;   // time until the next step
+} wave_step_t;
+
+typedef struct {
+    uint32_t samples;
+    int32_t min_us;         // lateness of a step versus its deadline
+    int32_t max_us;
+    int32_t avg_us;
+} wave_jitter_t;
+
+/* Table-driven output sequencer driven by one esp_timer one-shot. Steps are
+ * scheduled against absolute deadlines so timer latency does not accumulate.
+ * A step is one read-modify-write of GPIO_OUT_REG under the sequencer's
+ * lock, so all its outputs change on the same cycle (a pin in both masks
+ * ends low). Other GPIO0..31 outputs must not be written from the other
+ * core while the sequencer runs: a write landing inside the
+ * read-modify-write is undone. Only GPIO0..31 can be driven. */
+esp_err_t wave_seq_init(uint32_t out_mask);
+
+/* Copies a pattern into the sequencer. loops = 0 repeats forever. If the
+ * sequencer is running the new pattern starts when the current pass ends. */
+esp_err_t wave_seq_load(const wave_step_t *steps, size_t count, uint32_t loops);
+
+esp_err_t wave_seq_start(void);
+void wave_seq_stop(void);
+bool wave_seq_running(void);
+
+void wave_seq_jitter_enable(bool enable);
+void wave_seq_get_jitter(wave_jitter_t *out);
+
+#endif
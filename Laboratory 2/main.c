@@ -23,11 +23,23 @@
 #include "lwip/netdb.h"
 #include <driver/gpio.h>
 #include <lwip/netdb.h>
+#include "esp_mac.h"
+#include "esp_timer.h"
+
+#include "udp_tx.h"
+#include "../button/include/button_gpio.h"
 
 #define GPIO_INPUT_IO 2
 #define GPIO_INPUT_PIN_SEL (1ULL<<GPIO_INPUT_IO)
+#define GPIO_REMOTE_IO 4    // pin reported to the peer
 #define ESP_INTR_FLAG_DEFAULT 0
 
+// 1 = send on every debounced press (interrupt), 0 = sample the button once per second
+#define SEND_MODE_COS       1
+#define COS_DEBOUNCE_MS     30      // both edges must settle this long, see button/
+#define COS_HEARTBEAT_MS    10000   // resend the current state when idle this long
+#define UDP_RELIABLE        1       // peer ACKs frames, lost ones are retransmitted
+
 #define CONFIG_ESP_WIFI_SSID      "lab-iot"
 #define CONFIG_ESP_WIFI_PASS      "IoT-IoT-IoT"
 #define CONFIG_ESP_MAXIMUM_RETRY  5
@@ -35,9 +47,6 @@
 #define CONFIG_PEER_IP_ADDR "192.168.89.46"
 #define CONFIG_PEER_PORT 10001
 
-struct sockaddr_in dest_addr;
-int sock = 0;
-
 float lastToggle = 0;
 bool toggle = false;
 
@@ -54,6 +63,12 @@ static const char *TAG = "wifi station";
 
 static int s_retry_num = 0;
 
+#if SEND_MODE_COS
+static TaskHandle_t s_cos_task;
+static button_gpio_t s_button;
+static volatile int64_t s_press_ts;
+#endif
+
 void init_gpio(void)
 {
     gpio_config_t io_conf = {};
@@ -66,18 +81,82 @@ void init_gpio(void)
     gpio_config(&io_conf);
 }
 
-static void send_udp() {
-    char payload[8] = "GPIO4=0";
-    if (toggle == 1) {
-        payload[6] = '1';
+static void send_udp(int64_t ts_us) {
+    uint32_t pins = toggle ? (1UL << GPIO_REMOTE_IO) : 0;
+    if (!udp_tx_post(pins, ts_us)) {
+        ESP_LOGW(TAG, "Transmit queue full, message dropped");
     }
-    int err = sendto(sock, payload, strlen(payload), 0, (struct sockaddr *)&dest_addr, sizeof(dest_addr));
-    if (err < 0) {
-        ESP_LOGE(TAG, "Error occurred during sending: errno %d", errno);
+}
+
+static uint32_t device_id(void)
+{
+    uint8_t mac[6];
+    esp_efuse_mac_get_default(mac);
+    return ((uint32_t)mac[2] << 24) | ((uint32_t)mac[3] << 16) | ((uint32_t)mac[4] << 8) | mac[5];
+}
+
+static void log_udp_stats(void)
+{
+    udp_tx_stats_t st;
+    udp_tx_get_stats(&st);
+    ESP_LOGI(TAG, "udp: %lu msgs in %lu datagrams, %lu dropped, %lu errors (errno %d), queue %lu/%lu",
+             (unsigned long)st.messages_sent, (unsigned long)st.datagrams, (unsigned long)st.dropped,
+             (unsigned long)st.send_errors, st.last_errno,
+             (unsigned long)st.queue_depth, (unsigned long)st.queue_high_water);
+    ESP_LOGI(TAG, "udp: edge-to-datagram latency avg %lu us, max %lu us",
+             (unsigned long)st.latency_avg_us, (unsigned long)st.latency_max_us);
+#if UDP_RELIABLE
+    ESP_LOGI(TAG, "udp: %lu acks, %lu retransmits, %lu abandoned, %lu stalls, in flight %lu, srtt %lu us, rto %lu us",
+             (unsigned long)st.acks, (unsigned long)st.retransmits, (unsigned long)st.abandoned,
+             (unsigned long)st.window_stalls, (unsigned long)st.in_flight,
+             (unsigned long)st.srtt_us, (unsigned long)st.rto_us);
+#endif
+}
+
+#if SEND_MODE_COS
+/* esp_timer task, once per debounced press: a release, bouncing or not,
+ * has to settle back to idle before the next press can be reported */
+static void button_cb(button_t *btn, button_event_t event, void *arg)
+{
+    if (event != BUTTON_EVENT_DOWN) {
         return;
     }
-    ESP_LOGI(TAG, "Message sent");
+    // stamped with the last raw edge, so the latency includes the debounce wait
+    int64_t now = esp_timer_get_time();
+    uint32_t since_ms = (uint32_t)(now / 1000) - btn->edge_ms;
+    s_press_ts = now - (int64_t)since_ms * 1000;
+    xTaskNotifyGive(s_cos_task);
+}
+
+static void cos_task(void *pvParameters)
+{
+    int64_t last_send = esp_timer_get_time();
+    uint32_t beats = 0;
+    uint32_t presses = 0;
+
+    while (1) {
+        int64_t idle_us = last_send + COS_HEARTBEAT_MS * 1000LL - esp_timer_get_time();
+        TickType_t wait = idle_us > 0 ? pdMS_TO_TICKS(idle_us / 1000) + 1 : 0;
+
+        uint32_t n = ulTaskNotifyTake(pdTRUE, wait);
+        if (n) {
+            // two presses before this task ran cancel out, one send covers both
+            presses += n;
+            if (n & 1) {
+                toggle = !toggle;
+            }
+            ESP_LOGI(TAG, "Sending %d (press %lu)", toggle, (unsigned long)presses);
+            send_udp(s_press_ts);
+        } else {
+            send_udp(esp_timer_get_time());
+            if (++beats % 6 == 0) {
+                log_udp_stats();
+            }
+        }
+        last_send = esp_timer_get_time();
+    }
 }
+#endif
 
 static void event_handler(void* arg, esp_event_base_t event_base,
                                 int32_t event_id, void* event_data)
@@ -161,37 +240,6 @@ bool wifi_init_sta(void)
     return false;
 }
 
-static void udp_task(void *pvParameters)
-{
-    int addr_family = 0;
-    int ip_protocol = 0;
-
-    dest_addr.sin_addr.s_addr = inet_addr(CONFIG_PEER_IP_ADDR); // unde #define CONFIG_PEER_IP_ADDR "192.168.89.abc"
-    dest_addr.sin_family = AF_INET;
-    dest_addr.sin_port = htons(CONFIG_PEER_PORT);
-    addr_family = AF_INET;
-    ip_protocol = IPPROTO_IP;
-
-    sock = socket(addr_family, SOCK_DGRAM, ip_protocol);
-    if (sock < 0) {
-        ESP_LOGE(TAG, "Unable to create socket: errno %d", errno);
-        return;
-    }
-
-    // Set timeout
-    struct timeval timeout;
-    timeout.tv_sec = 10;
-    timeout.tv_usec = 0;
-    setsockopt (sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof timeout);
-
-    ESP_LOGI(TAG, "Socket created, sending to %s:%d", CONFIG_PEER_IP_ADDR, CONFIG_PEER_PORT);
-
-    while(sock >= 0) {}
-    ESP_LOGI(TAG, "Socket disconnected!");
-
-    vTaskDelete(NULL);
-}
-
 void app_main(void)
 {
     //Initialize NVS
@@ -207,17 +255,31 @@ void app_main(void)
 
     if (connected) {
         
+        ESP_ERROR_CHECK(udp_tx_start(CONFIG_PEER_IP_ADDR, CONFIG_PEER_PORT, device_id(), UDP_RELIABLE));
+
+#if SEND_MODE_COS
+        xTaskCreate(cos_task, "cos_task", 4096, NULL, 6, &s_cos_task);
+        // debounced on both edges by the shared button engine
+        button_config_t btn_conf = {
+            .active_level = 0,
+            .debounce_ms = COS_DEBOUNCE_MS,
+        };
+        ESP_ERROR_CHECK(button_gpio_init(&s_button, GPIO_INPUT_IO, &btn_conf, button_cb, NULL));
+#else
         init_gpio();
-        xTaskCreate(udp_task, "udp_task", 4096, NULL, 5, NULL);
-    
+        uint32_t loops = 0;
         while(1) {
             bool level = gpio_get_level(GPIO_INPUT_IO) == 0;
             toggle = toggle ^ level;
             if (level){
                 ESP_LOGI(TAG, "Sending %d (pin lvl %d)", toggle, gpio_get_level(GPIO_INPUT_IO));
-                send_udp();
+                send_udp(esp_timer_get_time());
+            }
+            if (++loops % 10 == 0) {
+                log_udp_stats();
             }
             vTaskDelay(1000/portTICK_PERIOD_MS);
         }
+#endif
     }
 }
\ No newline at end of file
@@ -0,0 +1,147 @@
+import struct
+import time
+
+# Binary GPIO telemetry frame, keep in sync with telemetry/include/telemetry.h
+MAGIC = 0xA5
+VERSION = 1
+TYPE_STATE = 1
+TYPE_ACK = 2
+TYPE_MASK = 0x7F
+FLAG_ACK_REQ = 0x80
+
+HEADER = struct.Struct("<BBBBIIQ")
+RECORD = struct.Struct("<II")
+SACK = struct.Struct("<I")
+SACK_BITS = 32
+MAX_RECORDS = 64
+
+
+class FrameError(ValueError):
+    pass
+
+
+def encode(device_id, seq, ts_us, records, frame_type=TYPE_STATE):
+    """records: list of (offset_us, pins) tuples"""
+    if len(records) > MAX_RECORDS:
+        raise FrameError("too many records")
+    buf = bytearray(HEADER.size + RECORD.size * len(records))
+    HEADER.pack_into(buf, 0, MAGIC, VERSION, frame_type, len(records), device_id, seq, ts_us)
+    off = HEADER.size
+    for offset_us, pins in records:
+        RECORD.pack_into(buf, off, offset_us, pins)
+        off += RECORD.size
+    return bytes(buf)
+
+
+def decode(buf):
+    """Returns (header dict, list of (offset_us, pins))"""
+    if len(buf) < HEADER.size:
+        raise FrameError("short frame")
+    magic, version, frame_type, count, device_id, seq, ts_us = HEADER.unpack_from(buf, 0)
+    if magic != MAGIC:
+        raise FrameError("bad magic")
+    if version != VERSION:
+        raise FrameError("unsupported version %d" % version)
+    if len(buf) < HEADER.size + RECORD.size * count:
+        raise FrameError("short frame")
+    records = list(RECORD.iter_unpack(buf[HEADER.size:HEADER.size + RECORD.size * count]))
+    header = {"type": frame_type, "device_id": device_id, "seq": seq, "ts_us": ts_us}
+    return header, records
+
+
+def encode_ack(device_id, cum_ack, sack):
+    """ACK frame: cumulative ack in the seq field, selective-ack bitmap after the header"""
+    return encode(device_id, cum_ack, 0, [], TYPE_ACK) + SACK.pack(sack)
+
+
+def decode_ack(buf):
+    """Returns (device_id, cum_ack, sack)"""
+    header, _ = decode(buf)
+    if header["type"] & TYPE_MASK != TYPE_ACK or len(buf) < HEADER.size + SACK.size:
+        raise FrameError("not an ACK")
+    return header["device_id"], header["seq"], SACK.unpack_from(buf, HEADER.size)[0]
+
+
+class ReceiveWindow:
+    """Receiver side of the reliable mode, same rules as Laboratory 4/main.c"""
+
+    def __init__(self):
+        self.synced = False
+        self.cum = 0
+        self.sack = 0
+        self.duplicates = 0
+        self.resyncs = 0
+
+    def accept(self, seq):
+        """Returns False for a frame that was already delivered"""
+        d = (seq - self.cum) & 0xFFFFFFFF
+        if d >= 0x80000000:
+            d -= 1 << 32
+        if not self.synced or d > SACK_BITS or d < -0x10000:
+            if self.synced:
+                self.resyncs += 1
+            self.synced = True
+            self.cum = (seq + 1) & 0xFFFFFFFF
+            self.sack = 0
+            return True
+        if d < 0 or (d > 0 and self.sack & (1 << (d - 1))):
+            self.duplicates += 1
+            return False
+        if d == 0:
+            self.cum += 1
+            while self.sack & 1:
+                self.sack >>= 1
+                self.cum += 1
+            self.sack >>= 1
+            self.cum &= 0xFFFFFFFF
+        else:
+            self.sack |= 1 << (d - 1)
+        return True
+
+    def received(self, seq):
+        d = (seq - self.cum) & 0xFFFFFFFF
+        return d >= 0x80000000 or (0 < d <= SACK_BITS and bool(self.sack & (1 << (d - 1))))
+
+
+class SeqTracker:
+    """Counts lost and reordered frames per device from sequence numbers"""
+
+    def __init__(self):
+        self.next_seq = {}
+        self.lost = 0
+        self.reordered = 0
+
+    def update(self, device_id, seq):
+        expected = self.next_seq.get(device_id)
+        if expected is not None:
+            gap = (seq - expected) & 0xFFFFFFFF
+            if gap >= 0x80000000:
+                self.reordered += 1
+                return
+            self.lost += gap
+        self.next_seq[device_id] = (seq + 1) & 0xFFFFFFFF
+
+
+def _bench(iterations=200000):
+    records = [(i * 10, 1 << 4 if i % 2 else 0) for i in range(8)]
+
+    start = time.perf_counter()
+    for seq in range(iterations):
+        decode(encode(0x1234ABCD, seq, seq * 1000, records))
+    binary = time.perf_counter() - start
+    frame_len = len(encode(0x1234ABCD, 0, 0, records))
+
+    text = b"".join(b"GPIO4=%d\n" % (p >> 4) for _, p in records)
+    start = time.perf_counter()
+    for _ in range(iterations):
+        [int(line.split(b"=")[1]) for line in text.split(b"\n") if line]
+    ascii_time = time.perf_counter() - start
+
+    print("binary: %d records in %d bytes, %.2f us per round trip" %
+          (len(records), frame_len, binary * 1e6 / iterations))
+    print("ascii:  %d records in %d bytes (no seq/timestamp), %.2f us per parse" %
+          (len(records), len(text), ascii_time * 1e6 / iterations))
+
+
+if __name__ == "__main__":
+    _bench()
@@ -0,0 +1,288 @@
+"""Stand-in peer for the reliable mode of the Lab 2 -> Lab 4 UDP path.
+
+  python udp_peer.py recv --port 10001 --loss 0.1 --dup 0.05 --reorder 0.05
+  python udp_peer.py send --peer 127.0.0.1:10001 --rate 2000 --loss 0.05
+
+recv plays Laboratory 4: it acknowledges frames and reports delivery and
+gap recovery times. send plays Laboratory 2 (udp_tx.c): same window, RTO
+and retransmit rules, fed by a synthetic state-change source. The
+impairments (--loss, --dup, --reorder, --delay) apply to the datagrams
+this process receives, so running both with impairments hits frames in one
+direction and ACKs in the other.
+"""
+import argparse
+import heapq
+import random
+import select
+import socket
+import time
+
+import telemetry
+
+WINDOW = 8
+MAX_RETX = 6
+RTO_INIT = 0.300
+RTO_MIN = 0.030
+RTO_MAX = 3.0
+
+
+class Impairer:
+    """Delivers received datagrams late, twice or never"""
+
+    def __init__(self, sock, loss, dup, reorder, delay, reorder_delay):
+        self.sock = sock
+        self.loss = loss
+        self.dup = dup
+        self.reorder = reorder
+        self.delay = delay
+        self.reorder_delay = reorder_delay
+        self.pending = []
+        self.order = 0
+        self.dropped = 0
+        self.duplicated = 0
+        self.reordered = 0
+
+    def _push(self, at, data, addr):
+        heapq.heappush(self.pending, (at, self.order, data, addr))
+        self.order += 1
+
+    def timeout(self, limit):
+        if not self.pending:
+            return limit
+        return max(0.0, min(limit, self.pending[0][0] - time.monotonic()))
+
+    def poll(self, limit):
+        """Waits up to limit seconds, returns the datagrams now due"""
+        readable, _, _ = select.select([self.sock], [], [], self.timeout(limit))
+        now = time.monotonic()
+        if readable:
+            data, addr = self.sock.recvfrom(2048)
+            if random.random() < self.loss:
+                self.dropped += 1
+            else:
+                at = now + self.delay
+                if random.random() < self.reorder:
+                    at += self.reorder_delay
+                    self.reordered += 1
+                self._push(at, data, addr)
+                if random.random() < self.dup:
+                    self._push(at + self.delay, data, addr)
+                    self.duplicated += 1
+        due = []
+        while self.pending and self.pending[0][0] <= now:
+            at, _, data, addr = heapq.heappop(self.pending)
+            due.append((data, addr))
+        return due
+
+
+def percentile(samples, p):
+    if not samples:
+        return 0.0
+    samples = sorted(samples)
+    return samples[min(len(samples) - 1, int(len(samples) * p))]
+
+
+def run_recv(args, imp):
+    windows = {}
+    gaps = {}               # (device, seq) -> time the gap was first seen
+    recovery = []
+    frames = unique = records = 0
+    last = time.monotonic()
+    end = last + args.duration if args.duration else None
+
+    while end is None or time.monotonic() < end:
+        for data, addr in imp.poll(0.2):
+            try:
+                header, recs = telemetry.decode(data)
+            except telemetry.FrameError:
+                continue
+            if header["type"] & telemetry.TYPE_MASK != telemetry.TYPE_STATE:
+                continue
+            frames += 1
+            dev, seq = header["device_id"], header["seq"]
+            now = time.monotonic()
+            if not header["type"] & telemetry.FLAG_ACK_REQ:
+                unique += 1
+                records += len(recs)
+                continue
+
+            w = windows.setdefault(dev, telemetry.ReceiveWindow())
+            cum_before = w.cum
+            fresh = w.accept(seq)
+            imp.sock.sendto(telemetry.encode_ack(dev, w.cum, w.sack), addr)
+            if not fresh:
+                continue
+            unique += 1
+            records += len(recs)
+            start = gaps.pop((dev, seq), None)
+            if start is not None:
+                recovery.append(now - start)
+            # frames skipped over by this one are now known to be missing
+            d = (seq - cum_before) & 0xFFFFFFFF
+            if 0 < d <= telemetry.SACK_BITS:
+                for i in range(d):
+                    missing = (cum_before + i) & 0xFFFFFFFF
+                    if not w.received(missing):
+                        gaps.setdefault((dev, missing), now)
+
+        now = time.monotonic()
+        if now - last >= 1.0:
+            print("recv: %d frames/s, %d new, %d records/s, dup %d, resync %d, open gaps %d | "
+                  "injected drop %d dup %d reorder %d | recovery p50 %.1f ms p99 %.1f ms max %.1f ms" %
+                  (frames / (now - last), unique, records / (now - last),
+                   sum(w.duplicates for w in windows.values()), sum(w.resyncs for w in windows.values()),
+                   len(gaps), imp.dropped, imp.duplicated, imp.reordered,
+                   percentile(recovery, 0.5) * 1e3, percentile(recovery, 0.99) * 1e3,
+                   max(recovery, default=0) * 1e3))
+            frames = unique = records = 0
+            last = now
+
+
+class Slot:
+    def __init__(self, frame, records, now, rto):
+        self.frame = frame
+        self.records = records
+        self.first_sent = now
+        self.sent = now
+        self.deadline = now + rto
+        self.retx = 0
+        self.acked = False
+
+
+def run_send(args, imp):
+    host, port = args.peer.split(":")
+    dest = (host, int(port))
+    device_id = args.device_id
+    start = time.monotonic()
+    seq = base = 0
+    slots = {}
+    srtt = rttvar = None
+    rto = RTO_INIT
+    backlog = 0             # state changes produced but not yet framed
+    produced = 0.0
+    produced_at = start
+    stats = dict(frames=0, retx=0, acks=0, abandoned=0, acked_records=0, stalls=0)
+    recovered = []          # first send to ACK of frames that needed a retransmit
+    last = start
+    end = start + args.duration if args.duration else None
+
+    def slide():
+        nonlocal base
+        while base != seq and slots[base].acked:
+            del slots[base]
+            base += 1
+
+    while end is None or time.monotonic() < end:
+        now = time.monotonic()
+
+        # synthetic producer, never waits on the window
+        produced += (now - produced_at) * args.rate
+        produced_at = now
+        whole = int(produced)
+        produced -= whole
+        backlog += whole
+
+        # frame as much of the backlog as the window allows
+        while backlog and seq - base < WINDOW:
+            n = min(backlog, telemetry.MAX_RECORDS)
+            ts_us = int((now - start) * 1e6)
+            recs = [(i, (seq + i) & 1 << 4) for i in range(n)]
+            frame = telemetry.encode(device_id, seq, ts_us, recs,
+                                     telemetry.TYPE_STATE | telemetry.FLAG_ACK_REQ)
+            slots[seq] = Slot(frame, n, now, rto)
+            imp.sock.sendto(frame, dest)
+            stats["frames"] += 1
+            backlog -= n
+            seq += 1
+        if backlog and seq - base >= WINDOW:
+            stats["stalls"] += 1
+
+        # retransmit timer, backing off once per timeout
+        expired = [s for s in slots.values() if not s.acked and now >= s.deadline]
+        if expired:
+            rto = min(rto * 2, RTO_MAX)
+        for s in expired:
+            if s.retx == MAX_RETX:
+                s.acked = True
+                stats["abandoned"] += 1
+                continue
+            s.retx += 1
+            s.sent = now
+            s.deadline = now + rto
+            imp.sock.sendto(s.frame, dest)
+            stats["retx"] += 1
+        slide()
+
+        deadline = min((s.deadline for s in slots.values() if not s.acked), default=now + 0.01)
+        for data, _ in imp.poll(max(0.0, min(deadline - now, 0.005))):
+            try:
+                dev, cum, sack = telemetry.decode_ack(data)
+            except telemetry.FrameError:
+                continue
+            if dev != device_id:
+                continue
+            stats["acks"] += 1
+            now = time.monotonic()
+            newest = None
+            for s_seq, s in slots.items():
+                d = (s_seq - cum) & 0xFFFFFFFF
+                hit = d >= 0x80000000 or (1 <= d <= telemetry.SACK_BITS and sack & (1 << (d - 1)))
+                if hit and not s.acked:
+                    s.acked = True
+                    stats["acked_records"] += s.records
+                    if s.retx == 0:
+                        newest = s.sent if newest is None else max(newest, s.sent)
+                    else:
+                        recovered.append(now - s.first_sent)
+            if newest is not None:
+                # Karn: only frames sent once give an unambiguous sample
+                r = now - newest
+                if srtt is None:
+                    srtt, rttvar = r, r / 2
+                else:
+                    rttvar += (abs(r - srtt) - rttvar) / 4
+                    srtt += (r - srtt) / 8
+                rto = min(max(srtt + 4 * rttvar, RTO_MIN), RTO_MAX)
+            slide()
+
+        now = time.monotonic()
+        if now - stats.setdefault("t", start) >= 1.0:
+            dt = now - stats["t"]
+            print("send: %d frames/s, %d records/s acked, retx %d, abandoned %d, stalls %d, "
+                  "in flight %d, backlog %d, srtt %.1f ms, rto %.1f ms | recovery p50 %.1f ms max %.1f ms" %
+                  (stats["frames"] / dt, stats["acked_records"] / dt, stats["retx"], stats["abandoned"],
+                   stats["stalls"], seq - base, backlog, (srtt or 0) * 1e3, rto * 1e3,
+                   percentile(recovered, 0.5) * 1e3, max(recovered, default=0) * 1e3))
+            stats.update(frames=0, acked_records=0, stalls=0, t=now)
+            recovered.clear()
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("role", choices=["recv", "send"])
+    parser.add_argument("--port", type=int, default=10001, help="local port (recv)")
+    parser.add_argument("--peer", default="127.0.0.1:10001", help="receiver address (send)")
+    parser.add_argument("--device-id", type=lambda s: int(s, 0), default=0xCAFE)
+    parser.add_argument("--rate", type=float, default=1000, help="state changes per second (send)")
+    parser.add_argument("--duration", type=float, default=0, help="seconds, 0 runs until Ctrl-C")
+    parser.add_argument("--loss", type=float, default=0.0, help="probability of dropping a received datagram")
+    parser.add_argument("--dup", type=float, default=0.0, help="probability of delivering it twice")
+    parser.add_argument("--reorder", type=float, default=0.0, help="probability of holding it back")
+    parser.add_argument("--delay", type=float, default=0.0, help="one-way delay added to every datagram, ms")
+    parser.add_argument("--reorder-delay", type=float, default=20.0, help="extra delay of held back datagrams, ms")
+    parser.add_argument("--seed", type=int)
+    args = parser.parse_args()
+
+    random.seed(args.seed)
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    if args.role == "recv":
+        sock.bind(("0.0.0.0", args.port))
+    imp = Impairer(sock, args.loss, args.dup, args.reorder, args.delay / 1e3, args.reorder_delay / 1e3)
+    try:
+        (run_recv if args.role == "recv" else run_send)(args, imp)
+    except KeyboardInterrupt:
+        pass
+
+
+if __name__ == "__main__":
+    main()
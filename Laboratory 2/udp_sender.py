@@ -1,18 +1,273 @@
+"""UDP load generator and latency prober for the Lab 4 receiver and other UDP firmware.
+
+Every datagram is a telemetry frame (telemetry.py) whose timestamp is the
+send time and whose sequence number counts per worker, padded to --size.
+Replies give the round trip time: either the datagram echoed back
+(--echo-server on the target side, or any echo firmware) or, with --ack,
+the ACK frames of the reliable mode (Laboratory 4, one worker only, it
+keeps a single receive window).
+
+  python udp_sender.py --echo-server 10001
+  python udp_sender.py --peer 127.0.0.1:10001 --rate 20000 --size 128 --concurrency 4
+  python udp_sender.py --peer 192.168.89.42:10001 --closed-loop --window 4 --ack
+
+Open loop sends on a fixed schedule whatever happens to the replies,
+closed loop keeps --window requests outstanding per worker. A request
+with no reply after --timeout counts as lost.
+"""
+import argparse
 import socket
+import threading
 import time
 
+import telemetry
+
 # Completati cu adresa IP a platformei ESP32
 PEER_IP = "192.168.89.42"
 PEER_PORT = 10001
 
-TO_SEND = b"GPIO4=0"
+DEVICE_ID = 0x0000CAFE
+GPIO_REMOTE_IO = 4
+
+
+def percentile(samples, p):
+    if not samples:
+        return 0.0
+    return samples[min(len(samples) - 1, int(len(samples) * p))]
+
+
+class Worker:
+    def __init__(self, index, args):
+        self.args = args
+        self.device_id = DEVICE_ID + index
+        self.sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+        self.sock.setsockopt(socket.SOL_SOCKET, socket.SO_RCVBUF, 1 << 20)
+        self.sock.connect(args.peer)
+        self.sock.settimeout(0.2)
+        self.lock = threading.Lock()
+        self.outstanding = {}       # seq -> send time, ns
+        self.window = threading.Semaphore(args.window)
+        self.seq = 0
+        self.running = True
+        # interval counters, swapped out by take()
+        self.sent = self.bytes = self.replies = self.lost = self.late = self.errors = 0
+        self.rtts = []
+
+        records = max(1, min(telemetry.MAX_RECORDS, (args.size - telemetry.HEADER.size) // telemetry.RECORD.size))
+        self.records = records
+        self.padding = bytes(max(0, args.size - telemetry.HEADER.size - records * telemetry.RECORD.size))
+        self.frame_type = telemetry.TYPE_STATE | (telemetry.FLAG_ACK_REQ if args.ack else 0)
+
+    def take(self):
+        with self.lock:
+            out = (self.sent, self.bytes, self.replies, self.lost, self.late, self.errors, self.rtts)
+            self.sent = self.bytes = self.replies = self.lost = self.late = self.errors = 0
+            self.rtts = []
+        return out
+
+    def _send(self):
+        seq = self.seq
+        self.seq = (seq + 1) & 0xFFFFFFFF
+        level = (seq & 1) << GPIO_REMOTE_IO
+        now = time.monotonic_ns()
+        frame = telemetry.encode(self.device_id, seq, now // 1000,
+                                 [(0, level)] * self.records, self.frame_type) + self.padding
+        with self.lock:
+            self.outstanding[seq] = now
+        try:
+            self.sock.send(frame)
+        except OSError:
+            with self.lock:
+                self.errors += 1
+                del self.outstanding[seq]
+            return
+        with self.lock:
+            self.sent += 1
+            self.bytes += len(frame)
+
+    def _answered(self, seqs, now):
+        """Closes the requests in seqs, returns how many were outstanding"""
+        n = 0
+        with self.lock:
+            for seq in seqs:
+                sent = self.outstanding.pop(seq, None)
+                if sent is not None:
+                    self.rtts.append((now - sent) / 1e6)
+                    n += 1
+            self.replies += n
+        for _ in range(n):
+            self.window.release()
+
+    def _expire(self, now):
+        limit = now - int(self.args.timeout * 1e9)
+        with self.lock:
+            old = [seq for seq, sent in self.outstanding.items() if sent < limit]
+            for seq in old:
+                del self.outstanding[seq]
+            self.lost += len(old)
+        for _ in old:
+            self.window.release()
+
+    def receiver(self):
+        last_expire = time.monotonic_ns()
+        while self.running:
+            try:
+                data = self.sock.recv(4096)
+            except socket.timeout:
+                data = None
+            except OSError:
+                # ICMP port unreachable surfaces here on Linux
+                data = None
+                time.sleep(0.01)
+            now = time.monotonic_ns()
+            if data:
+                try:
+                    if self.args.ack:
+                        device_id, cum, sack = telemetry.decode_ack(data)
+                        with self.lock:
+                            pending = list(self.outstanding)
+                        done = [s for s in pending if (s - cum) & 0xFFFFFFFF >= 0x80000000 or
+                                (0 < (s - cum) & 0xFFFFFFFF <= telemetry.SACK_BITS and
+                                 sack >> (((s - cum) & 0xFFFFFFFF) - 1) & 1)]
+                    else:
+                        header, _ = telemetry.decode(data)
+                        device_id, done = header["device_id"], [header["seq"]]
+                except telemetry.FrameError:
+                    continue
+                if device_id == self.device_id:
+                    self._answered(done, now)
+            if now - last_expire > 50_000_000:
+                self._expire(now)
+                last_expire = now
+
+    def open_loop(self, rate, end):
+        period = 1.0 / rate
+        next_send = time.monotonic()
+        while self.running and next_send < end:
+            now = time.monotonic()
+            if now < next_send:
+                time.sleep(next_send - now)
+            elif now - next_send > period:
+                with self.lock:
+                    self.late += 1
+            self._send()
+            # absolute schedule: a late send does not push the others back
+            next_send += period
 
-sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
-while 1:
+    def closed_loop(self, end):
+        while self.running and time.monotonic() < end:
+            if self.window.acquire(timeout=0.1):
+                self._send()
+
+
+def run_load(args):
+    workers = [Worker(i, args) for i in range(args.concurrency)]
+    start = time.monotonic()
+    end = start + args.duration if args.duration else float("inf")
+    threads = []
+    for w in workers:
+        threads.append(threading.Thread(target=w.receiver, daemon=True))
+        if args.closed_loop:
+            threads.append(threading.Thread(target=w.closed_loop, args=(end,), daemon=True))
+        else:
+            threads.append(threading.Thread(target=w.open_loop, args=(args.rate / args.concurrency, end), daemon=True))
+    for t in threads:
+        t.start()
+
+    totals = dict(sent=0, bytes=0, replies=0, lost=0)
+    all_rtts = []
+    last = start
+    try:
+        while time.monotonic() < end + args.timeout:
+            time.sleep(max(0.0, last + 1.0 - time.monotonic()))
+            now = time.monotonic()
+            sent = nbytes = replies = lost = late = errors = 0
+            rtts = []
+            for w in workers:
+                s, b, r, lo, la, e, rt = w.take()
+                sent += s
+                nbytes += b
+                replies += r
+                lost += lo
+                late += la
+                errors += e
+                rtts += rt
+            rtts.sort()
+            all_rtts += rtts
+            dt = now - last
+            last = now
+            totals["sent"] += sent
+            totals["bytes"] += nbytes
+            totals["replies"] += replies
+            totals["lost"] += lost
+            print("%6.1fs  tx %7.0f pkt/s %8.2f Mbit/s  rx %7.0f pkt/s  lost %5d (%.2f%%)  late %d  err %d  "
+                  "rtt p50 %.3f p90 %.3f p99 %.3f max %.3f ms" %
+                  (now - start, sent / dt, nbytes * 8 / dt / 1e6, replies / dt, lost,
+                   100.0 * lost / max(1, replies + lost), late, errors,
+                   percentile(rtts, 0.5), percentile(rtts, 0.9), percentile(rtts, 0.99),
+                   rtts[-1] if rtts else 0.0))
+    except KeyboardInterrupt:
+        pass
+    for w in workers:
+        w.running = False
+
+    all_rtts.sort()
+    elapsed = max(1e-9, last - start)
+    print("total: %d sent, %d replies, %d lost (%.2f%%), %.0f pkt/s, %.2f Mbit/s" %
+          (totals["sent"], totals["replies"], totals["lost"],
+           100.0 * totals["lost"] / max(1, totals["replies"] + totals["lost"]),
+           totals["sent"] / elapsed, totals["bytes"] * 8 / elapsed / 1e6))
+    if all_rtts:
+        print("rtt ms: min %.3f p50 %.3f p90 %.3f p99 %.3f p99.9 %.3f max %.3f" %
+              (all_rtts[0], percentile(all_rtts, 0.5), percentile(all_rtts, 0.9),
+               percentile(all_rtts, 0.99), percentile(all_rtts, 0.999), all_rtts[-1]))
+
+
+def run_echo_server(port):
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.setsockopt(socket.SOL_SOCKET, socket.SO_RCVBUF, 1 << 20)
+    sock.bind(("0.0.0.0", port))
+    print("echo server on udp port %d" % port)
+    count = 0
+    last = time.monotonic()
     try:
-        sock.sendto(TO_SEND, (PEER_IP, PEER_PORT))
-        print("Am trimis mesajul: ", TO_SEND)
-        TO_SEND = b"GPIO4=0" if TO_SEND == b"GPIO4=1" else b"GPIO4=1"
-        time.sleep(1)
+        while True:
+            data, addr = sock.recvfrom(65535)
+            sock.sendto(data, addr)
+            count += 1
+            now = time.monotonic()
+            if now - last >= 1.0:
+                print("echo: %.0f pkt/s" % (count / (now - last)))
+                count = 0
+                last = now
     except KeyboardInterrupt:
-        break
\ No newline at end of file
+        pass
+
+
+def peer_addr(text):
+    host, _, port = text.rpartition(":")
+    return (host or PEER_IP, int(port))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--peer", type=peer_addr, default=(PEER_IP, PEER_PORT), help="target ip:port")
+    parser.add_argument("--rate", type=float, default=1.0, help="total packets per second (open loop)")
+    parser.add_argument("--size", type=int, default=28, help="datagram size in bytes, at least 28")
+    parser.add_argument("--concurrency", type=int, default=1, help="worker threads, one socket each")
+    parser.add_argument("--closed-loop", action="store_true", help="send on reply instead of on a schedule")
+    parser.add_argument("--window", type=int, default=1, help="outstanding requests per worker (closed loop)")
+    parser.add_argument("--timeout", type=float, default=1.0, help="seconds before a request counts as lost")
+    parser.add_argument("--duration", type=float, default=0, help="seconds, 0 runs until Ctrl-C")
+    parser.add_argument("--ack", action="store_true", help="request reliable-mode ACKs instead of echoes")
+    parser.add_argument("--echo-server", type=int, metavar="PORT", help="run a local echo target instead")
+    args = parser.parse_args()
+
+    if args.echo_server:
+        run_echo_server(args.echo_server)
+    else:
+        run_load(args)
+
+
+if __name__ == "__main__":
+    main()
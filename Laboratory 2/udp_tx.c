@@ -0,0 +1,377 @@
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "lwip/sockets.h"
+#include "lwip/netdb.h"
+
+#include "udp_tx.h"
+#include "../telemetry/include/telemetry.h"
+
+typedef struct {
+    int64_t ts_us;
+    uint32_t pins;
+} udp_tx_msg_t;
+
+// one sent frame waiting for its ACK, slot index is seq % UDP_TX_WINDOW
+typedef struct {
+    uint16_t len;
+    uint8_t retx;
+    bool acked;
+    int64_t sent_us;            // last transmission
+    int64_t deadline_us;        // retransmit when still unacked by then
+    uint8_t buf[TELEMETRY_MAX_LEN];
+} tx_slot_t;
+
+static const char *TAG = "udp_tx";
+
+static QueueHandle_t s_queue;
+static struct sockaddr_in s_dest;
+static int s_sock = -1;
+static uint32_t s_device_id;
+static uint32_t s_seq;
+static udp_tx_stats_t s_stats;
+static portMUX_TYPE s_stats_lock = portMUX_INITIALIZER_UNLOCKED;
+static uint64_t s_latency_sum;
+static uint32_t s_latency_samples;
+
+// reliable mode, window [s_base, s_seq) guarded by s_win_lock
+static bool s_reliable;
+static TaskHandle_t s_tx_task;
+static SemaphoreHandle_t s_win_lock;
+static tx_slot_t s_win[UDP_TX_WINDOW];
+static uint32_t s_base;
+static int64_t s_srtt_us;
+static int64_t s_rttvar_us;
+static int64_t s_rto_us = UDP_TX_RTO_INIT_MS * 1000;
+
+static void count_send(int err, int64_t sent, const telemetry_header_t *hdr, const telemetry_record_t *recs)
+{
+    portENTER_CRITICAL(&s_stats_lock);
+    if (err < 0) {
+        s_stats.send_errors++;
+        s_stats.last_errno = errno;
+    } else {
+        s_stats.datagrams++;
+        s_stats.messages_sent += hdr->count;
+        for (uint8_t i = 0; i < hdr->count; i++) {
+            uint32_t lat = (uint32_t)(sent - (int64_t)(hdr->ts_us + recs[i].offset_us));
+            s_latency_sum += lat;
+            s_latency_samples++;
+            if (lat > s_stats.latency_max_us) {
+                s_stats.latency_max_us = lat;
+            }
+        }
+    }
+    portEXIT_CRITICAL(&s_stats_lock);
+
+    if (err < 0) {
+        ESP_LOGE(TAG, "Error occurred during sending: errno %d", errno);
+    }
+}
+
+static void flush(telemetry_header_t *hdr, const telemetry_record_t *recs)
+{
+    static uint8_t buf[TELEMETRY_MAX_LEN];
+
+    hdr->seq = s_seq++;
+    size_t len = telemetry_encode(buf, sizeof(buf), hdr, recs);
+    int err = sendto(s_sock, buf, len, 0, (struct sockaddr *)&s_dest, sizeof(s_dest));
+    count_send(err, esp_timer_get_time(), hdr, recs);
+}
+
+// RFC 6298 estimator, fed only with samples from frames sent once (Karn)
+static void rtt_sample(int64_t rtt_us)
+{
+    if (s_srtt_us == 0) {
+        s_srtt_us = rtt_us;
+        s_rttvar_us = rtt_us / 2;
+    } else {
+        int64_t err = rtt_us - s_srtt_us;
+        s_srtt_us += err / 8;
+        s_rttvar_us += ((err < 0 ? -err : err) - s_rttvar_us) / 4;
+    }
+    s_rto_us = s_srtt_us + 4 * s_rttvar_us;
+    if (s_rto_us < UDP_TX_RTO_MIN_MS * 1000) {
+        s_rto_us = UDP_TX_RTO_MIN_MS * 1000;
+    } else if (s_rto_us > UDP_TX_RTO_MAX_MS * 1000) {
+        s_rto_us = UDP_TX_RTO_MAX_MS * 1000;
+    }
+}
+
+// call with s_win_lock held
+static bool window_full(void)
+{
+    return s_seq - s_base >= UDP_TX_WINDOW;
+}
+
+// call with s_win_lock held, returns true if the window moved
+static bool window_slide(void)
+{
+    uint32_t base = s_base;
+    while (s_base != s_seq && s_win[s_base % UDP_TX_WINDOW].acked) {
+        s_base++;
+    }
+    return s_base != base;
+}
+
+static void flush_reliable(telemetry_header_t *hdr, const telemetry_record_t *recs)
+{
+    xSemaphoreTake(s_win_lock, portMAX_DELAY);
+    tx_slot_t *slot = &s_win[s_seq % UDP_TX_WINDOW];
+    hdr->seq = s_seq++;
+    slot->len = telemetry_encode(slot->buf, sizeof(slot->buf), hdr, recs);
+    slot->retx = 0;
+    slot->acked = false;
+    slot->sent_us = esp_timer_get_time();
+    slot->deadline_us = slot->sent_us + s_rto_us;
+    int err = sendto(s_sock, slot->buf, slot->len, 0, (struct sockaddr *)&s_dest, sizeof(s_dest));
+    xSemaphoreGive(s_win_lock);
+
+    count_send(err, slot->sent_us, hdr, recs);
+}
+
+/* Resends every unacked frame whose deadline has passed and gives up on
+ * frames after UDP_TX_MAX_RETX attempts. Returns the ticks until the next
+ * deadline, portMAX_DELAY when nothing is in flight. */
+static TickType_t service_retransmits(void)
+{
+    uint32_t retransmits = 0, abandoned = 0;
+    int64_t next = INT64_MAX;
+
+    xSemaphoreTake(s_win_lock, portMAX_DELAY);
+    int64_t now = esp_timer_get_time();
+    for (uint32_t seq = s_base; seq != s_seq; seq++) {
+        tx_slot_t *slot = &s_win[seq % UDP_TX_WINDOW];
+        if (slot->acked) {
+            continue;
+        }
+        if (now >= slot->deadline_us) {
+            if (slot->retx == UDP_TX_MAX_RETX) {
+                slot->acked = true;
+                abandoned++;
+                continue;
+            }
+            // exponential backoff once per timeout, kept until a clean
+            // sample resets it
+            if (retransmits == 0) {
+                s_rto_us *= 2;
+                if (s_rto_us > UDP_TX_RTO_MAX_MS * 1000) {
+                    s_rto_us = UDP_TX_RTO_MAX_MS * 1000;
+                }
+            }
+            slot->retx++;
+            slot->sent_us = now;
+            slot->deadline_us = now + s_rto_us;
+            sendto(s_sock, slot->buf, slot->len, 0, (struct sockaddr *)&s_dest, sizeof(s_dest));
+            retransmits++;
+        }
+        if (slot->deadline_us < next) {
+            next = slot->deadline_us;
+        }
+    }
+    window_slide();
+    xSemaphoreGive(s_win_lock);
+
+    if (retransmits || abandoned) {
+        portENTER_CRITICAL(&s_stats_lock);
+        s_stats.retransmits += retransmits;
+        s_stats.abandoned += abandoned;
+        portEXIT_CRITICAL(&s_stats_lock);
+    }
+    if (next == INT64_MAX) {
+        return portMAX_DELAY;
+    }
+    return pdMS_TO_TICKS((next - now) / 1000) + 1;
+}
+
+// blocks the sender task (never the producer) until a frame may be sent
+static void wait_for_window(void)
+{
+    while (1) {
+        TickType_t wait = service_retransmits();
+        xSemaphoreTake(s_win_lock, portMAX_DELAY);
+        bool full = window_full();
+        xSemaphoreGive(s_win_lock);
+        if (!full) {
+            return;
+        }
+        portENTER_CRITICAL(&s_stats_lock);
+        s_stats.window_stalls++;
+        portEXIT_CRITICAL(&s_stats_lock);
+        ulTaskNotifyTake(pdTRUE, wait);
+    }
+}
+
+static void udp_ack_task(void *pvParameters)
+{
+    uint8_t buf[TELEMETRY_ACK_LEN + 8];
+    uint32_t device_id, cum, sack;
+
+    while (1) {
+        int len = recvfrom(s_sock, buf, sizeof(buf), 0, NULL, NULL);
+        if (len < 0) {
+            ESP_LOGE(TAG, "recvfrom failed: errno %d", errno);
+            vTaskDelay(pdMS_TO_TICKS(1000));
+            continue;
+        }
+        if (telemetry_decode_ack(buf, len, &device_id, &cum, &sack) < 0 || device_id != s_device_id) {
+            continue;
+        }
+
+        xSemaphoreTake(s_win_lock, portMAX_DELAY);
+        int64_t now = esp_timer_get_time();
+        int64_t newest = 0;
+        for (uint32_t seq = s_base; seq != s_seq; seq++) {
+            uint32_t d = seq - cum;
+            // below the cumulative ack, or selectively acked above it
+            bool hit = (int32_t)d < 0 || (d >= 1 && d <= 32 && (sack & (1u << (d - 1))));
+            tx_slot_t *slot = &s_win[seq % UDP_TX_WINDOW];
+            if (hit && !slot->acked) {
+                slot->acked = true;
+                if (slot->retx == 0 && slot->sent_us > newest) {
+                    newest = slot->sent_us;
+                }
+            }
+        }
+        if (newest) {
+            rtt_sample(now - newest);
+        }
+        bool moved = window_slide();
+        xSemaphoreGive(s_win_lock);
+
+        portENTER_CRITICAL(&s_stats_lock);
+        s_stats.acks++;
+        portEXIT_CRITICAL(&s_stats_lock);
+        if (moved) {
+            xTaskNotifyGive(s_tx_task);
+        }
+    }
+}
+
+static void udp_tx_task(void *pvParameters)
+{
+    static telemetry_record_t recs[TELEMETRY_MAX_RECORDS];
+    telemetry_header_t hdr = {
+        .version = TELEMETRY_VERSION,
+        .type = TELEMETRY_TYPE_STATE | (s_reliable ? TELEMETRY_FLAG_ACK_REQ : 0),
+    };
+    void (*send_frame)(telemetry_header_t *, const telemetry_record_t *) = s_reliable ? flush_reliable : flush;
+    udp_tx_msg_t msg;
+
+    while (1) {
+        // the only blocking point: idle costs nothing. In reliable mode
+        // the next retransmit deadline bounds the wait, and nothing is
+        // taken off the queue while the window is full.
+        TickType_t wait = portMAX_DELAY;
+        if (s_reliable) {
+            wait_for_window();
+            wait = service_retransmits();
+        }
+        if (xQueueReceive(s_queue, &msg, wait) != pdTRUE) {
+            continue;
+        }
+
+        hdr.device_id = s_device_id;
+        hdr.count = 0;
+        do {
+            // offsets are unsigned 32-bit, start a new frame when one does not fit
+            int64_t offset = msg.ts_us - (int64_t)hdr.ts_us;
+            if (hdr.count && (hdr.count == TELEMETRY_MAX_RECORDS || offset < 0 || offset > UINT32_MAX)) {
+                send_frame(&hdr, recs);
+                hdr.count = 0;
+                if (s_reliable) {
+                    wait_for_window();
+                }
+            }
+            if (hdr.count == 0) {
+                hdr.ts_us = msg.ts_us;
+                offset = 0;
+            }
+            recs[hdr.count].offset_us = (uint32_t)offset;
+            recs[hdr.count].pins = msg.pins;
+            hdr.count++;
+        } while (xQueueReceive(s_queue, &msg, 0) == pdTRUE);
+
+        send_frame(&hdr, recs);
+    }
+}
+
+esp_err_t udp_tx_start(const char *peer_ip, uint16_t peer_port, uint32_t device_id, bool reliable)
+{
+    s_device_id = device_id;
+    s_reliable = reliable;
+    s_dest.sin_addr.s_addr = inet_addr(peer_ip);
+    s_dest.sin_family = AF_INET;
+    s_dest.sin_port = htons(peer_port);
+
+    s_sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_IP);
+    if (s_sock < 0) {
+        ESP_LOGE(TAG, "Unable to create socket: errno %d", errno);
+        return ESP_FAIL;
+    }
+
+    s_queue = xQueueCreate(UDP_TX_QUEUE_LEN, sizeof(udp_tx_msg_t));
+    s_win_lock = xSemaphoreCreateMutex();
+    if (s_queue == NULL || s_win_lock == NULL) {
+        close(s_sock);
+        s_sock = -1;
+        return ESP_ERR_NO_MEM;
+    }
+
+    ESP_LOGI(TAG, "Socket created, sending to %s:%d%s", peer_ip, peer_port, reliable ? " (reliable)" : "");
+    if (xTaskCreate(udp_tx_task, "udp_tx", 4096, NULL, 5, &s_tx_task) != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+    if (reliable && xTaskCreate(udp_ack_task, "udp_ack", 3072, NULL, 6, NULL) != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+bool udp_tx_post(uint32_t pins, int64_t ts_us)
+{
+    udp_tx_msg_t msg = {
+        .ts_us = ts_us,
+        .pins = pins,
+    };
+    if (s_queue == NULL) {
+        return false;
+    }
+
+    bool ok = xQueueSend(s_queue, &msg, 0) == pdTRUE;
+    uint32_t depth = uxQueueMessagesWaiting(s_queue);
+
+    portENTER_CRITICAL(&s_stats_lock);
+    if (ok) {
+        s_stats.enqueued++;
+    } else {
+        s_stats.dropped++;
+    }
+    if (depth > s_stats.queue_high_water) {
+        s_stats.queue_high_water = depth;
+    }
+    portEXIT_CRITICAL(&s_stats_lock);
+    return ok;
+}
+
+void udp_tx_get_stats(udp_tx_stats_t *out)
+{
+    portENTER_CRITICAL(&s_stats_lock);
+    *out = s_stats;
+    out->latency_avg_us = s_latency_samples ? (uint32_t)(s_latency_sum / s_latency_samples) : 0;
+    portEXIT_CRITICAL(&s_stats_lock);
+    out->queue_depth = s_queue ? uxQueueMessagesWaiting(s_queue) : 0;
+
+    if (s_reliable) {
+        xSemaphoreTake(s_win_lock, portMAX_DELAY);
+        out->in_flight = s_seq - s_base;
+        out->srtt_us = (uint32_t)s_srtt_us;
+        out->rto_us = (uint32_t)s_rto_us;
+        xSemaphoreGive(s_win_lock);
+    }
+}
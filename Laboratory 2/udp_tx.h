@@ -0,0 +1,54 @@
+#ifndef _UDP_TX_H_
+#define _UDP_TX_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+#define UDP_TX_QUEUE_LEN     32
+
+// reliable mode
+#define UDP_TX_WINDOW        8      // frames in flight, bounds the retransmit buffer
+#define UDP_TX_MAX_RETX      6      // then the frame is abandoned
+#define UDP_TX_RTO_INIT_MS   300
+#define UDP_TX_RTO_MIN_MS    30
+#define UDP_TX_RTO_MAX_MS    3000
+
+typedef struct {
+    uint32_t enqueued;
+    uint32_t dropped;           // producer found the queue full
+    uint32_t datagrams;
+    uint32_t messages_sent;     // state records, several per datagram
+    uint32_t send_errors;
+    int last_errno;
+    uint32_t queue_depth;
+    uint32_t queue_high_water;
+    uint32_t latency_avg_us;    // record timestamp to sendto() return
+    uint32_t latency_max_us;
+    // reliable mode only
+    uint32_t acks;
+    uint32_t retransmits;
+    uint32_t abandoned;         // gave up after UDP_TX_MAX_RETX
+    uint32_t window_stalls;     // sender waited for the window to open
+    uint32_t in_flight;
+    uint32_t srtt_us;
+    uint32_t rto_us;
+} udp_tx_stats_t;
+
+/* Starts the sender task. It sleeps on the queue and, once woken, packs
+ * every state change that is already pending into as few telemetry
+ * frames (see telemetry.h) as possible, one frame per datagram.
+ *
+ * With reliable set, frames ask the peer for ACKs and are kept in a
+ * window of UDP_TX_WINDOW until acked, retransmitted on an adaptive RTO.
+ * A full window stalls the sender task, never udp_tx_post(); the queue
+ * absorbs the burst and overflows into the dropped counter. */
+esp_err_t udp_tx_start(const char *peer_ip, uint16_t peer_port, uint32_t device_id, bool reliable);
+
+// Never blocks; returns false (and counts a drop) if the queue is full
+bool udp_tx_post(uint32_t pins, int64_t ts_us);
+
+void udp_tx_get_stats(udp_tx_stats_t *out);
+
+#endif
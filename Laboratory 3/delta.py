@@ -0,0 +1,244 @@
+"""Binary delta patches between firmware images (format read by delta_apply.c).
+
+A patch is an 80-byte header followed by a zlib stream of operations that
+rebuild the new image front to back:
+
+  header  "LDP1", u32 flags, u32 base size, 32B base hash, u32 size, 32B sha256
+  COPY    0x01 u32 base offset, u32 length            new = base
+  ADD     0x02 u32 base offset, u32 length, bytes     new = base + bytes (mod 256)
+  INSERT  0x03 u32 length, bytes                      new = bytes
+  END     0x00
+
+All integers are little-endian. ADD covers code that moved: the
+instructions match, only embedded addresses differ, so the added bytes
+are mostly zero and compress away. The base hash is what
+esp_partition_get_sha256() reports for the running app (the SHA-256
+appended to the image). Without flags bit 0 there is no base and the
+patch is just the compressed image.
+
+  python delta.py diff old.bin new.bin patch.ldp
+  python delta.py compress new.bin patch.ldp
+  python delta.py apply old.bin patch.ldp out.bin
+  python delta.py info patch.ldp
+"""
+import argparse
+import hashlib
+import struct
+import sys
+import zlib
+
+MAGIC = b"LDP1"
+HEADER = struct.Struct("<4sII32sI32s")
+FLAG_BASE = 1
+
+OP_END = 0
+OP_COPY = 1
+OP_ADD = 2
+OP_INSERT = 3
+
+BLOCK = 16          # shortest exact match that seeds a COPY/ADD
+INDEX_STRIDE = 4    # base positions indexed, matches of BLOCK + STRIDE - 1 are always found
+GIVE_UP = 32        # an extension stops this many mismatches past its best point
+
+
+class PatchError(Exception):
+    pass
+
+
+def image_hash(data):
+    """SHA-256 as esp_partition_get_sha256() reports it for an app image"""
+    if len(data) > 32 and hashlib.sha256(data[:-32]).digest() == data[-32:]:
+        return data[-32:]
+    return hashlib.sha256(data).digest()
+
+
+def _extend_forward(old, j, new, i):
+    """Length of the approximate match at old[j:], new[i:]; the first BLOCK bytes are equal"""
+    limit = min(len(old) - j, len(new) - i)
+    k = best_len = score = best = BLOCK
+    while k < limit:
+        n = min(64, limit - k)
+        if old[j + k:j + k + n] == new[i + k:i + k + n]:
+            k += n
+            score += n
+        else:
+            score += 1 if old[j + k] == new[i + k] else -1
+            k += 1
+        if score > best:
+            best, best_len = score, k
+        elif score < best - GIVE_UP:
+            break
+    return best_len
+
+
+def _extend_backward(old, j, new, i, limit):
+    """How far the match at (j, i) reaches back, at most limit bytes"""
+    limit = min(limit, j)
+    k = best_len = score = best = 0
+    while k < limit:
+        k += 1
+        score += 1 if old[j - k] == new[i - k] else -1
+        if score > best:
+            best, best_len = score, k
+        elif score < best - GIVE_UP:
+            break
+    return best_len
+
+
+def diff_ops(old, new):
+    """Yields (op, base offset, length, data) covering new from start to end"""
+    index = {}
+    for j in range(0, len(old) - BLOCK + 1, INDEX_STRIDE):
+        index.setdefault(old[j:j + BLOCK], j)
+
+    i = pending = 0
+    shift = None        # base offset - new offset of the previous match
+    while i <= len(new) - BLOCK:
+        key = new[i:i + BLOCK]
+        # code after a match usually carries on at the same shift
+        j = i + shift if shift is not None else -1
+        if not 0 <= j <= len(old) - BLOCK or old[j:j + BLOCK] != key:
+            j = index.get(key)
+            if j is None:
+                i += 1
+                continue
+
+        length = _extend_forward(old, j, new, i)
+        back = _extend_backward(old, j, new, i, i - pending)
+        start, end = i - back, i + length
+        if start > pending:
+            yield OP_INSERT, 0, start - pending, new[pending:start]
+        base, target = old[j - back:j + length], new[start:end]
+        if base == target:
+            yield OP_COPY, j - back, end - start, b""
+        else:
+            yield OP_ADD, j - back, end - start, bytes((t - b) & 0xFF for t, b in zip(target, base))
+        shift = j - i
+        i = pending = end
+    if pending < len(new):
+        yield OP_INSERT, 0, len(new) - pending, new[pending:]
+
+
+def make_patch(old, new, level=9):
+    """Patch from old to new, or just the compressed new image if old is None"""
+    body = bytearray()
+    if old is None:
+        body += struct.pack("<BI", OP_INSERT, len(new)) + new
+        header = HEADER.pack(MAGIC, 0, 0, bytes(32), len(new), hashlib.sha256(new).digest())
+    else:
+        for op, offset, length, data in diff_ops(old, new):
+            if op == OP_INSERT:
+                body += struct.pack("<BI", op, length)
+            else:
+                body += struct.pack("<BII", op, offset, length)
+            body += data
+        header = HEADER.pack(MAGIC, FLAG_BASE, len(old), image_hash(old), len(new),
+                             hashlib.sha256(new).digest())
+    body.append(OP_END)
+    return header + zlib.compress(bytes(body), level)
+
+
+def parse_header(patch):
+    if len(patch) < HEADER.size:
+        raise PatchError("truncated header")
+    magic, flags, base_size, base_hash, size, sha = HEADER.unpack_from(patch)
+    if magic != MAGIC:
+        raise PatchError("not a patch")
+    return dict(flags=flags, base_size=base_size, base_hash=base_hash, size=size, sha256=sha)
+
+
+def apply_patch(old, patch):
+    """Reference implementation of delta_apply.c, returns the new image"""
+    h = parse_header(patch)
+    if h["flags"] & FLAG_BASE:
+        if old is None or len(old) != h["base_size"] or image_hash(old) != h["base_hash"]:
+            raise PatchError("patch is for a different base image")
+    else:
+        old = b""
+    try:
+        body = zlib.decompress(patch[HEADER.size:])
+    except zlib.error as e:
+        raise PatchError(str(e))
+
+    out = bytearray()
+    pos = 0
+    while True:
+        if pos >= len(body):
+            raise PatchError("no END")
+        op = body[pos]
+        if op == OP_END:
+            pos += 1
+            break
+        if op == OP_INSERT:
+            (length,) = struct.unpack_from("<I", body, pos + 1)
+            pos += 5
+            out += body[pos:pos + length]
+            pos += length
+        elif op in (OP_COPY, OP_ADD):
+            offset, length = struct.unpack_from("<II", body, pos + 1)
+            pos += 9
+            if offset + length > len(old):
+                raise PatchError("reads past the base image")
+            base = old[offset:offset + length]
+            if op == OP_COPY:
+                out += base
+            else:
+                out += bytes((b + d) & 0xFF for b, d in zip(base, body[pos:pos + length]))
+                pos += length
+        else:
+            raise PatchError("bad op %d" % op)
+        if len(out) > h["size"]:
+            raise PatchError("image longer than the header says")
+    if pos != len(body) or len(out) != h["size"] or hashlib.sha256(out).digest() != h["sha256"]:
+        raise PatchError("image does not match the header")
+    return bytes(out)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    sub = parser.add_subparsers(dest="cmd", required=True)
+    p = sub.add_parser("diff")
+    p.add_argument("old")
+    p.add_argument("new")
+    p.add_argument("patch")
+    p = sub.add_parser("compress")
+    p.add_argument("new")
+    p.add_argument("patch")
+    p = sub.add_parser("apply")
+    p.add_argument("old")
+    p.add_argument("patch")
+    p.add_argument("out")
+    p = sub.add_parser("info")
+    p.add_argument("patch")
+    args = parser.parse_args()
+
+    def read(path):
+        with open(path, "rb") as f:
+            return f.read()
+
+    if args.cmd in ("diff", "compress"):
+        old = read(args.old) if args.cmd == "diff" else None
+        new = read(args.new)
+        patch = make_patch(old, new)
+        with open(args.patch, "wb") as f:
+            f.write(patch)
+        print("%d -> %d bytes (%.1fx smaller)" % (len(new), len(patch), len(new) / max(len(patch), 1)))
+    elif args.cmd == "apply":
+        try:
+            new = apply_patch(read(args.old), read(args.patch))
+        except PatchError as e:
+            sys.exit("apply failed: %s" % e)
+        with open(args.out, "wb") as f:
+            f.write(new)
+        print("%d bytes, sha256 ok" % len(new))
+    else:
+        h = parse_header(read(args.patch))
+        if h["flags"] & FLAG_BASE:
+            print("base: %d bytes, %s" % (h["base_size"], h["base_hash"].hex()))
+        else:
+            print("base: none (full image)")
+        print("image: %d bytes, sha256 %s" % (h["size"], h["sha256"].hex()))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,355 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "delta_apply.h"
+
+#ifdef ESP_PLATFORM
+// tinfl from the ROM: no code space spent on an inflater
+#include "rom/miniz.h"
+#else
+#include <zlib.h>
+#endif
+
+#define MAGIC         "LDP1"
+#define HEADER_LEN    80
+#define FLAG_BASE     1
+
+#define OP_END        0
+#define OP_COPY       1
+#define OP_ADD        2
+#define OP_INSERT     3
+
+#define BASE_BUF_LEN  512       // base image bytes read per read_base() call
+
+enum {
+    ST_HEADER,
+    ST_OP,
+    ST_ARGS,
+    ST_DATA,
+    ST_END,
+};
+
+struct delta_apply {
+    delta_io_t io;
+    uint8_t want_hash[DELTA_HASH_LEN];
+    int err;
+    int state;
+    uint8_t raw_header[HEADER_LEN];
+    size_t raw_len;
+    delta_header_t header;
+
+    uint8_t op;
+    uint8_t args[8];
+    size_t args_len;
+    size_t args_need;
+    uint32_t offset;            // base offset of the running ADD
+    uint32_t remaining;         // data bytes left in the running ADD/INSERT
+    uint32_t written;
+    bool inflate_done;
+    uint8_t base[BASE_BUF_LEN];
+
+#ifdef ESP_PLATFORM
+    tinfl_decompressor inflator;
+    size_t dict_ofs;
+    // inflate output doubles as the 32 KB history window, ops read straight from it
+    uint8_t dict[TINFL_LZ_DICT_SIZE];
+#else
+    z_stream zs;
+    uint8_t out[4096];
+#endif
+};
+
+static uint32_t le32(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static int emit(delta_apply_t *d, const uint8_t *p, size_t len)
+{
+    if (d->io.write(d->io.ctx, p, len) != 0) {
+        return DELTA_ERR_IO;
+    }
+    d->written += len;
+    return DELTA_OK;
+}
+
+// COPY: base bytes as they are
+static int copy_base(delta_apply_t *d, uint32_t offset, uint32_t len)
+{
+    while (len > 0) {
+        size_t n = len < BASE_BUF_LEN ? len : BASE_BUF_LEN;
+        if (d->io.read_base(d->io.ctx, offset, d->base, n) != 0) {
+            return DELTA_ERR_IO;
+        }
+        int err = emit(d, d->base, n);
+        if (err) {
+            return err;
+        }
+        offset += n;
+        len -= n;
+    }
+    return DELTA_OK;
+}
+
+// ADD: base bytes plus the patch bytes, byte-wise mod 256
+static int add_base(delta_apply_t *d, const uint8_t *p, size_t len)
+{
+    while (len > 0) {
+        size_t n = len < BASE_BUF_LEN ? len : BASE_BUF_LEN;
+        if (d->io.read_base(d->io.ctx, d->offset, d->base, n) != 0) {
+            return DELTA_ERR_IO;
+        }
+        for (size_t i = 0; i < n; i++) {
+            d->base[i] += p[i];
+        }
+        int err = emit(d, d->base, n);
+        if (err) {
+            return err;
+        }
+        d->offset += n;
+        p += n;
+        len -= n;
+    }
+    return DELTA_OK;
+}
+
+static int parse_header(delta_apply_t *d)
+{
+    const uint8_t *p = d->raw_header;
+    delta_header_t *h = &d->header;
+
+    if (memcmp(p, MAGIC, 4) != 0) {
+        return DELTA_ERR_FORMAT;
+    }
+    h->has_base = le32(p + 4) & FLAG_BASE;
+    h->base_size = le32(p + 8);
+    memcpy(h->base_hash, p + 12, DELTA_HASH_LEN);
+    h->image_size = le32(p + 44);
+    memcpy(h->image_sha256, p + 48, DELTA_HASH_LEN);
+    if (!h->has_base) {
+        h->base_size = 0;
+    } else if (memcmp(h->base_hash, d->want_hash, DELTA_HASH_LEN) != 0) {
+        return DELTA_ERR_BASE;
+    }
+    return DELTA_OK;
+}
+
+// The op's arguments are complete
+static int start_op(delta_apply_t *d)
+{
+    uint32_t len = le32(d->args + (d->op == OP_INSERT ? 0 : 4));
+
+    if (len > d->header.image_size - d->written) {
+        return DELTA_ERR_FORMAT;
+    }
+    if (d->op != OP_INSERT) {
+        d->offset = le32(d->args);
+        if (len > d->header.base_size || d->offset > d->header.base_size - len) {
+            return DELTA_ERR_FORMAT;
+        }
+    }
+    if (d->op == OP_COPY) {
+        d->state = ST_OP;
+        return copy_base(d, d->offset, len);
+    }
+    d->remaining = len;
+    d->state = len ? ST_DATA : ST_OP;
+    return DELTA_OK;
+}
+
+// Runs the op stream over a piece of inflated patch
+static int parse(delta_apply_t *d, const uint8_t *p, size_t len)
+{
+    int err = DELTA_OK;
+
+    while (len > 0 && err == DELTA_OK) {
+        size_t n;
+
+        switch (d->state) {
+        case ST_OP:
+            d->op = *p++;
+            len--;
+            d->args_len = 0;
+            if (d->op == OP_END) {
+                d->state = ST_END;
+            } else if (d->op == OP_INSERT) {
+                d->args_need = 4;
+                d->state = ST_ARGS;
+            } else if (d->op == OP_COPY || d->op == OP_ADD) {
+                d->args_need = 8;
+                d->state = ST_ARGS;
+            } else {
+                err = DELTA_ERR_FORMAT;
+            }
+            break;
+        case ST_ARGS:
+            n = d->args_need - d->args_len < len ? d->args_need - d->args_len : len;
+            memcpy(d->args + d->args_len, p, n);
+            d->args_len += n;
+            p += n;
+            len -= n;
+            if (d->args_len == d->args_need) {
+                err = start_op(d);
+            }
+            break;
+        case ST_DATA:
+            n = d->remaining < len ? d->remaining : len;
+            err = d->op == OP_ADD ? add_base(d, p, n) : emit(d, p, n);
+            p += n;
+            len -= n;
+            d->remaining -= n;
+            if (d->remaining == 0) {
+                d->state = ST_OP;
+            }
+            break;
+        default:
+            // nothing may follow END
+            err = DELTA_ERR_FORMAT;
+            break;
+        }
+    }
+    return err;
+}
+
+#ifdef ESP_PLATFORM
+
+static int inflate_init(delta_apply_t *d)
+{
+    tinfl_init(&d->inflator);
+    return DELTA_OK;
+}
+
+static int inflate_feed(delta_apply_t *d, const uint8_t *in, size_t len)
+{
+    while (!d->inflate_done) {
+        size_t in_n = len;
+        size_t out_n = TINFL_LZ_DICT_SIZE - d->dict_ofs;
+        tinfl_status st = tinfl_decompress(&d->inflator, in, &in_n, d->dict, d->dict + d->dict_ofs, &out_n,
+                                           TINFL_FLAG_PARSE_ZLIB_HEADER | TINFL_FLAG_HAS_MORE_INPUT);
+        in += in_n;
+        len -= in_n;
+        int err = parse(d, d->dict + d->dict_ofs, out_n);
+        d->dict_ofs = (d->dict_ofs + out_n) & (TINFL_LZ_DICT_SIZE - 1);
+        if (err) {
+            return err;
+        }
+        if (st < TINFL_STATUS_DONE) {
+            return DELTA_ERR_FORMAT;
+        }
+        if (st == TINFL_STATUS_DONE) {
+            d->inflate_done = true;
+        } else if (st == TINFL_STATUS_NEEDS_MORE_INPUT) {
+            return DELTA_OK;
+        }
+    }
+    return len ? DELTA_ERR_FORMAT : DELTA_OK;
+}
+
+static void inflate_free(delta_apply_t *d)
+{
+    // tinfl state lives in the struct
+}
+
+#else
+
+static int inflate_init(delta_apply_t *d)
+{
+    return inflateInit(&d->zs) == Z_OK ? DELTA_OK : DELTA_ERR_NO_MEM;
+}
+
+static int inflate_feed(delta_apply_t *d, const uint8_t *in, size_t len)
+{
+    d->zs.next_in = (Bytef *)in;
+    d->zs.avail_in = len;
+    while (!d->inflate_done) {
+        d->zs.next_out = d->out;
+        d->zs.avail_out = sizeof(d->out);
+        int ret = inflate(&d->zs, Z_NO_FLUSH);
+        int err = parse(d, d->out, sizeof(d->out) - d->zs.avail_out);
+        if (err) {
+            return err;
+        }
+        if (ret == Z_STREAM_END) {
+            d->inflate_done = true;
+        } else if (ret != Z_OK && ret != Z_BUF_ERROR) {
+            return DELTA_ERR_FORMAT;
+        } else if (d->zs.avail_out != 0) {
+            // all input taken
+            return DELTA_OK;
+        }
+    }
+    return d->zs.avail_in ? DELTA_ERR_FORMAT : DELTA_OK;
+}
+
+static void inflate_free(delta_apply_t *d)
+{
+    inflateEnd(&d->zs);
+}
+
+#endif
+
+delta_apply_t *delta_apply_new(const delta_io_t *io, const uint8_t base_hash[DELTA_HASH_LEN])
+{
+    delta_apply_t *d = calloc(1, sizeof(*d));
+
+    if (d == NULL) {
+        return NULL;
+    }
+    if (inflate_init(d) != DELTA_OK) {
+        free(d);
+        return NULL;
+    }
+    d->io = *io;
+    memcpy(d->want_hash, base_hash, DELTA_HASH_LEN);
+    d->state = ST_HEADER;
+    return d;
+}
+
+int delta_apply_feed(delta_apply_t *d, const void *data, size_t len)
+{
+    const uint8_t *p = data;
+
+    if (d->err) {
+        return d->err;
+    }
+    if (d->state == ST_HEADER) {
+        size_t n = HEADER_LEN - d->raw_len < len ? HEADER_LEN - d->raw_len : len;
+        memcpy(d->raw_header + d->raw_len, p, n);
+        d->raw_len += n;
+        p += n;
+        len -= n;
+        if (d->raw_len < HEADER_LEN) {
+            return DELTA_OK;
+        }
+        d->err = parse_header(d);
+        if (d->err) {
+            return d->err;
+        }
+        d->state = ST_OP;
+    }
+    if (len > 0) {
+        d->err = inflate_feed(d, p, len);
+    }
+    return d->err;
+}
+
+int delta_apply_finish(delta_apply_t *d)
+{
+    if (d->err == DELTA_OK && !(d->inflate_done && d->state == ST_END && d->written == d->header.image_size)) {
+        d->err = DELTA_ERR_FORMAT;
+    }
+    return d->err;
+}
+
+const delta_header_t *delta_apply_header(const delta_apply_t *d)
+{
+    return d->state == ST_HEADER ? NULL : &d->header;
+}
+
+void delta_apply_free(delta_apply_t *d)
+{
+    if (d) {
+        inflate_free(d);
+        free(d);
+    }
+}
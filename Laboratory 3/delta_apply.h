@@ -0,0 +1,56 @@
+#ifndef _DELTA_APPLY_H_
+#define _DELTA_APPLY_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/* Streaming applier for the patches made by delta.py. The patch is fed in
+ * as it arrives from the network; the new image comes out front to back
+ * through write(), the parts it shares with the running image are read
+ * back through read_base(). Memory use is fixed (about 45 KB, most of it
+ * the inflate window) whatever the image size.
+ *
+ * No ESP-IDF calls in here: on a Linux host the same file builds against
+ * zlib instead of the ROM inflater, so patches can be checked off target. */
+
+#define DELTA_OK            0
+#define DELTA_ERR_FORMAT   -1   // corrupt or truncated patch
+#define DELTA_ERR_BASE     -2   // patch was made against another image
+#define DELTA_ERR_IO       -3   // read_base() or write() failed
+#define DELTA_ERR_NO_MEM   -4
+
+#define DELTA_HASH_LEN     32
+
+typedef struct {
+    int (*read_base)(void *ctx, uint32_t offset, void *buf, size_t len);
+    int (*write)(void *ctx, const void *buf, size_t len);
+    void *ctx;
+} delta_io_t;
+
+typedef struct {
+    bool has_base;                      // false: the patch is a compressed full image
+    uint32_t base_size;
+    uint8_t base_hash[DELTA_HASH_LEN];  // as esp_partition_get_sha256() reports it
+    uint32_t image_size;
+    uint8_t image_sha256[DELTA_HASH_LEN];
+} delta_header_t;
+
+typedef struct delta_apply delta_apply_t;
+
+/* base_hash identifies the running image; a patch against anything else
+ * is refused with DELTA_ERR_BASE before a byte is written. */
+delta_apply_t *delta_apply_new(const delta_io_t *io, const uint8_t base_hash[DELTA_HASH_LEN]);
+
+// Any amount of patch data; the first error sticks
+int delta_apply_feed(delta_apply_t *d, const void *data, size_t len);
+
+// DELTA_OK once the whole image has been written
+int delta_apply_finish(delta_apply_t *d);
+
+// NULL until the header has been fed
+const delta_header_t *delta_apply_header(const delta_apply_t *d);
+
+void delta_apply_free(delta_apply_t *d);
+
+#endif
@@ -0,0 +1,191 @@
+/* Host test for delta_apply.c against patches made by delta.py.
+ *
+ * Applies a patch to the base image with the patch fed in pieces of
+ * several sizes, 1 byte included, so every state of the applier sees its
+ * input split at every possible point, and compares the result with the
+ * expected image byte for byte. Then checks that a patch for another
+ * base, a truncated patch and a corrupted one are refused.
+ *
+ *   ./delta_apply_test base.bin patch.ldp expected.bin <base hash hex>
+ *
+ * base.bin is not read for a full-image patch but is still required. */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "delta_apply.h"
+
+typedef struct {
+    uint8_t *data;
+    size_t len;
+} blob_t;
+
+typedef struct {
+    const blob_t *base;
+    uint8_t *out;
+    size_t out_len;
+    size_t out_cap;
+} io_ctx_t;
+
+static int failures;
+
+static blob_t read_file(const char *path)
+{
+    blob_t b = {0};
+    FILE *f = fopen(path, "rb");
+
+    if (f == NULL) {
+        perror(path);
+        exit(2);
+    }
+    fseek(f, 0, SEEK_END);
+    b.len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    b.data = malloc(b.len ? b.len : 1);
+    if (b.data == NULL || fread(b.data, 1, b.len, f) != b.len) {
+        perror(path);
+        exit(2);
+    }
+    fclose(f);
+    return b;
+}
+
+static int parse_hash(const char *hex, uint8_t out[DELTA_HASH_LEN])
+{
+    if (strlen(hex) != 2 * DELTA_HASH_LEN) {
+        return -1;
+    }
+    for (int i = 0; i < DELTA_HASH_LEN; i++) {
+        unsigned v;
+        if (sscanf(hex + 2 * i, "%2x", &v) != 1) {
+            return -1;
+        }
+        out[i] = v;
+    }
+    return 0;
+}
+
+static int read_base(void *ctx, uint32_t offset, void *buf, size_t len)
+{
+    const io_ctx_t *io = ctx;
+
+    if (offset > io->base->len || len > io->base->len - offset) {
+        return -1;
+    }
+    memcpy(buf, io->base->data + offset, len);
+    return 0;
+}
+
+static int write_out(void *ctx, const void *buf, size_t len)
+{
+    io_ctx_t *io = ctx;
+
+    if (len > io->out_cap - io->out_len) {
+        return -1;
+    }
+    memcpy(io->out + io->out_len, buf, len);
+    io->out_len += len;
+    return 0;
+}
+
+/* Feeds patch[0, len) in pieces of step bytes, returns what finish()
+ * does; *out_len is how much came out */
+static int apply(const blob_t *base, const uint8_t *patch, size_t len, const uint8_t hash[DELTA_HASH_LEN],
+                 size_t step, uint8_t *out, size_t out_cap, size_t *out_len)
+{
+    io_ctx_t ctx = { .base = base, .out = out, .out_cap = out_cap };
+    delta_io_t io = { .read_base = read_base, .write = write_out, .ctx = &ctx };
+    delta_apply_t *d = delta_apply_new(&io, hash);
+
+    if (d == NULL) {
+        fprintf(stderr, "delta_apply_new failed\n");
+        exit(2);
+    }
+    int err = DELTA_OK;
+    for (size_t at = 0; at < len && err == DELTA_OK; at += step) {
+        err = delta_apply_feed(d, patch + at, len - at < step ? len - at : step);
+    }
+    if (err == DELTA_OK) {
+        err = delta_apply_finish(d);
+    }
+    delta_apply_free(d);
+    *out_len = ctx.out_len;
+    return err;
+}
+
+int main(int argc, char **argv)
+{
+    static const size_t steps[] = { 1, 3, 79, 80, 81, 512, 4096, 65536 };
+    uint8_t hash[DELTA_HASH_LEN];
+
+    if (argc != 5 || parse_hash(argv[4], hash) != 0) {
+        fprintf(stderr, "usage: %s base.bin patch.ldp expected.bin <base hash hex>\n", argv[0]);
+        return 2;
+    }
+    blob_t base = read_file(argv[1]);
+    blob_t patch = read_file(argv[2]);
+    blob_t want = read_file(argv[3]);
+    // room for more than the image, so an overlong result shows up
+    size_t cap = want.len + 4096;
+    uint8_t *out = malloc(cap);
+    size_t out_len;
+    int err;
+
+    for (size_t i = 0; i < sizeof(steps) / sizeof(steps[0]); i++) {
+        err = apply(&base, patch.data, patch.len, hash, steps[i], out, cap, &out_len);
+        if (err != DELTA_OK || out_len != want.len || memcmp(out, want.data, want.len) != 0) {
+            failures++;
+            fprintf(stderr, "%s, %zu-byte feeds: error %d, %zu of %zu bytes, %s\n", argv[2], steps[i],
+                    err, out_len, want.len,
+                    out_len == want.len && memcmp(out, want.data, want.len) == 0 ? "same" : "different");
+        }
+    }
+    // whole patch in one feed
+    err = apply(&base, patch.data, patch.len, hash, patch.len, out, cap, &out_len);
+    if (err != DELTA_OK || out_len != want.len || memcmp(out, want.data, want.len) != 0) {
+        failures++;
+        fprintf(stderr, "%s, one feed: error %d\n", argv[2], err);
+    }
+
+    // a patch against another image: refused before anything is written
+    uint8_t other[DELTA_HASH_LEN];
+    memcpy(other, hash, sizeof(other));
+    other[0] ^= 0xff;
+    err = apply(&base, patch.data, patch.len, other, 4096, out, cap, &out_len);
+    int has_base = patch.len >= 8 && (patch.data[4] & 1);
+    if (has_base && (err != DELTA_ERR_BASE || out_len != 0)) {
+        failures++;
+        fprintf(stderr, "%s, wrong base: error %d after %zu bytes\n", argv[2], err, out_len);
+    }
+
+    // cut short inside the header, just past it and near the end
+    size_t cuts[] = { 1, 40, 81, patch.len - 1000, patch.len - 2, patch.len - 1 };
+    for (size_t i = 0; i < sizeof(cuts) / sizeof(cuts[0]); i++) {
+        size_t len = cuts[i];
+        if (len == 0 || len >= patch.len) {
+            continue;
+        }
+        err = apply(&base, patch.data, len, hash, 1, out, cap, &out_len);
+        if (err == DELTA_OK) {
+            failures++;
+            fprintf(stderr, "%s, truncated to %zu bytes: accepted\n", argv[2], len);
+        }
+    }
+
+    // a flipped byte in the compressed stream: zlib's checksum, if nothing earlier
+    if (patch.len > 200) {
+        patch.data[patch.len / 2] ^= 0x55;
+        err = apply(&base, patch.data, patch.len, hash, 512, out, cap, &out_len);
+        if (err == DELTA_OK) {
+            failures++;
+            fprintf(stderr, "%s, corrupted: accepted\n", argv[2]);
+        }
+    }
+
+    free(out);
+    free(base.data);
+    free(patch.data);
+    free(want.data);
+    printf("delta_apply %s (%zu bytes -> %zu): %s\n", argv[2], patch.len, want.len, failures ? "FAIL" : "ok");
+    return failures ? 1 : 0;
+}
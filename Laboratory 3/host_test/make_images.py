@@ -0,0 +1,70 @@
+"""Writes a pair of firmware-like images for delta_apply_test.
+
+old.bin and new.bin look like two builds of the same app: code with
+embedded absolute addresses, a function inserted in the middle so
+everything after it moves and its addresses shift, a few patched
+constants, a data section that changes, and the SHA-256 an ESP-IDF app
+image carries in its last 32 bytes. old.hash is the base hash
+delta_apply_new() expects, as esp_partition_get_sha256() reports it.
+
+  python make_images.py [out dir]
+"""
+import hashlib
+import os
+import random
+import struct
+import sys
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), ".."))
+import delta  # noqa: E402
+
+CODE_LEN = 192 * 1024
+DATA_LEN = 24 * 1024
+INSERT_AT = 70 * 1024
+INSERT_LEN = 3000
+LOAD_ADDR = 0x400D0000
+
+
+def code(rng, length, shift, moved_from):
+    """Instructions from a small alphabet, every 16 bytes an absolute address"""
+    out = bytearray()
+    ops = [rng.randbytes(12) for _ in range(64)]
+    for i in range(0, length, 16):
+        target = LOAD_ADDR + rng.randrange(length)
+        if target >= LOAD_ADDR + moved_from:
+            target += shift
+        out += ops[rng.randrange(len(ops))] + struct.pack("<I", target)
+    return out[:length]
+
+
+def app_image(body):
+    return body + hashlib.sha256(body).digest()
+
+
+def main():
+    out = sys.argv[1] if len(sys.argv) > 1 else "."
+    # the same seed for both builds: same code, different layout
+    old_code = code(random.Random(1), CODE_LEN, 0, CODE_LEN)
+    new_code = code(random.Random(1), CODE_LEN, INSERT_LEN, INSERT_AT)
+    rng = random.Random(2)
+    new_code = new_code[:INSERT_AT] + rng.randbytes(INSERT_LEN) + new_code[INSERT_AT:]
+    for _ in range(20):
+        at = rng.randrange(len(new_code) - 4)
+        new_code[at:at + 4] = rng.randbytes(4)
+
+    data = bytearray(random.Random(3).randbytes(DATA_LEN))
+    new_data = bytearray(data)
+    new_data[1000:1200] = rng.randbytes(200)
+
+    old = app_image(bytes(old_code + data))
+    new = app_image(bytes(new_code + new_data))
+    for name, blob in (("old.bin", old), ("new.bin", new)):
+        with open(os.path.join(out, name), "wb") as f:
+            f.write(blob)
+    with open(os.path.join(out, "old.hash"), "w") as f:
+        f.write(delta.image_hash(old).hex() + "\n")
+    print("old %d bytes, new %d bytes" % (len(old), len(new)))
+
+
+if __name__ == "__main__":
+    main()
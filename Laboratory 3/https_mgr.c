@@ -0,0 +1,146 @@
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "https_mgr.h"
+
+#define MAX_REQUEST_HEADERS 4
+#define MAX_DRAIN_BYTES     2048    // more than this left unread: cheaper to reconnect
+
+static const char *TAG = "https_mgr";
+
+static esp_http_client_handle_t s_client;
+static SemaphoreHandle_t s_lock;
+static http_event_handle_cb s_shared_handler;
+static http_event_handle_cb s_request_handler;
+static bool s_connected;                // ON_CONNECTED seen during the last open
+static const char *s_headers[MAX_REQUEST_HEADERS];
+static int s_header_count;
+static https_mgr_stats_t s_stats;
+
+static esp_err_t http_event(esp_http_client_event_t *evt)
+{
+    esp_err_t err = ESP_OK;
+
+    if (evt->event_id == HTTP_EVENT_ON_CONNECTED) {
+        s_connected = true;
+    }
+    if (s_request_handler) {
+        err = s_request_handler(evt);
+    }
+    // bodies are read by the caller, the shared handler would log every chunk of an image
+    if (evt->event_id == HTTP_EVENT_ON_DATA) {
+        return err;
+    }
+    if (s_shared_handler && s_shared_handler(evt) != ESP_OK) {
+        err = ESP_FAIL;
+    }
+    return err;
+}
+
+esp_err_t https_mgr_init(const esp_http_client_config_t *config)
+{
+    if (s_client != NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    esp_http_client_config_t c = *config;
+    s_shared_handler = config->event_handler;
+    c.event_handler = http_event;
+    c.keep_alive_enable = true;
+#if CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS
+    // reconnects resume the last session instead of a full handshake
+    c.save_client_session = true;
+#endif
+    s_lock = xSemaphoreCreateMutex();
+    s_client = esp_http_client_init(&c);
+    return s_client && s_lock ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
+esp_http_client_handle_t https_mgr_begin(const char *url, http_event_handle_cb on_event)
+{
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    s_request_handler = on_event;
+    s_header_count = 0;
+    esp_http_client_set_method(s_client, HTTP_METHOD_GET);
+    // same host and port: the open connection stays, otherwise it is closed
+    if (esp_http_client_set_url(s_client, url) != ESP_OK) {
+        ESP_LOGE(TAG, "bad URL %s", url);
+        s_request_handler = NULL;
+        xSemaphoreGive(s_lock);
+        return NULL;
+    }
+    return s_client;
+}
+
+esp_err_t https_mgr_set_header(esp_http_client_handle_t client, const char *key, const char *value)
+{
+    if (s_header_count == MAX_REQUEST_HEADERS) {
+        return ESP_ERR_NO_MEM;
+    }
+    s_headers[s_header_count++] = key;
+    return esp_http_client_set_header(client, key, value);
+}
+
+int64_t https_mgr_send(esp_http_client_handle_t client)
+{
+    for (int attempt = 0; ; attempt++) {
+        s_connected = false;
+        int64_t start = esp_timer_get_time();
+        esp_err_t err = esp_http_client_open(client, 0);
+        if (s_connected) {
+            uint32_t ms = (esp_timer_get_time() - start) / 1000;
+            s_stats.handshakes++;
+            s_stats.handshake_ms_total += ms;
+            s_stats.handshake_ms_last = ms;
+            if (ms > s_stats.handshake_ms_max) {
+                s_stats.handshake_ms_max = ms;
+            }
+        }
+        int64_t len = err == ESP_OK ? esp_http_client_fetch_headers(client) : ESP_FAIL;
+        if (len >= 0) {
+            s_stats.requests++;
+            if (!s_connected) {
+                s_stats.reused++;
+            }
+            return len;
+        }
+        esp_http_client_close(client);
+        // a fresh connection that fails is not retried
+        if (s_connected || attempt > 0) {
+            return ESP_FAIL;
+        }
+        ESP_LOGI(TAG, "kept-alive connection was closed by the server, reconnecting");
+        s_stats.reconnects++;
+    }
+}
+
+void https_mgr_end(esp_http_client_handle_t client)
+{
+    int status = esp_http_client_get_status_code(client);
+    bool no_body = status == 204 || status == 304;
+
+    // a body left unread would be taken for the next response
+    if (!no_body && !esp_http_client_is_complete_data_received(client)) {
+        char buf[256];
+        int drained = 0, n;
+        while (drained < MAX_DRAIN_BYTES && (n = esp_http_client_read(client, buf, sizeof(buf))) > 0) {
+            drained += n;
+        }
+        if (!esp_http_client_is_complete_data_received(client)) {
+            esp_http_client_close(client);
+        }
+    }
+    for (int i = 0; i < s_header_count; i++) {
+        esp_http_client_delete_header(client, s_headers[i]);
+    }
+    s_header_count = 0;
+    s_request_handler = NULL;
+    xSemaphoreGive(s_lock);
+}
+
+void https_mgr_get_stats(https_mgr_stats_t *out)
+{
+    *out = s_stats;
+}
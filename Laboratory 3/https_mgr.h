@@ -0,0 +1,51 @@
+#ifndef _HTTPS_MGR_H_
+#define _HTTPS_MGR_H_
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "esp_http_client.h"
+
+/* One long-lived HTTPS client shared by every request to the update
+ * server. The connection is kept alive between requests. When the server
+ * drops it, the next request reconnects with the TLS session saved from
+ * the last handshake, which makes for an abbreviated handshake. That
+ * needs CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS in sdkconfig.
+ *
+ * Requests take turns: https_mgr_begin() blocks until the previous
+ * request's https_mgr_end(). */
+
+typedef struct {
+    uint32_t requests;
+    uint32_t reused;            // sent over a connection that was already open
+    uint32_t handshakes;        // new connections, TCP connect plus TLS handshake
+    uint32_t reconnects;        // kept-alive connection found dead, request sent again
+    uint32_t handshake_ms_total;
+    uint32_t handshake_ms_max;
+    uint32_t handshake_ms_last;
+} https_mgr_stats_t;
+
+/* Creates the shared client. config->url is any URL on the server,
+ * config->event_handler sees the events of every request except
+ * HTTP_EVENT_ON_DATA: callers read bodies with esp_http_client_read(). */
+esp_err_t https_mgr_init(const esp_http_client_config_t *config);
+
+/* Takes the client for a GET of url. on_event (may be NULL) sees this
+ * request's events, ON_DATA included, ahead of the shared handler. */
+esp_http_client_handle_t https_mgr_begin(const char *url, http_event_handle_cb on_event);
+
+// Request header for this request only, removed again by https_mgr_end()
+esp_err_t https_mgr_set_header(esp_http_client_handle_t client, const char *key, const char *value);
+
+/* Sends the request and reads the response headers. A kept-alive
+ * connection that went dead is reopened once. Returns what
+ * esp_http_client_fetch_headers() does, negative on failure. */
+int64_t https_mgr_send(esp_http_client_handle_t client);
+
+/* Reads off what is left of the response, up to 2 KB, so the connection
+ * can carry the next request, closes it when more is left or the read
+ * fails, and hands the client back. */
+void https_mgr_end(esp_http_client_handle_t client);
+
+void https_mgr_get_stats(https_mgr_stats_t *out);
+
+#endif
@@ -6,6 +6,7 @@
    software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
    CONDITIONS OF ANY KIND, either express or implied.
 */
+#include <stdio.h>
 #include <string.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
@@ -17,8 +18,8 @@
 #include "esp_log.h"
 #include "nvs_flash.h"
 #include "esp_http_client.h"
-#include "esp_https_ota.h"
 #include "esp_tls.h"
+#include "esp_mac.h"
 
 #include "lwip/err.h"
 #include "lwip/sys.h"
@@ -27,8 +28,11 @@
 #include "lwip/netdb.h"
 
 #include "version.h"
-
-#define MIN(a,b) ((a) < (b) ? (a) : (b))
+#include "ota_engine.h"
+#include "ota_manifest.h"
+#include "https_mgr.h"
+#include "../button/include/button_gpio.h"
+#include "../http_sink/include/http_sink.h"
 
 #define CONFIG_ESP_WIFI_SSID      "lab-iot"
 #define CONFIG_ESP_WIFI_PASS      "IoT-IoT-IoT"
@@ -37,6 +41,17 @@
 
 //TODO: Modificati adresa IP de mai jos pentru a coincide cu cea a PC-ul pe care rulati scriptul python
 #define CONFIG_EXAMPLE_FIRMWARE_UPGRADE_URL "https://192.168.245.214:5000/firmware.bin" 
+// version, hash and download URLs of the newest image, see server.py
+#define CONFIG_EXAMPLE_FIRMWARE_MANIFEST_URL "https://192.168.245.214:5000/manifest.json"
+#define OTA_HW_VARIANT "esp-wrover-kit"         // PlatformIO environment the image is built by
+#define OTA_CHECK_INTERVAL_MS (60 * 60 * 1000)  // update check without a button press
+#define OTA_USE_DELTA 1                         // try a patch (delta.py) before the full image
+
+/* Patches are keyed by this string: server.py archives each image under
+ * its versioning file's contents, and version.h carries the same string */
+#ifndef FIRMWARE_VERSION
+#error "version.h must define FIRMWARE_VERSION, the version in server.py's versioning file"
+#endif
 
 #define GPIO_OUTPUT_IO 4
 #define GPIO_OUTPUT_PIN_SEL (1ULL<<GPIO_OUTPUT_IO)
@@ -51,8 +66,7 @@ static EventGroupHandle_t s_wifi_event_group;
 static EventGroupHandle_t s_event_start_ota;
 #define BIT_BTN_PRESSED    BIT0
 
-#define MAX_HTTP_OUTPUT_BUFFER 2048
-#define MAX_HTTP_RECV_BUFFER 512
+#define KBPS(bytes, ms) ((unsigned long)((ms) ? (bytes) / (ms) : 0))
 
 static const char *TAG = "simple_ota_example";
 extern const uint8_t server_cert_pem_start[] asm("_binary_ca_cert_pem_start");
@@ -62,9 +76,6 @@ static int s_retry_num = 0;
 
 esp_err_t _http_event_handler(esp_http_client_event_t *evt)
 {
-    static char *output_buffer;  // Buffer to store response of http request from event handler
-    static int output_len;       // Stores number of bytes read
-
     switch (evt->event_id) {
     case HTTP_EVENT_ERROR:
         ESP_LOGI(TAG, "HTTP_EVENT_ERROR");
@@ -80,41 +91,6 @@ esp_err_t _http_event_handler(esp_http_client_event_t *evt)
         break;
     case HTTP_EVENT_ON_DATA:
         ESP_LOGI(TAG, "HTTP_EVENT_ON_DATA, len=%d", evt->data_len);
-
-        if (output_len == 0 && evt->user_data)  // Clean the buffer in case of a new request
-            memset(evt->user_data, 0, MAX_HTTP_OUTPUT_BUFFER); // we are just starting to copy the output data into the use
-                
-        if (!esp_http_client_is_chunked_response(evt->client)) 
-        {
-            // If user_data buffer is configured, copy the response into the buffer
-            int copy_len = 0;
-            if (evt->user_data) 
-            {
-                // The last byte in evt->user_data is kept for the NULL character in case of out-of-bound access.
-                copy_len = MIN(evt->data_len, (MAX_HTTP_OUTPUT_BUFFER - output_len));
-                if (copy_len) 
-                    memcpy(evt->user_data + output_len, evt->data, copy_len);
-            } 
-            else 
-            {
-                int content_len = esp_http_client_get_content_length(evt->client);
-                if (output_buffer == NULL) 
-                {
-                    // We initialize output_buffer with 0 because it is used by strlen() and similar functions therefore should be null terminated.
-                    output_buffer = (char *) calloc(content_len + 1, sizeof(char));
-                    output_len = 0;
-                    if (output_buffer == NULL) 
-                    {
-                        ESP_LOGE(TAG, "Failed to allocate memory for output buffer");
-                        return ESP_FAIL;
-                    }
-                }
-                copy_len = MIN(evt->data_len, (content_len - output_len));
-                if (copy_len) 
-                    memcpy(output_buffer + output_len, evt->data, copy_len);                
-            }
-            output_len += copy_len;
-        }
         break;
     case HTTP_EVENT_ON_FINISH:
         ESP_LOGI(TAG, "HTTP_EVENT_ON_FINISH");
@@ -213,79 +189,118 @@ bool wifi_init_sta(void)
 
 static void ota_task(void *pvParameters)
 {
-    xEventGroupWaitBits(s_event_start_ota, BIT_BTN_PRESSED, pdTRUE, pdTRUE, portMAX_DELAY);
-    char local_response_buffer[MAX_HTTP_OUTPUT_BUFFER + 1] = {0};
     ESP_LOGI(TAG, "Starting OTA example task");
 
     esp_http_client_config_t config = {
-        .url = CONFIG_EXAMPLE_FIRMWARE_UPGRADE_URL,
+        .url = CONFIG_EXAMPLE_FIRMWARE_MANIFEST_URL,
         .cert_pem = (char *)server_cert_pem_start,
         .cert_len = 1422,
         .event_handler = _http_event_handler,
         .keep_alive_enable = true,
         .use_global_ca_store = true,
-        .user_data = local_response_buffer,
         .skip_cert_common_name_check = true
     };
-
-    esp_https_ota_config_t ota_config = {
-        .http_config = &config,
-    };
     
     ESP_ERROR_CHECK(esp_tls_init_global_ca_store());
     ESP_ERROR_CHECK(esp_tls_set_global_ca_store((unsigned char*)server_cert_pem_start, server_cert_pem_end - server_cert_pem_start));
-
-    ESP_LOGI(TAG, "Attempting to download update from %s", config.url);
-    esp_err_t ret = esp_https_ota(&ota_config);
-    if (ret == ESP_OK) {
-        ESP_LOGI(TAG, "OTA Succeed, Rebooting...");
-        esp_restart();
-    } else {
-        ESP_LOGE(TAG, "Firmware upgrade failed");
-    }
-
-    esp_http_client_handle_t client = esp_http_client_init(&config);
-    esp_err_t err = esp_http_client_perform(client);
-
-    if (err == ESP_OK) 
-    {
-        ESP_LOGI(TAG, "HTTP GET Status = %d, content_length = %"PRId64,
-                esp_http_client_get_status_code(client),
-                esp_http_client_get_content_length(client));
-    } 
-    else 
-    {
-        ESP_LOGE(TAG, "HTTP GET request failed: %s", esp_err_to_name(err));
-    }
+    // manifest checks, patches and images share one connection
+    ESP_ERROR_CHECK(https_mgr_init(&config));
+
+    // the MAC names the device to a rollout server (ota_server.py cohorts)
+    char manifest_url[sizeof(CONFIG_EXAMPLE_FIRMWARE_MANIFEST_URL) + 20];
+    uint8_t mac[6];
+    ESP_ERROR_CHECK(esp_read_mac(mac, ESP_MAC_WIFI_STA));
+    snprintf(manifest_url, sizeof(manifest_url), "%s?device=%02x%02x%02x%02x%02x%02x",
+             CONFIG_EXAMPLE_FIRMWARE_MANIFEST_URL, mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+
+    // kept between checks, its ETag turns the next check into a 304
+    static ota_manifest_t manifest;
+    ota_manifest_stats_t manifest_stats = {0};
+    // an update cut short before the last reboot carries on without the button
+    bool pending = ota_engine_pending();
 
     while (1) {
-        vTaskDelay(1000 / portTICK_PERIOD_MS);
-    }
-}
+        if (pending) {
+            ESP_LOGI(TAG, "Resuming interrupted update");
+        } else {
+            // the button, or the periodic check when nobody presses it
+            xEventGroupWaitBits(s_event_start_ota, BIT_BTN_PRESSED, pdTRUE, pdTRUE, pdMS_TO_TICKS(OTA_CHECK_INTERVAL_MS));
+        }
 
-static void button_task(void * pvParameter)
-{
-    uint8_t u8Count = 5;
-    int val = 1;
-
-    while(1)
-    {
-        if (gpio_get_level(GPIO_INPUT_IO) != val)
-            u8Count--;
-        else
-            u8Count = 5;
-
-        if(!u8Count) {
-            val = gpio_get_level(GPIO_INPUT_IO);
-
-            if(!gpio_get_level(GPIO_INPUT_IO)){
-                ESP_LOGI(TAG, "Button pressed");
-                xEventGroupSetBits(s_event_start_ota, BIT_BTN_PRESSED);
-                val = gpio_get_level(GPIO_INPUT_IO);
+        esp_err_t ret = ota_manifest_fetch(manifest_url, OTA_HW_VARIANT, &manifest, &manifest_stats);
+        ESP_LOGI(TAG, "Manifest: %lu checks, %lu answered 304, %lu bytes",
+                 (unsigned long)manifest_stats.checks, (unsigned long)manifest_stats.not_modified,
+                 (unsigned long)manifest_stats.bytes);
+        http_sink_stats_t sink_stats;
+        http_sink_get_stats(&sink_stats);
+        ESP_LOGI(TAG, "Response buffers: %lu responses, %lu pool takes, %lu heap allocs, %lu grows, %lu bytes copied",
+                 (unsigned long)sink_stats.responses, (unsigned long)sink_stats.pool_takes,
+                 (unsigned long)sink_stats.heap_allocs, (unsigned long)sink_stats.grows,
+                 (unsigned long)sink_stats.bytes_copied);
+        https_mgr_stats_t tls_stats;
+        https_mgr_get_stats(&tls_stats);
+        ESP_LOGI(TAG, "HTTPS: %lu requests, %lu on a kept-alive connection, %lu handshakes (avg %lu ms, max %lu ms), %lu reconnects",
+                 (unsigned long)tls_stats.requests, (unsigned long)tls_stats.reused, (unsigned long)tls_stats.handshakes,
+                 (unsigned long)(tls_stats.handshakes ? tls_stats.handshake_ms_total / tls_stats.handshakes : 0),
+                 (unsigned long)tls_stats.handshake_ms_max, (unsigned long)tls_stats.reconnects);
+        if (!pending) {
+            if (ret != ESP_OK) {
+                ESP_LOGE(TAG, "Update check failed");
+                continue;
+            }
+            if (!ota_manifest_update_available(&manifest, FIRMWARE_VERSION)) {
+                ESP_LOGI(TAG, "Running %s, the server has %s: nothing to download", FIRMWARE_VERSION, manifest.version);
+                continue;
             }
+            ESP_LOGI(TAG, "Update %s -> %s, %lu bytes", FIRMWARE_VERSION, manifest.version, (unsigned long)manifest.size);
+        }
+        pending = false;
+
+        ota_engine_stats_t stats = {0};
+        ret = ESP_FAIL;
+#if OTA_USE_DELTA
+        // a half-downloaded full image is finished first, the patch would overwrite it
+        if (manifest.delta_url[0] && !ota_engine_pending()) {
+            char delta_url[OTA_MANIFEST_URL_LEN + 48];
+            snprintf(delta_url, sizeof(delta_url), "%s?from=%s", manifest.delta_url, FIRMWARE_VERSION);
+            ESP_LOGI(TAG, "Attempting to download patch from %s", delta_url);
+            // ESP_ERR_NOT_FOUND: same version number, different build, the full image it is
+            ret = ota_engine_run_delta(delta_url, &stats);
+        }
+#endif
+        if (ret != ESP_OK) {
+            const char *url = manifest.url[0] ? manifest.url : CONFIG_EXAMPLE_FIRMWARE_UPGRADE_URL;
+            ESP_LOGI(TAG, "Attempting to download update from %s", url);
+            ret = ota_engine_run(url, manifest.url[0] ? manifest.sha256 : NULL, &stats);
+        }
+        ESP_LOGI(TAG, "OTA: %lu connections, %lu resumed, %lu restarts, %lu bytes downloaded, %lu bytes not fetched again",
+                 (unsigned long)stats.attempts, (unsigned long)stats.resumes, (unsigned long)stats.restarts,
+                 (unsigned long)stats.bytes_downloaded, (unsigned long)stats.bytes_skipped);
+        ESP_LOGI(TAG, "OTA: %lu patch bytes for a %lu byte image",
+                 (unsigned long)stats.delta_bytes, (unsigned long)stats.delta_image_bytes);
+        // bytes per ms is KB/s; the stage that waits least is the bottleneck
+        const ota_pipeline_stats_t *p = &stats.pipeline;
+        ESP_LOGI(TAG, "OTA stages (KB/s): network %lu, sha256 %lu, erase %lu, write %lu; %lu ms total",
+                 KBPS(stats.bytes_downloaded, p->recv_ms), KBPS(p->bytes, p->hash_ms),
+                 KBPS(p->erased_bytes, p->erase_ms), KBPS(p->bytes, p->write_ms), (unsigned long)p->wall_ms);
+        ESP_LOGI(TAG, "OTA stages: network waited %lu ms for flash, flash waited %lu ms for network, %lu bytes erased ahead",
+                 (unsigned long)p->recv_wait_ms, (unsigned long)p->flash_wait_ms, (unsigned long)p->erased_ahead_bytes);
+        if (ret == ESP_OK) {
+            ESP_LOGI(TAG, "OTA Succeed, Rebooting...");
+            esp_restart();
+        } else {
+            ESP_LOGE(TAG, "Firmware upgrade failed");
         }
+    }
+}
+
+static button_gpio_t s_button;
 
-        vTaskDelay(10 / portTICK_PERIOD_MS);
+static void button_cb(button_t *btn, button_event_t event, void *arg)
+{
+    if (event == BUTTON_EVENT_DOWN) {
+        ESP_LOGI(TAG, "Button pressed");
+        xEventGroupSetBits(s_event_start_ota, BIT_BTN_PRESSED);
     }
 }
 
@@ -305,11 +320,6 @@ void gpio_init()
     io_conf.pull_up_en = 0;
     //configure GPIO with the given settings
     gpio_config(&io_conf);
-
-    io_conf.mode = GPIO_MODE_INPUT;
-    io_conf.pin_bit_mask = GPIO_INPUT_PIN_SEL;
-    io_conf.pull_up_en = 1;
-    gpio_config(&io_conf);
 }
 
 void app_main(void)
@@ -329,7 +339,13 @@ void app_main(void)
 
     if (connected) {
         s_event_start_ota = xEventGroupCreate();
-        xTaskCreate(ota_task, "ota_task", 8192, NULL, 5, NULL);
-        xTaskCreate(button_task, "button_task", 4096, NULL, 5, NULL);
+        // the OTA flash stage runs on the other core
+        xTaskCreatePinnedToCore(ota_task, "ota_task", 8192, NULL, 5, NULL, OTA_PIPELINE_NET_CORE);
+
+        button_config_t btn_conf = {
+            .active_level = 0,
+            .debounce_ms = 50,
+        };
+        button_gpio_init(&s_button, GPIO_INPUT_IO, &btn_conf, button_cb, NULL);
     }
 }
\ No newline at end of file
@@ -0,0 +1,287 @@
+"""Concurrent OTA download benchmark for server.py and ota_server.py.
+
+Simulated devices fetch the firmware image at the same time, the way a
+fleet does after a release. Every download is checked against the first
+one (sha256), and the server's Range and ETag handling is exercised:
+with --resume a share of the clients drop the connection halfway and
+continue with a Range request, and every client finishes with a
+conditional GET that must answer 304.
+
+With --manifest each client first asks for the manifest under its own
+device id, the way the firmware does, downloads the image it points to
+and checks it against the manifest's sha256. The summary then shows how
+the rollout split the clients over releases. A 503 (the server's
+transfer cap) is retried after --busy-wait seconds. --metrics prints the
+server's /metrics (ota_server.py) at the end.
+
+  python ota_bench.py --clients 50
+  python ota_bench.py --url https://192.168.245.214:5000/firmware.bin --clients 80 --rate-kbps 200 --resume 0.3
+  python ota_bench.py --clients 50 --server-pid 12345      # also samples the server's RSS (Linux)
+  python ota_bench.py --manifest https://127.0.0.1:5000/manifest.json --clients 300 --metrics
+
+Certificates are not verified, the lab server uses a self-signed one.
+"""
+import argparse
+import hashlib
+import http.client
+import json
+import ssl
+import threading
+import time
+import urllib.parse
+
+CHUNK = 4096
+
+
+def percentile(samples, p):
+    if not samples:
+        return 0.0
+    return samples[min(len(samples) - 1, int(len(samples) * p))]
+
+
+class Client:
+    def __init__(self, index, args):
+        self.index = index
+        self.args = args
+        self.url = urllib.parse.urlsplit(args.url)
+        self.device = "%s%04d" % (args.device_prefix, index)
+        self.statuses = {}
+        self.errors = []
+        self.durations = []
+        self.bytes = 0
+        self.digest = None
+        self.etag = None
+        self.version = None
+        self.busy = 0
+
+    def _connect(self):
+        if self.url.scheme == "https":
+            ctx = ssl.create_default_context()
+            ctx.check_hostname = False
+            ctx.verify_mode = ssl.CERT_NONE
+            return http.client.HTTPSConnection(self.url.hostname, self.url.port or 443,
+                                               timeout=self.args.timeout, context=ctx)
+        return http.client.HTTPConnection(self.url.hostname, self.url.port or 80, timeout=self.args.timeout)
+
+    def _request(self, headers):
+        path = (self.url.path or "/") + ("?" + self.url.query if self.url.query else "")
+        for _ in range(self.args.busy_retries + 1):
+            conn = self._connect()
+            conn.request("GET", path, headers=headers)
+            resp = conn.getresponse()
+            self.statuses[resp.status] = self.statuses.get(resp.status, 0) + 1
+            if resp.status != 503:
+                break
+            # the server is at its transfer cap: come back later, as a device would
+            resp.read()
+            conn.close()
+            self.busy += 1
+            time.sleep(min(float(resp.getheader("Retry-After", "1")), self.args.busy_wait))
+        return conn, resp
+
+    def check_manifest(self):
+        """Points self.url at this device's image, returns its sha256"""
+        self.url = urllib.parse.urlsplit(self.args.manifest)
+        conn, resp = self._request({"X-Device-Id": self.device})
+        body = resp.read()
+        conn.close()
+        if resp.status != 200:
+            raise RuntimeError("manifest answered %d" % resp.status)
+        manifest = json.loads(body)
+        entry = manifest["variants"].get(self.args.variant)
+        if entry is None:
+            raise RuntimeError("no %s image in the manifest" % self.args.variant)
+        self.version = manifest["version"]
+        self.url = urllib.parse.urlsplit(entry["url"])
+        return entry["sha256"]
+
+    def _read(self, resp, h, limit=None):
+        """Reads the body into h at --rate-kbps, returns the byte count"""
+        got = 0
+        start = time.monotonic()
+        rate = self.args.rate_kbps * 1000 / 8
+        while limit is None or got < limit:
+            block = resp.read(CHUNK if limit is None else min(CHUNK, limit - got))
+            if not block:
+                break
+            h.update(block)
+            got += len(block)
+            if rate:
+                # a slow Wi-Fi link drains the socket at its own pace
+                ahead = got / rate - (time.monotonic() - start)
+                if ahead > 0:
+                    time.sleep(ahead)
+        self.bytes += got
+        return got
+
+    def download(self, resume):
+        h = hashlib.sha256()
+        start = time.monotonic()
+        conn, resp = self._request({})
+        if resp.status != 200:
+            raise RuntimeError("GET answered %d" % resp.status)
+        size = int(resp.getheader("Content-Length", "-1"))
+        self.etag = resp.getheader("ETag")
+        if resume and size > 0:
+            # connection lost halfway, continue where the data stopped
+            got = self._read(resp, h, size // 2)
+            conn.close()
+            conn, resp = self._request({"Range": "bytes=%d-" % got})
+            if resp.status != 206:
+                raise RuntimeError("Range request answered %d" % resp.status)
+            expect = "bytes %d-%d/%d" % (got, size - 1, size)
+            if resp.getheader("Content-Range") != expect:
+                raise RuntimeError("Content-Range %r, expected %r" % (resp.getheader("Content-Range"), expect))
+            got += self._read(resp, h)
+        else:
+            got = self._read(resp, h)
+        conn.close()
+        if size >= 0 and got != size:
+            raise RuntimeError("got %d of %d bytes" % (got, size))
+        self.durations.append(time.monotonic() - start)
+        return h.hexdigest()
+
+    def revalidate(self):
+        if not self.etag:
+            raise RuntimeError("no ETag in the response")
+        conn, resp = self._request({"If-None-Match": self.etag})
+        resp.read()
+        conn.close()
+        if resp.status != 304:
+            raise RuntimeError("conditional GET answered %d" % resp.status)
+
+    def run(self, barrier):
+        barrier.wait()
+        resume = self.index < self.args.clients * self.args.resume
+        for _ in range(self.args.downloads):
+            try:
+                expect = self.check_manifest() if self.args.manifest else None
+                digest = self.download(resume)
+                if expect is not None and digest != expect:
+                    raise RuntimeError("image does not match the manifest's sha256")
+                if self.digest is None or expect is not None:
+                    self.digest = digest
+                elif digest != self.digest:
+                    raise RuntimeError("image changed between downloads")
+                self.revalidate()
+            except (OSError, http.client.HTTPException, RuntimeError) as e:
+                self.errors.append(str(e))
+
+
+def server_rss_kb(pid):
+    try:
+        with open("/proc/%d/status" % pid) as f:
+            for line in f:
+                if line.startswith("VmRSS:"):
+                    return int(line.split()[1])
+    except OSError:
+        pass
+    return None
+
+
+def server_metrics(url):
+    """ota_server.py /metrics on the host of url, None if it has none"""
+    u = urllib.parse.urlsplit(url)
+    if u.scheme == "https":
+        ctx = ssl.create_default_context()
+        ctx.check_hostname = False
+        ctx.verify_mode = ssl.CERT_NONE
+        conn = http.client.HTTPSConnection(u.hostname, u.port or 443, timeout=10, context=ctx)
+    else:
+        conn = http.client.HTTPConnection(u.hostname, u.port or 80, timeout=10)
+    try:
+        conn.request("GET", "/metrics")
+        resp = conn.getresponse()
+        return json.loads(resp.read()) if resp.status == 200 else None
+    except (OSError, http.client.HTTPException, ValueError):
+        return None
+    finally:
+        conn.close()
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--url", default="https://127.0.0.1:5000/firmware.bin")
+    parser.add_argument("--clients", type=int, default=50, help="concurrent simulated devices")
+    parser.add_argument("--downloads", type=int, default=1, help="downloads per client")
+    parser.add_argument("--rate-kbps", type=float, default=0, help="per-client link speed, 0 is unlimited")
+    parser.add_argument("--resume", type=float, default=0.2, help="share of clients that resume with Range")
+    parser.add_argument("--timeout", type=float, default=30.0)
+    parser.add_argument("--server-pid", type=int, help="sample VmRSS of this process while running")
+    parser.add_argument("--manifest", help="start every download with this manifest, as the firmware does")
+    parser.add_argument("--variant", default="esp-wrover-kit", help="manifest entry to download")
+    parser.add_argument("--device-prefix", default="bench-", help="device ids are <prefix><client number>")
+    parser.add_argument("--busy-wait", type=float, default=1.0, help="max seconds to wait after a 503")
+    parser.add_argument("--busy-retries", type=int, default=30)
+    parser.add_argument("--metrics", action="store_true", help="print the server's /metrics at the end")
+    args = parser.parse_args()
+
+    clients = [Client(i, args) for i in range(args.clients)]
+    barrier = threading.Barrier(args.clients + 1)
+    threads = [threading.Thread(target=c.run, args=(barrier,), daemon=True) for c in clients]
+    for t in threads:
+        t.start()
+
+    rss_base = server_rss_kb(args.server_pid) if args.server_pid else None
+    rss_peak = rss_base
+    barrier.wait()
+    start = time.monotonic()
+    while any(t.is_alive() for t in threads):
+        time.sleep(0.1)
+        if args.server_pid:
+            rss = server_rss_kb(args.server_pid)
+            if rss is not None and (rss_peak is None or rss > rss_peak):
+                rss_peak = rss
+    elapsed = time.monotonic() - start
+
+    statuses = {}
+    durations = []
+    errors = []
+    digests = set()
+    versions = {}
+    busy = 0
+    total = 0
+    for c in clients:
+        for status, n in c.statuses.items():
+            statuses[status] = statuses.get(status, 0) + n
+        durations += c.durations
+        errors += ["client %d: %s" % (c.index, e) for e in c.errors]
+        total += c.bytes
+        busy += c.busy
+        if c.version:
+            versions[c.version] = versions.get(c.version, 0) + 1
+        elif c.digest:
+            digests.add(c.digest)
+    durations.sort()
+
+    print("%d clients x %d downloads in %.2f s: %d ok, %d failed" %
+          (args.clients, args.downloads, elapsed, len(durations), len(errors)))
+    print("%.1f MB received, %.2f MB/s aggregate" % (total / 1e6, total / 1e6 / max(elapsed, 1e-9)))
+    if durations:
+        print("download s: p50 %.3f p90 %.3f p99 %.3f max %.3f" %
+              (percentile(durations, 0.5), percentile(durations, 0.9), percentile(durations, 0.99), durations[-1]))
+    print("responses: " + ", ".join("%d x %d" % (n, s) for s, n in sorted(statuses.items())))
+    if busy:
+        print("%d requests turned away busy and retried" % busy)
+    if versions:
+        print("releases: " + ", ".join("%s x %d" % (v, n) for v, n in sorted(versions.items())))
+    if len(digests) > 1:
+        print("MISMATCH: clients received %d different images" % len(digests))
+    if rss_peak is not None:
+        print("server RSS: %d kB before, %d kB peak" % (rss_base, rss_peak))
+    if args.metrics:
+        m = server_metrics(args.manifest or args.url)
+        if m is None:
+            print("server has no /metrics")
+        else:
+            print("server: %d connections (%d TLS handshakes, %d resumed), peak %d transfers, %d turned away, "
+                  "peak %.2f MB/s" % (m["connections_total"], m["handshakes"], m["resumed"],
+                                      m["transfers_peak"], m["rejected"], m["peak_bytes_per_s"] / 1e6))
+            print("server: downloads %s, manifests by cohort %s" %
+                  (json.dumps(m["downloads"], sort_keys=True), json.dumps(m["cohorts"], sort_keys=True)))
+    for e in errors[:10]:
+        print(e)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,419 @@
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <stdlib.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_ota_ops.h"
+#include "esp_partition.h"
+#include "esp_rom_crc.h"
+#include "nvs.h"
+#include "mbedtls/sha256.h"
+
+#include "ota_engine.h"
+#include "delta_apply.h"
+#include "https_mgr.h"
+#include "ota_pipeline.h"
+
+#define NVS_NAMESPACE "ota_engine"
+#define NVS_KEY       "progress"
+#define SECTOR_SIZE   4096
+
+static const char *TAG = "ota_engine";
+
+// response headers of the current connection
+static char s_etag[OTA_ENGINE_ETAG_LEN];
+static uint32_t s_content_length;
+static uint32_t s_range_total;      // from Content-Range, 0 for a full (200) response
+
+static esp_err_t http_event(esp_http_client_event_t *evt)
+{
+    if (evt->event_id == HTTP_EVENT_ON_HEADER) {
+        if (strcasecmp(evt->header_key, "ETag") == 0) {
+            strlcpy(s_etag, evt->header_value, sizeof(s_etag));
+        } else if (strcasecmp(evt->header_key, "Content-Length") == 0) {
+            s_content_length = strtoul(evt->header_value, NULL, 10);
+        } else if (strcasecmp(evt->header_key, "Content-Range") == 0) {
+            // bytes <first>-<last>/<total>
+            const char *total = strrchr(evt->header_value, '/');
+            s_range_total = total ? strtoul(total + 1, NULL, 10) : 0;
+        }
+    }
+    return ESP_OK;
+}
+
+static bool load_progress(ota_engine_progress_t *prog)
+{
+    nvs_handle_t nvs;
+    size_t len = sizeof(*prog);
+
+    if (nvs_open(NVS_NAMESPACE, NVS_READONLY, &nvs) != ESP_OK) {
+        return false;
+    }
+    esp_err_t err = nvs_get_blob(nvs, NVS_KEY, prog, &len);
+    nvs_close(nvs);
+    return err == ESP_OK && len == sizeof(*prog);
+}
+
+static void save_progress(const ota_engine_progress_t *prog)
+{
+    nvs_handle_t nvs;
+
+    if (nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs) != ESP_OK) {
+        ESP_LOGE(TAG, "cannot open NVS, progress not saved");
+        return;
+    }
+    if (nvs_set_blob(nvs, NVS_KEY, prog, sizeof(*prog)) != ESP_OK || nvs_commit(nvs) != ESP_OK) {
+        ESP_LOGE(TAG, "progress not saved");
+    }
+    nvs_close(nvs);
+}
+
+static void clear_progress(void)
+{
+    nvs_handle_t nvs;
+
+    if (nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs) == ESP_OK) {
+        nvs_erase_key(nvs, NVS_KEY);
+        nvs_commit(nvs);
+        nvs_close(nvs);
+    }
+}
+
+static void reset_progress(ota_engine_progress_t *prog, const esp_partition_t *part)
+{
+    memset(prog, 0, sizeof(*prog));
+    prog->partition_addr = part->address;
+    clear_progress();
+}
+
+static uint32_t crc_range(const esp_partition_t *part, uint32_t from, uint32_t to, uint32_t crc)
+{
+    static uint8_t buf[1024];
+
+    while (from < to) {
+        uint32_t n = to - from < sizeof(buf) ? to - from : sizeof(buf);
+        if (esp_partition_read(part, from, buf, n) != ESP_OK) {
+            // cannot match any saved CRC, the download starts over
+            return ~crc;
+        }
+        crc = esp_rom_crc32_le(crc, buf, n);
+        from += n;
+    }
+    return crc;
+}
+
+// Saved progress is only trusted if the flash still holds what it describes
+static bool progress_valid(const ota_engine_progress_t *prog, const esp_partition_t *part)
+{
+    uint32_t limit = prog->image_size ? prog->image_size : part->size;
+
+    if (prog->partition_addr != part->address || prog->image_size > part->size ||
+        prog->offset > limit || prog->offset % SECTOR_SIZE) {
+        return false;
+    }
+    return crc_range(part, 0, prog->offset, 0) == prog->crc;
+}
+
+// Moves the saved offset up to the last whole sector below len
+static void commit(ota_engine_progress_t *prog, const esp_partition_t *part, uint32_t len)
+{
+    uint32_t to = len & ~(SECTOR_SIZE - 1);
+
+    if (to <= prog->offset) {
+        return;
+    }
+    // read back from flash: the CRC covers what was written, not what was sent
+    prog->crc = crc_range(part, prog->offset, to, prog->crc);
+    prog->offset = to;
+    save_progress(prog);
+    ESP_LOGI(TAG, "%lu of %lu bytes saved", (unsigned long)prog->offset, (unsigned long)prog->image_size);
+}
+
+bool ota_engine_pending(void)
+{
+    ota_engine_progress_t prog;
+    const esp_partition_t *part = esp_ota_get_next_update_partition(NULL);
+
+    return part && load_progress(&prog) && prog.offset > 0 && progress_valid(&prog, part);
+}
+
+typedef struct {
+    ota_engine_progress_t *prog;
+    const esp_partition_t *part;
+} commit_ctx_t;
+
+// On the flash task, as the pipeline writes
+static void on_written(uint32_t written, void *arg)
+{
+    commit_ctx_t *c = arg;
+
+    if (written >= c->prog->offset + OTA_ENGINE_COMMIT_BYTES) {
+        commit(c->prog, c->part, written);
+    }
+}
+
+// One connection: request (resuming at prog->offset), receive until done or broken
+static esp_err_t download(const char *url, const esp_partition_t *part, const uint8_t *sha256,
+                          ota_engine_progress_t *prog, ota_engine_stats_t *stats)
+{
+    char range[32];
+    uint8_t sha[32];
+    uint32_t written;
+    int n = 0;
+
+    s_etag[0] = '\0';
+    s_content_length = 0;
+    s_range_total = 0;
+    stats->attempts++;
+
+    esp_http_client_handle_t client = https_mgr_begin(url, http_event);
+    if (client == NULL) {
+        return ESP_FAIL;
+    }
+    if (prog->offset > 0) {
+        // a Range request for the rest of the image
+        snprintf(range, sizeof(range), "bytes=%lu-", (unsigned long)prog->offset);
+        https_mgr_set_header(client, "Range", range);
+    }
+    if (https_mgr_send(client) < 0) {
+        ESP_LOGW(TAG, "image request failed");
+        https_mgr_end(client);
+        return ESP_FAIL;
+    }
+    int status = esp_http_client_get_status_code(client);
+
+    uint32_t start = prog->offset;
+    if (start > 0) {
+        // the saved bytes must belong to the image the server has now
+        bool same = prog->etag[0] ? strcmp(prog->etag, s_etag) == 0 : s_range_total == prog->image_size;
+        if (status != 206 || s_range_total == 0 || !same) {
+            ESP_LOGW(TAG, "image on the server changed or no range support, starting over");
+            https_mgr_end(client);
+            stats->restarts++;
+            reset_progress(prog, part);
+            return ESP_ERR_INVALID_STATE;
+        }
+        ESP_LOGI(TAG, "resuming at %lu of %lu bytes", (unsigned long)start, (unsigned long)prog->image_size);
+        stats->resumes++;
+        stats->bytes_skipped += start;
+    } else if (status != 200) {
+        ESP_LOGW(TAG, "image request answered %d", status);
+        https_mgr_end(client);
+        return ESP_FAIL;
+    } else {
+        prog->image_size = s_content_length;
+        strlcpy(prog->etag, s_etag, sizeof(prog->etag));
+    }
+
+    // receiving here, hashing, erasing and writing on the other core
+    commit_ctx_t ctx = { .prog = prog, .part = part };
+    esp_err_t err = ota_pipeline_begin(part, start, prog->image_size, on_written, &ctx);
+    if (err != ESP_OK) {
+        https_mgr_end(client);
+        return err;
+    }
+    uint8_t *buf;
+    size_t cap;
+    while ((buf = ota_pipeline_get_buffer(&cap)) != NULL) {
+        // whole buffers: fewer hand-overs and page-sized flash writes
+        size_t len = 0;
+        while (len < cap && (n = esp_http_client_read(client, (char *)buf + len, cap - len)) > 0) {
+            len += n;
+        }
+        ota_pipeline_submit(len);
+        if (n <= 0) {
+            break;
+        }
+    }
+    bool complete = n == 0 && esp_http_client_is_complete_data_received(client);
+    https_mgr_end(client);
+    err = ota_pipeline_end(&written, sha, &stats->pipeline);
+    stats->bytes_downloaded += written - start;
+
+    if (err == ESP_OK && complete && (prog->image_size == 0 || written == prog->image_size)) {
+        if (sha256 && memcmp(sha, sha256, sizeof(sha)) != 0) {
+            ESP_LOGE(TAG, "image does not match the manifest's sha256");
+            return ESP_ERR_OTA_VALIDATE_FAILED;
+        }
+        // verifies the image like esp_ota_end() does and sets the boot partition
+        err = esp_ota_set_boot_partition(part);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "image rejected: %s", esp_err_to_name(err));
+        }
+        return err;
+    }
+
+    // broken transfer: keep what reached the flash for the next attempt
+    ESP_LOGW(TAG, "transfer stopped at %lu bytes: %s", (unsigned long)written,
+             err != ESP_OK ? esp_err_to_name(err) : "connection lost");
+    commit(prog, part, written);
+    return err == ESP_OK ? ESP_FAIL : err;
+}
+
+esp_err_t ota_engine_run(const char *url, const uint8_t *sha256, ota_engine_stats_t *stats)
+{
+    ota_engine_stats_t local;
+    ota_engine_progress_t prog;
+    uint32_t delay_ms = OTA_ENGINE_RETRY_MS;
+    esp_err_t err = ESP_FAIL;
+
+    if (stats == NULL) {
+        memset(&local, 0, sizeof(local));
+        stats = &local;
+    }
+
+    const esp_partition_t *part = esp_ota_get_next_update_partition(NULL);
+    if (part == NULL) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    if (!load_progress(&prog)) {
+        reset_progress(&prog, part);
+    } else if (!progress_valid(&prog, part)) {
+        ESP_LOGW(TAG, "saved progress does not match the flash, starting over");
+        stats->restarts++;
+        reset_progress(&prog, part);
+    }
+
+    for (int attempt = 0; attempt < OTA_ENGINE_MAX_ATTEMPTS; attempt++) {
+        if (attempt > 0) {
+            vTaskDelay(pdMS_TO_TICKS(delay_ms));
+        }
+        uint32_t before = prog.offset;
+        err = download(url, part, sha256, &prog, stats);
+        if (err == ESP_OK) {
+            clear_progress();
+            return ESP_OK;
+        }
+        if (err == ESP_ERR_OTA_VALIDATE_FAILED) {
+            // every byte arrived and the image is still bad, do not resume into it
+            reset_progress(&prog, part);
+            return err;
+        }
+        // a link that moves data is retried quickly, a dead one less and less often
+        if (prog.offset > before) {
+            delay_ms = OTA_ENGINE_RETRY_MS;
+        } else {
+            delay_ms = delay_ms * 2 > OTA_ENGINE_RETRY_MAX_MS ? OTA_ENGINE_RETRY_MAX_MS : delay_ms * 2;
+        }
+    }
+    ESP_LOGE(TAG, "giving up after %d attempts, %lu bytes kept for later",
+             OTA_ENGINE_MAX_ATTEMPTS, (unsigned long)prog.offset);
+    return err;
+}
+
+typedef struct {
+    const esp_partition_t *running;
+    esp_ota_handle_t ota;
+    mbedtls_sha256_context sha;
+} delta_target_t;
+
+static int delta_read_base(void *ctx, uint32_t offset, void *buf, size_t len)
+{
+    delta_target_t *t = ctx;
+    return esp_partition_read(t->running, offset, buf, len) == ESP_OK ? 0 : -1;
+}
+
+static int delta_write(void *ctx, const void *buf, size_t len)
+{
+    delta_target_t *t = ctx;
+    mbedtls_sha256_update(&t->sha, buf, len);
+    return esp_ota_write(t->ota, buf, len) == ESP_OK ? 0 : -1;
+}
+
+esp_err_t ota_engine_run_delta(const char *url, ota_engine_stats_t *stats)
+{
+    static uint8_t buf[2048];
+    ota_engine_stats_t local;
+    uint8_t running_hash[DELTA_HASH_LEN];
+    uint8_t sha[DELTA_HASH_LEN];
+    delta_target_t t = { .running = esp_ota_get_running_partition() };
+    delta_io_t io = { .read_base = delta_read_base, .write = delta_write, .ctx = &t };
+    delta_apply_t *d = NULL;
+    uint32_t received = 0;
+    esp_err_t err;
+    int rc = DELTA_OK;
+
+    if (stats == NULL) {
+        memset(&local, 0, sizeof(local));
+        stats = &local;
+    }
+    const esp_partition_t *part = esp_ota_get_next_update_partition(NULL);
+    if (part == NULL || esp_partition_get_sha256(t.running, running_hash) != ESP_OK) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    esp_http_client_handle_t client = https_mgr_begin(url, NULL);
+    if (client == NULL) {
+        return ESP_FAIL;
+    }
+    stats->attempts++;
+    if (https_mgr_send(client) < 0) {
+        ESP_LOGW(TAG, "patch request failed");
+        https_mgr_end(client);
+        return ESP_FAIL;
+    }
+    int status = esp_http_client_get_status_code(client);
+    if (status != 200) {
+        // 204: the running image is the newest
+        if (status != 204) {
+            ESP_LOGW(TAG, "patch request answered %d", status);
+        }
+        https_mgr_end(client);
+        return status == 204 ? ESP_ERR_NOT_FOUND : ESP_FAIL;
+    }
+
+    // the patch overwrites the partition a broken full download was kept in
+    clear_progress();
+    err = esp_ota_begin(part, OTA_WITH_SEQUENTIAL_WRITES, &t.ota);
+    if (err != ESP_OK) {
+        https_mgr_end(client);
+        return err;
+    }
+    mbedtls_sha256_init(&t.sha);
+    mbedtls_sha256_starts(&t.sha, 0);
+    d = delta_apply_new(&io, running_hash);
+    if (d == NULL) {
+        rc = DELTA_ERR_NO_MEM;
+    }
+
+    while (rc == DELTA_OK) {
+        int n = esp_http_client_read(client, (char *)buf, sizeof(buf));
+        if (n < 0) {
+            rc = DELTA_ERR_IO;
+        } else if (n == 0) {
+            rc = esp_http_client_is_complete_data_received(client) ? delta_apply_finish(d) : DELTA_ERR_IO;
+            break;
+        } else {
+            received += n;
+            rc = delta_apply_feed(d, buf, n);
+        }
+    }
+
+    stats->delta_bytes += received;
+    const delta_header_t *h = d ? delta_apply_header(d) : NULL;
+    mbedtls_sha256_finish(&t.sha, sha);
+    mbedtls_sha256_free(&t.sha);
+    if (rc == DELTA_OK && memcmp(sha, h->image_sha256, sizeof(sha)) != 0) {
+        rc = DELTA_ERR_FORMAT;
+    }
+    if (rc == DELTA_OK) {
+        stats->delta_image_bytes += h->image_size;
+        ESP_LOGI(TAG, "%lu byte image rebuilt from a %lu byte %s", (unsigned long)h->image_size,
+                 (unsigned long)received, h->has_base ? "patch" : "compressed image");
+        // esp_ota_end() validates the image like esp_https_ota_finish() does
+        err = esp_ota_end(t.ota);
+        if (err == ESP_OK) {
+            err = esp_ota_set_boot_partition(part);
+        }
+    } else {
+        ESP_LOGW(TAG, "patch failed (%d)%s", rc,
+                 rc == DELTA_ERR_BASE ? ": made for another running image" : "");
+        esp_ota_abort(t.ota);
+        err = ESP_FAIL;
+    }
+    delta_apply_free(d);
+    https_mgr_end(client);
+    return err;
+}
@@ -0,0 +1,60 @@
+#ifndef _OTA_ENGINE_H_
+#define _OTA_ENGINE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "ota_pipeline.h"
+
+#define OTA_ENGINE_COMMIT_BYTES  (64 * 1024)    // progress is saved to NVS this often
+#define OTA_ENGINE_MAX_ATTEMPTS  20             // connections per ota_engine_run()
+#define OTA_ENGINE_RETRY_MS      1000           // first retry delay, doubles up to the max
+#define OTA_ENGINE_RETRY_MAX_MS  30000
+#define OTA_ENGINE_ETAG_LEN      64
+
+/* Download progress as kept in NVS. offset is always a flash sector
+ * boundary: everything before it is in the update partition and covered
+ * by crc, so after a reboot the flash can be checked against it. */
+typedef struct {
+    uint32_t partition_addr;        // update partition the bytes went to
+    uint32_t image_size;
+    uint32_t offset;
+    uint32_t crc;                   // CRC-32 of the partition bytes [0, offset)
+    char etag[OTA_ENGINE_ETAG_LEN]; // image identity, empty if the server sent none
+} ota_engine_progress_t;
+
+typedef struct {
+    uint32_t attempts;              // connections made
+    uint32_t resumes;               // connections that continued with a Range request
+    uint32_t restarts;              // saved progress thrown away (image changed, flash mismatch)
+    uint32_t bytes_downloaded;      // received over all connections
+    uint32_t bytes_skipped;         // not downloaded again thanks to resuming
+    uint32_t delta_bytes;           // patch bytes received by ota_engine_run_delta()
+    uint32_t delta_image_bytes;     // image bytes the patch rebuilt
+    ota_pipeline_stats_t pipeline;  // per stage, full image downloads
+} ota_engine_stats_t;
+
+/* True if a previous download stopped part way and its saved progress
+ * still matches the flash, so ota_engine_run() would resume it. */
+bool ota_engine_pending(void);
+
+/* Downloads the image at url over the shared client (https_mgr.h) into
+ * the next update partition, resuming from saved progress and
+ * reconnecting with Range requests after a broken transfer. Receiving
+ * overlaps with hashing, erasing and writing, see ota_pipeline.h. Returns
+ * ESP_OK once the image is verified and set as the boot partition (the
+ * caller restarts), an error when the attempts run out or the image does
+ * not validate. sha256, if not NULL, is what the image must hash to.
+ * Counts are added to *stats. */
+esp_err_t ota_engine_run(const char *url, const uint8_t *sha256, ota_engine_stats_t *stats);
+
+/* Fetches a patch from url (server.py /firmware.delta) over the shared
+ * client, see https_mgr.h, and rebuilds the new image from the running
+ * one straight into the next update partition, see delta_apply.h.
+ * Returns ESP_OK once the image is set as the boot partition,
+ * ESP_ERR_NOT_FOUND if the server has nothing newer, another error if the
+ * caller should fall back to ota_engine_run(). The patch is not
+ * resumable, it is a fraction of the image. Counts are added to *stats. */
+esp_err_t ota_engine_run_delta(const char *url, ota_engine_stats_t *stats);
+
+#endif
@@ -0,0 +1,177 @@
+#include <string.h>
+#include <strings.h>
+#include <stdlib.h>
+#include "esp_log.h"
+#include "esp_ota_ops.h"
+#include "esp_partition.h"
+#include "cJSON.h"
+
+#include "ota_manifest.h"
+#include "https_mgr.h"
+#include "../http_sink/include/http_sink.h"
+
+static const char *TAG = "ota_manifest";
+
+static char s_etag[OTA_MANIFEST_ETAG_LEN];
+static http_sink_t s_body;              // kept between checks, its pool buffer with it
+
+static esp_err_t http_event(esp_http_client_event_t *evt)
+{
+    if (evt->event_id == HTTP_EVENT_ON_HEADER && strcasecmp(evt->header_key, "ETag") == 0) {
+        strlcpy(s_etag, evt->header_value, sizeof(s_etag));
+    }
+    return ESP_OK;
+}
+
+static bool get_str(const cJSON *obj, const char *key, char *out, size_t len)
+{
+    const cJSON *item = cJSON_GetObjectItemCaseSensitive(obj, key);
+
+    if (!cJSON_IsString(item) || strlen(item->valuestring) >= len) {
+        return false;
+    }
+    strcpy(out, item->valuestring);
+    return true;
+}
+
+static int hex_digit(char c)
+{
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+static bool get_hash(const cJSON *obj, const char *key, uint8_t out[32])
+{
+    const cJSON *item = cJSON_GetObjectItemCaseSensitive(obj, key);
+
+    if (!cJSON_IsString(item) || strlen(item->valuestring) != 64) {
+        return false;
+    }
+    for (int i = 0; i < 32; i++) {
+        int hi = hex_digit(item->valuestring[2 * i]);
+        int lo = hex_digit(item->valuestring[2 * i + 1]);
+        if (hi < 0 || lo < 0) {
+            return false;
+        }
+        out[i] = hi << 4 | lo;
+    }
+    return true;
+}
+
+static esp_err_t parse(const char *buf, size_t len, const char *variant, ota_manifest_t *m)
+{
+    esp_err_t err = ESP_ERR_INVALID_RESPONSE;
+    cJSON *root = cJSON_ParseWithLength(buf, len);
+    const cJSON *entry = cJSON_GetObjectItemCaseSensitive(cJSON_GetObjectItemCaseSensitive(root, "variants"), variant);
+    const cJSON *size = cJSON_GetObjectItemCaseSensitive(entry, "size");
+
+    if (root == NULL || !get_str(root, "version", m->version, sizeof(m->version))) {
+        ESP_LOGE(TAG, "not a manifest");
+    } else if (entry == NULL) {
+        ESP_LOGE(TAG, "no image for variant %s", variant);
+        err = ESP_ERR_NOT_FOUND;
+    } else if (!cJSON_IsNumber(size) || !get_hash(entry, "sha256", m->sha256) ||
+               !get_str(entry, "url", m->url, sizeof(m->url))) {
+        ESP_LOGE(TAG, "incomplete entry for %s", variant);
+    } else {
+        m->size = size->valuedouble;
+        m->has_image_hash = get_hash(entry, "image_hash", m->image_hash);
+        if (!get_str(entry, "delta", m->delta_url, sizeof(m->delta_url))) {
+            m->delta_url[0] = '\0';
+        }
+        err = ESP_OK;
+    }
+    cJSON_Delete(root);
+    return err;
+}
+
+esp_err_t ota_manifest_fetch(const char *url, const char *variant, ota_manifest_t *m, ota_manifest_stats_t *stats)
+{
+    ota_manifest_stats_t local;
+    esp_err_t err;
+
+    if (stats == NULL) {
+        stats = &local;
+    }
+    if (s_body.limit == 0) {
+        http_sink_init(&s_body, OTA_MANIFEST_MAX_BYTES - 1);
+    }
+    s_etag[0] = '\0';
+
+    esp_http_client_handle_t client = https_mgr_begin(url, http_event);
+    if (client == NULL) {
+        return ESP_FAIL;
+    }
+    // only worth asking for a 304 if the last answer is still at hand
+    if (m->etag[0] && m->version[0]) {
+        https_mgr_set_header(client, "If-None-Match", m->etag);
+    }
+    stats->checks++;
+    int64_t len = https_mgr_send(client);
+    if (len < 0) {
+        ESP_LOGW(TAG, "manifest request failed");
+        https_mgr_end(client);
+        return ESP_FAIL;
+    }
+    int status = esp_http_client_get_status_code(client);
+
+    if (status == 304 && m->version[0]) {
+        stats->not_modified++;
+        err = ESP_OK;
+    } else if (status != 200) {
+        ESP_LOGW(TAG, "manifest request answered %d", status);
+        err = ESP_FAIL;
+    } else if (len >= OTA_MANIFEST_MAX_BYTES) {
+        ESP_LOGE(TAG, "manifest too large (%lld bytes)", (long long)len);
+        err = ESP_ERR_INVALID_SIZE;
+    } else {
+        // read straight into the sink's buffer; len is 0 for a chunked answer
+        char *p;
+        size_t avail;
+        int n = 0;
+        http_sink_begin(&s_body, len);
+        while ((p = http_sink_reserve(&s_body, 256, &avail)) != NULL &&
+               (n = esp_http_client_read(client, p, avail)) > 0) {
+            http_sink_commit(&s_body, n);
+        }
+        if (p == NULL) {
+            // full up to the limit: too large only if there is more
+            char extra;
+            n = esp_http_client_read(client, &extra, 1);
+        }
+        stats->bytes += s_body.len;
+        if (n != 0 || !esp_http_client_is_complete_data_received(client)) {
+            ESP_LOGE(TAG, "manifest too large or cut short");
+            err = ESP_ERR_INVALID_SIZE;
+        } else {
+            // parsed into a copy, a bad answer leaves the previous one in m
+            ota_manifest_t fresh = {0};
+            err = parse(s_body.data, s_body.len, variant, &fresh);
+            if (err == ESP_OK) {
+                strlcpy(fresh.etag, s_etag, sizeof(fresh.etag));
+                *m = fresh;
+            }
+        }
+    }
+    https_mgr_end(client);
+    return err;
+}
+
+bool ota_manifest_update_available(const ota_manifest_t *m, const char *running_version)
+{
+    uint8_t running[32];
+    const esp_partition_t *part = esp_ota_get_running_partition();
+
+    if (m->has_image_hash && part && esp_partition_get_sha256(part, running) == ESP_OK) {
+        return memcmp(running, m->image_hash, sizeof(running)) != 0;
+    }
+    return strcmp(m->version, running_version) != 0;
+}
@@ -0,0 +1,43 @@
+#ifndef _OTA_MANIFEST_H_
+#define _OTA_MANIFEST_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+#define OTA_MANIFEST_MAX_BYTES    2048      // larger answers are refused
+#define OTA_MANIFEST_VERSION_LEN  32
+#define OTA_MANIFEST_URL_LEN      160
+#define OTA_MANIFEST_ETAG_LEN     64
+
+/* server.py /manifest.json, the entry for one hardware variant */
+typedef struct {
+    char version[OTA_MANIFEST_VERSION_LEN];
+    uint32_t size;
+    uint8_t sha256[32];                 // of the image file
+    uint8_t image_hash[32];             // as esp_partition_get_sha256() reports it once flashed
+    bool has_image_hash;
+    char url[OTA_MANIFEST_URL_LEN];     // full image
+    char delta_url[OTA_MANIFEST_URL_LEN]; // empty if the server makes no patches for the variant
+    char etag[OTA_MANIFEST_ETAG_LEN];   // sent back as If-None-Match by the next check
+} ota_manifest_t;
+
+typedef struct {
+    uint32_t checks;
+    uint32_t not_modified;              // answered 304, nothing parsed
+    uint32_t bytes;                     // response bodies received
+} ota_manifest_stats_t;
+
+/* Fetches the manifest from url over the shared client (https_mgr.h)
+ * and fills m with the entry for variant. m keeps the previous answer
+ * between calls: its etag makes the request conditional and a 304 leaves
+ * it untouched. Zero m before the first call. ESP_ERR_NOT_FOUND if the
+ * manifest lists no such variant. */
+esp_err_t ota_manifest_fetch(const char *url, const char *variant, ota_manifest_t *m, ota_manifest_stats_t *stats);
+
+/* True if the manifest's image is not the one running. The running
+ * partition's hash decides; the version string only when the server sent
+ * no image hash. */
+bool ota_manifest_update_available(const ota_manifest_t *m, const char *running_version);
+
+#endif
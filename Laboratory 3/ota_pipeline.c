@@ -0,0 +1,264 @@
+#include <stdlib.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "mbedtls/sha256.h"
+
+#include "ota_pipeline.h"
+
+#define SECTOR_SIZE 4096
+
+static const char *TAG = "ota_pipeline";
+
+typedef struct {
+    uint8_t buf;
+    uint32_t len;                   // 0: nothing more, the flash task stops
+} chunk_t;
+
+static const esp_partition_t *s_part;
+static uint8_t *s_bufs[OTA_PIPELINE_BUFS];
+static QueueHandle_t s_free;        // buffer indexes for the network stage
+static QueueHandle_t s_full;        // chunks for the flash stage
+static SemaphoreHandle_t s_done;
+static uint8_t s_current;           // the buffer the network stage is filling
+static int64_t s_fill_start;
+static int64_t s_begin;
+static uint32_t s_offset;
+
+// owned by the flash task until s_done
+static uint32_t s_written;
+static uint32_t s_erased;           // [s_written, s_erased) is erased
+static uint32_t s_end;              // erasing stops here
+static esp_err_t s_err;             // first failure, also read by the network stage
+static mbedtls_sha256_context s_sha;
+static ota_pipeline_written_cb s_cb;
+static void *s_cb_arg;
+
+static int64_t s_recv_us, s_recv_wait_us, s_hash_us, s_erase_us, s_write_us, s_flash_wait_us;
+static uint32_t s_erased_bytes, s_erased_ahead;
+
+static void fail(esp_err_t err)
+{
+    __atomic_store_n(&s_err, err, __ATOMIC_RELAXED);
+}
+
+static bool failed(void)
+{
+    return __atomic_load_n(&s_err, __ATOMIC_RELAXED) != ESP_OK;
+}
+
+static void erase_to(uint32_t to)
+{
+    to = (to + SECTOR_SIZE - 1) & ~(SECTOR_SIZE - 1);
+    if (to > s_part->size) {
+        to = s_part->size;
+    }
+    if (to <= s_erased) {
+        return;
+    }
+    int64_t t = esp_timer_get_time();
+    esp_err_t err = esp_partition_erase_range(s_part, s_erased, to - s_erased);
+    s_erase_us += esp_timer_get_time() - t;
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "erase at %lu failed: %s", (unsigned long)s_erased, esp_err_to_name(err));
+        fail(err);
+        return;
+    }
+    s_erased_bytes += to - s_erased;
+    s_erased = to;
+}
+
+// A resumed download: the bytes already in flash go into the hash first
+static void hash_prefix(void)
+{
+    static uint8_t buf[1024];
+    int64_t t = esp_timer_get_time();
+
+    for (uint32_t at = 0; at < s_written; at += sizeof(buf)) {
+        uint32_t n = s_written - at < sizeof(buf) ? s_written - at : sizeof(buf);
+        esp_err_t err = esp_partition_read(s_part, at, buf, n);
+        if (err != ESP_OK) {
+            fail(err);
+            break;
+        }
+        mbedtls_sha256_update(&s_sha, buf, n);
+    }
+    s_hash_us += esp_timer_get_time() - t;
+}
+
+static void write_chunk(const uint8_t *data, uint32_t len)
+{
+    uint32_t end = s_written + len;
+
+    if (end > s_part->size) {
+        ESP_LOGE(TAG, "image larger than the partition");
+        fail(ESP_ERR_INVALID_SIZE);
+        return;
+    }
+    // the network got ahead of idle erasing
+    erase_to(end);
+    if (failed()) {
+        return;
+    }
+    int64_t t = esp_timer_get_time();
+    mbedtls_sha256_update(&s_sha, data, len);
+    int64_t t2 = esp_timer_get_time();
+    s_hash_us += t2 - t;
+    esp_err_t err = esp_partition_write(s_part, s_written, data, len);
+    if (err == ESP_OK) {
+        s_written = end;
+        if (s_cb) {
+            s_cb(s_written, s_cb_arg);
+        }
+    } else {
+        ESP_LOGE(TAG, "write at %lu failed: %s", (unsigned long)s_written, esp_err_to_name(err));
+        fail(err);
+    }
+    s_write_us += esp_timer_get_time() - t2;
+}
+
+static void flash_task(void *pvParameters)
+{
+    chunk_t c;
+
+    hash_prefix();
+    while (1) {
+        if (xQueueReceive(s_full, &c, 0) != pdTRUE) {
+            uint32_t ahead = s_written + OTA_PIPELINE_ERASE_AHEAD < s_end ? s_written + OTA_PIPELINE_ERASE_AHEAD : s_end;
+            if (!failed() && s_erased < ahead) {
+                // nothing to write yet: a sector at a time, so a chunk waits at most one erase
+                uint32_t before = s_erased;
+                erase_to(s_erased + SECTOR_SIZE);
+                s_erased_ahead += s_erased - before;
+                continue;
+            }
+            int64_t t = esp_timer_get_time();
+            xQueueReceive(s_full, &c, portMAX_DELAY);
+            s_flash_wait_us += esp_timer_get_time() - t;
+        }
+        if (c.len == 0) {
+            break;
+        }
+        // after an error chunks are only handed back, the network stage is stopping
+        if (!failed()) {
+            write_chunk(s_bufs[c.buf], c.len);
+        }
+        xQueueSend(s_free, &c.buf, portMAX_DELAY);
+    }
+    xSemaphoreGive(s_done);
+    vTaskDelete(NULL);
+}
+
+static void cleanup(void)
+{
+    for (int i = 0; i < OTA_PIPELINE_BUFS; i++) {
+        free(s_bufs[i]);
+        s_bufs[i] = NULL;
+    }
+    if (s_free) {
+        vQueueDelete(s_free);
+    }
+    if (s_full) {
+        vQueueDelete(s_full);
+    }
+    if (s_done) {
+        vSemaphoreDelete(s_done);
+    }
+    s_free = s_full = NULL;
+    s_done = NULL;
+}
+
+esp_err_t ota_pipeline_begin(const esp_partition_t *part, uint32_t offset, uint32_t image_size,
+                             ota_pipeline_written_cb cb, void *arg)
+{
+    s_free = xQueueCreate(OTA_PIPELINE_BUFS, sizeof(uint8_t));
+    s_full = xQueueCreate(OTA_PIPELINE_BUFS + 1, sizeof(chunk_t));
+    s_done = xSemaphoreCreateBinary();
+    for (uint8_t i = 0; i < OTA_PIPELINE_BUFS; i++) {
+        s_bufs[i] = malloc(OTA_PIPELINE_BUF_LEN);
+        if (s_bufs[i] == NULL) {
+            break;
+        }
+        xQueueSend(s_free, &i, 0);
+    }
+    if (s_free == NULL || s_full == NULL || s_done == NULL || s_bufs[OTA_PIPELINE_BUFS - 1] == NULL) {
+        cleanup();
+        return ESP_ERR_NO_MEM;
+    }
+
+    s_part = part;
+    s_offset = offset;
+    s_written = offset;
+    s_erased = offset;
+    s_end = image_size && image_size < part->size ? image_size : part->size;
+    __atomic_store_n(&s_err, ESP_OK, __ATOMIC_RELAXED);
+    s_cb = cb;
+    s_cb_arg = arg;
+    s_recv_us = s_recv_wait_us = s_hash_us = s_erase_us = s_write_us = s_flash_wait_us = 0;
+    s_erased_bytes = s_erased_ahead = 0;
+    s_begin = esp_timer_get_time();
+    mbedtls_sha256_init(&s_sha);
+    mbedtls_sha256_starts(&s_sha, 0);
+
+    if (xTaskCreatePinnedToCore(flash_task, "ota_flash", 4096, NULL, 5, NULL, OTA_PIPELINE_FLASH_CORE) != pdPASS) {
+        mbedtls_sha256_free(&s_sha);
+        cleanup();
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+uint8_t *ota_pipeline_get_buffer(size_t *len)
+{
+    if (failed()) {
+        return NULL;
+    }
+    int64_t t = esp_timer_get_time();
+    xQueueReceive(s_free, &s_current, portMAX_DELAY);
+    s_fill_start = esp_timer_get_time();
+    s_recv_wait_us += s_fill_start - t;
+    *len = OTA_PIPELINE_BUF_LEN;
+    return s_bufs[s_current];
+}
+
+void ota_pipeline_submit(size_t len)
+{
+    chunk_t c = { .buf = s_current, .len = len };
+
+    s_recv_us += esp_timer_get_time() - s_fill_start;
+    if (len == 0) {
+        xQueueSend(s_free, &c.buf, portMAX_DELAY);
+    } else {
+        xQueueSend(s_full, &c, portMAX_DELAY);
+    }
+}
+
+esp_err_t ota_pipeline_end(uint32_t *written, uint8_t sha256[32], ota_pipeline_stats_t *stats)
+{
+    chunk_t stop = { 0 };
+
+    xQueueSend(s_full, &stop, portMAX_DELAY);
+    xSemaphoreTake(s_done, portMAX_DELAY);
+    mbedtls_sha256_finish(&s_sha, sha256);
+    mbedtls_sha256_free(&s_sha);
+    cleanup();
+
+    *written = s_written;
+    if (stats) {
+        stats->bytes += s_written - s_offset;
+        stats->recv_ms += s_recv_us / 1000;
+        stats->recv_wait_ms += s_recv_wait_us / 1000;
+        stats->hash_ms += s_hash_us / 1000;
+        stats->erase_ms += s_erase_us / 1000;
+        stats->erased_bytes += s_erased_bytes;
+        stats->erased_ahead_bytes += s_erased_ahead;
+        stats->write_ms += s_write_us / 1000;
+        stats->flash_wait_ms += s_flash_wait_us / 1000;
+        stats->wall_ms += (esp_timer_get_time() - s_begin) / 1000;
+    }
+    return s_err;
+}
@@ -0,0 +1,55 @@
+#ifndef _OTA_PIPELINE_H_
+#define _OTA_PIPELINE_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_err.h"
+#include "esp_partition.h"
+
+#define OTA_PIPELINE_BUFS         2                 // one filling from the network, one going to flash
+#define OTA_PIPELINE_BUF_LEN      (8 * 1024)
+#define OTA_PIPELINE_ERASE_AHEAD  (64 * 1024)       // how far past the write pointer idle erasing goes
+#define OTA_PIPELINE_NET_CORE     0                 // with Wi-Fi and lwIP
+#define OTA_PIPELINE_FLASH_CORE   (portNUM_PROCESSORS - 1)
+
+/* Where the time went. The stage that waits least is the bottleneck:
+ * with the two overlapping, an update takes about as long as the slower
+ * of network and flash, not their sum. */
+typedef struct {
+    uint32_t bytes;                 // reached the flash
+    uint32_t recv_ms;               // network stage: filling buffers
+    uint32_t recv_wait_ms;          //   waiting for a free buffer, flash is behind
+    uint32_t hash_ms;               // flash stage: SHA-256, a resumed prefix included
+    uint32_t erase_ms;
+    uint32_t erased_bytes;
+    uint32_t erased_ahead_bytes;    //   of which while waiting for data
+    uint32_t write_ms;              //   writes and the commit callback
+    uint32_t flash_wait_ms;         //   waiting for a full buffer, the network is behind
+    uint32_t wall_ms;               // ota_pipeline_begin() to ota_pipeline_end()
+} ota_pipeline_stats_t;
+
+// Called on the flash task after every write, written counts from the partition start
+typedef void (*ota_pipeline_written_cb)(uint32_t written, void *arg);
+
+/* Starts the flash task, pinned to OTA_PIPELINE_FLASH_CORE, writing to
+ * part from offset on. The bytes already before offset are read back into
+ * the hash while the caller sets up the transfer. image_size (0 if not
+ * known) bounds erasing. One pipeline at a time. */
+esp_err_t ota_pipeline_begin(const esp_partition_t *part, uint32_t offset, uint32_t image_size,
+                             ota_pipeline_written_cb cb, void *arg);
+
+/* Blocks until a buffer is free and returns it, *len bytes long. NULL once
+ * the flash stage has failed: stop receiving and call ota_pipeline_end(). */
+uint8_t *ota_pipeline_get_buffer(size_t *len);
+
+// Hands the buffer to the flash stage with len bytes filled (0 gives it back)
+void ota_pipeline_submit(size_t len);
+
+/* Waits for the flash stage to write everything submitted, stops it and
+ * returns its first error. *written is the end of the data in the
+ * partition, sha256 the hash of [0, *written). Counts are added to
+ * *stats. */
+esp_err_t ota_pipeline_end(uint32_t *written, uint8_t sha256[32], ota_pipeline_stats_t *stats);
+
+#endif
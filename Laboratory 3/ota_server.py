@@ -0,0 +1,466 @@
+"""Asynchronous OTA distribution server for fleet rollouts.
+
+server.py is a Flask development server, one thread per connection,
+which is fine for a lab bench. This one serves a rollout to hundreds of
+devices from a single asyncio loop. It answers the same requests the
+device makes (/manifest.json, the image with Range and ETag) and adds:
+
+  - a firmware root with one directory per release:
+        <root>/<version>/<variant>/firmware.bin
+  - a bandwidth limit per connection (--rate-kbps) and a cap on
+    concurrent transfers, with a 503 and Retry-After beyond it
+  - staged rollout from <root>/rollout.json, re-read when it changes:
+        {"stable": "1.0.0", "candidate": "1.1.0", "percent": 10,
+         "canary": ["a4cf12345678"]}
+    Devices named in canary, and percent of all the others, get the
+    candidate. A device's share is fixed by a hash of its id, so raising
+    percent only adds devices. Without the file every device gets the
+    newest release. The id is ?device= (the firmware sends its MAC), the
+    X-Device-Id header, or else the client address.
+  - GET /metrics: active connections and transfers, bytes/s, TLS
+    handshakes/s, downloads per version and cohort
+
+Patches (/firmware.delta) stay with server.py.
+
+  python ota_server.py --root releases
+  python ota_server.py --root releases --rate-kbps 400 --max-transfers 200 --report 5
+  python ota_bench.py --manifest https://127.0.0.1:5000/manifest.json --clients 300
+"""
+import argparse
+import asyncio
+import hashlib
+import json
+import os
+import re
+import ssl
+import time
+import urllib.parse
+
+import delta
+
+CHUNK = 16 * 1024
+MAX_HEADER = 8192
+DEFAULT_VARIANT = "esp-wrover-kit"
+ROLLOUT_FILE = "rollout.json"
+
+REASONS = {200: "OK", 206: "Partial Content", 304: "Not Modified", 400: "Bad Request",
+           404: "Not Found", 405: "Method Not Allowed", 416: "Range Not Satisfiable",
+           503: "Service Unavailable"}
+
+
+def safe_name(v):
+    """Versions and variants become file names; anything else is treated as unknown"""
+    return v if v and re.fullmatch(r"[0-9A-Za-z._+-]{1,32}", v) and v not in (".", "..") else None
+
+
+def version_key(v):
+    # 1.10.0 after 1.9.0
+    return [(0, int(p), "") if p.isdigit() else (1, 0, p) for p in re.split(r"(\d+)", v) if p]
+
+
+class Image:
+    def __init__(self, version, variant, data, key):
+        self.version = version
+        self.variant = variant
+        self.data = data
+        self.key = key
+        self.sha256 = hashlib.sha256(data).hexdigest()
+        self.image_hash = delta.image_hash(data).hex()
+        self.etag = '"%s"' % self.sha256[:32]
+
+
+def load_image(path, version, variant, key):
+    with open(path, "rb") as f:
+        return Image(version, variant, f.read(), key)
+
+
+class Releases:
+    """The firmware root. Images are kept in memory, one copy shared by
+    every transfer, and reloaded when the file changes on disk."""
+
+    def __init__(self, root):
+        self.root = root
+        self.images = {}        # path -> Image
+        self.loading = {}       # (path, key) -> future of the Image being read
+
+    def versions(self):
+        try:
+            names = os.listdir(self.root)
+        except OSError:
+            return []
+        return sorted((n for n in names if safe_name(n) and self.variants(n)), key=version_key)
+
+    def variants(self, version):
+        try:
+            names = os.listdir(os.path.join(self.root, version))
+        except OSError:
+            return []
+        return sorted(n for n in names
+                      if safe_name(n) and os.path.isfile(os.path.join(self.root, version, n, "firmware.bin")))
+
+    async def get(self, version, variant):
+        if not safe_name(version) or not safe_name(variant):
+            return None
+        path = os.path.join(self.root, version, variant, "firmware.bin")
+        try:
+            st = os.stat(path)
+        except OSError:
+            self.images.pop(path, None)
+            return None
+        key = (st.st_size, st.st_mtime_ns)
+        image = self.images.get(path)
+        if image is not None and image.key == key:
+            return image
+        # read and hashed in a worker thread, once for every request that
+        # asks meanwhile; transfers already running go on
+        pending = self.loading.get((path, key))
+        if pending is None:
+            loop = asyncio.get_running_loop()
+            pending = self.loading[(path, key)] = loop.run_in_executor(
+                None, load_image, path, version, variant, key)
+            pending.add_done_callback(lambda _: self.loading.pop((path, key), None))
+        try:
+            # shielded: a client that goes away does not cancel the others' load
+            image = await asyncio.shield(pending)
+        except OSError:
+            return None
+        self.images[path] = image
+        return image
+
+
+class Rollout:
+    """Which release a device gets, see the module doc."""
+
+    def __init__(self, releases):
+        self.releases = releases
+        self.path = os.path.join(releases.root, ROLLOUT_FILE)
+        self.key = None
+        self.plan = {}
+
+    def _load(self):
+        try:
+            st = os.stat(self.path)
+        except OSError:
+            self.key, self.plan = None, {}
+            return
+        key = (st.st_size, st.st_mtime_ns)
+        if key == self.key:
+            return
+        try:
+            with open(self.path) as f:
+                plan = json.load(f)
+            percent = float(plan.get("percent", 0))
+            if not 0 <= percent <= 100:
+                raise ValueError("percent %r" % percent)
+        except (OSError, ValueError) as e:
+            # a half-written file: keep the previous plan
+            print("%s: %s, keeping the previous rollout" % (self.path, e))
+            return
+        self.key, self.plan = key, plan
+        print("rollout: stable %s, candidate %s to %g%% and %d canaries" %
+              (plan.get("stable"), plan.get("candidate"), percent, len(plan.get("canary", []))))
+
+    def assign(self, device):
+        """Returns (version, cohort) for device, version None if there is no release"""
+        self._load()
+        versions = self.releases.versions()
+        stable = self.plan.get("stable")
+        candidate = self.plan.get("candidate")
+        if stable not in versions:
+            stable = versions[-1] if versions else None
+        if candidate in versions and candidate != stable:
+            if device in self.plan.get("canary", []):
+                return candidate, "canary"
+            bucket = int(hashlib.sha256(device.encode()).hexdigest()[:8], 16) % 10000
+            if bucket < float(self.plan.get("percent", 0)) * 100:
+                return candidate, "candidate"
+        return stable, "stable"
+
+
+class Metrics:
+    def __init__(self):
+        self.started = time.monotonic()
+        self.connections = 0
+        self.connections_total = 0
+        self.handshakes = 0
+        self.resumed = 0
+        self.requests = 0
+        self.statuses = {}
+        self.transfers = 0
+        self.transfers_peak = 0
+        self.rejected = 0           # 503, --max-transfers reached
+        self.bytes = 0
+        self.downloads = {}         # version -> completed transfers of the whole image
+        self.cohorts = {}           # cohort -> manifests answered
+        self.rates = dict(bytes_per_s=0.0, handshakes_per_s=0.0, requests_per_s=0.0)
+        self.peak_bytes_per_s = 0.0
+        self._last = (time.monotonic(), 0, 0, 0)
+
+    def sample(self):
+        """Rates since the previous call"""
+        now = time.monotonic()
+        t, b, h, r = self._last
+        dt = max(now - t, 1e-6)
+        self.rates = dict(bytes_per_s=(self.bytes - b) / dt, handshakes_per_s=(self.handshakes - h) / dt,
+                          requests_per_s=(self.requests - r) / dt)
+        self.peak_bytes_per_s = max(self.peak_bytes_per_s, self.rates["bytes_per_s"])
+        self._last = (now, self.bytes, self.handshakes, self.requests)
+
+    def snapshot(self):
+        return dict(uptime_s=round(time.monotonic() - self.started, 1),
+                    connections=self.connections, connections_total=self.connections_total,
+                    transfers=self.transfers, transfers_peak=self.transfers_peak, rejected=self.rejected,
+                    handshakes=self.handshakes, resumed=self.resumed, requests=self.requests,
+                    statuses={str(k): v for k, v in sorted(self.statuses.items())},
+                    bytes=self.bytes, peak_bytes_per_s=round(self.peak_bytes_per_s),
+                    downloads=self.downloads, cohorts=self.cohorts,
+                    **{k: round(v, 1) for k, v in self.rates.items()})
+
+
+class Request:
+    def __init__(self, head):
+        lines = head.decode("latin-1").split("\r\n")
+        self.method, self.target, self.version = lines[0].split(" ")
+        self.headers = {}
+        for line in lines[1:]:
+            if line:
+                name, _, value = line.partition(":")
+                self.headers[name.strip().lower()] = value.strip()
+        url = urllib.parse.urlsplit(self.target)
+        self.path = url.path
+        self.query = dict(urllib.parse.parse_qsl(url.query))
+
+
+def parse_range(value, size):
+    """(start, end) for a single "bytes=" range, None to ignore it, False if unsatisfiable"""
+    m = re.fullmatch(r"bytes=(\d*)-(\d*)", value.strip())
+    if m is None or m.group(1) == m.group(2) == "":
+        return None
+    if m.group(1) == "":
+        n = int(m.group(2))
+        return (max(size - n, 0), size) if n > 0 else False
+    start = int(m.group(1))
+    end = min(int(m.group(2)) + 1, size) if m.group(2) else size
+    return (start, end) if start < size and start < end else False
+
+
+class Server:
+    def __init__(self, args):
+        self.args = args
+        self.releases = Releases(args.root)
+        self.rollout = Rollout(self.releases)
+        self.metrics = Metrics()
+        self.scheme = "http" if args.no_tls else "https"
+
+    async def handle(self, reader, writer):
+        m = self.metrics
+        m.connections += 1
+        m.connections_total += 1
+        tls = writer.get_extra_info("ssl_object")
+        if tls is not None:
+            # the handshake is done by the time a connection gets here
+            m.handshakes += 1
+            m.resumed += tls.session_reused
+        peer = (writer.get_extra_info("peername") or ("?",))[0]
+        try:
+            keep = True
+            while keep:
+                try:
+                    head = await asyncio.wait_for(reader.readuntil(b"\r\n\r\n"), self.args.idle_timeout)
+                except (asyncio.IncompleteReadError, asyncio.LimitOverrunError, asyncio.TimeoutError,
+                        ConnectionError, ssl.SSLError):
+                    break
+                try:
+                    req = Request(head)
+                    # nothing the device sends has a body; skip one if a client does
+                    length = int(req.headers.get("content-length") or 0)
+                except ValueError:
+                    await self.respond(writer, 400, b"bad request\n", keep=False)
+                    break
+                m.requests += 1
+                keep = req.version == "HTTP/1.1" and req.headers.get("connection", "").lower() != "close"
+                if length:
+                    await reader.readexactly(length)
+                keep = await self.dispatch(req, writer, keep, peer)
+        except (ConnectionError, asyncio.TimeoutError, asyncio.IncompleteReadError, ssl.SSLError):
+            pass
+        finally:
+            m.connections -= 1
+            writer.close()
+            try:
+                await writer.wait_closed()
+            except (ConnectionError, ssl.SSLError):
+                pass
+
+    async def respond(self, writer, status, body=b"", headers=None, keep=True, head_only=False, length=None):
+        self.metrics.statuses[status] = self.metrics.statuses.get(status, 0) + 1
+        lines = ["HTTP/1.1 %d %s" % (status, REASONS.get(status, "")),
+                 "Content-Length: %d" % (len(body) if length is None else length)]
+        lines += ["%s: %s" % kv for kv in (headers or {}).items()]
+        if not keep:
+            lines.append("Connection: close")
+        writer.write(("\r\n".join(lines) + "\r\n\r\n").encode("latin-1"))
+        if body and not head_only:
+            writer.write(body)
+        await asyncio.wait_for(writer.drain(), self.args.idle_timeout)
+        return keep
+
+    async def dispatch(self, req, writer, keep, peer):
+        if req.method not in ("GET", "HEAD"):
+            return await self.respond(writer, 405, b"GET only\n", {"Allow": "GET, HEAD"}, keep)
+        device = req.query.get("device") or req.headers.get("x-device-id") or peer
+        if req.path == "/manifest.json":
+            return await self.manifest(req, writer, keep, device)
+        if req.path == "/firmware.bin":
+            # the firmware's fallback URL: the device's release
+            version, _ = self.rollout.assign(device)
+            image = version and await self.releases.get(version, req.query.get("variant", DEFAULT_VARIANT))
+            return await self.image(req, writer, keep, image)
+        m = re.fullmatch(r"/firmware/([^/]+)/([^/]+)\.bin", req.path)
+        if m:
+            return await self.image(req, writer, keep, await self.releases.get(m.group(1), m.group(2)))
+        if req.path == "/metrics":
+            body = json.dumps(self.metrics.snapshot(), indent=1).encode()
+            return await self.respond(writer, 200, body, {"Content-Type": "application/json"}, keep)
+        return await self.respond(writer, 404, b"not found\n", keep=keep)
+
+    async def manifest(self, req, writer, keep, device):
+        """Same shape as server.py's, for the release of the device's cohort"""
+        version, cohort = self.rollout.assign(device)
+        if version is None:
+            return await self.respond(writer, 404, b"no release in the firmware root\n", keep=keep)
+        self.metrics.cohorts[cohort] = self.metrics.cohorts.get(cohort, 0) + 1
+        base = "%s://%s" % (self.scheme, req.headers.get("host", "localhost"))
+        body = dict(version=version, cohort=cohort, variants={})
+        for variant in self.releases.variants(version):
+            image = await self.releases.get(version, variant)
+            if image is not None:
+                body["variants"][variant] = dict(size=len(image.data), sha256=image.sha256,
+                                                 image_hash=image.image_hash,
+                                                 url="%s/firmware/%s/%s.bin" % (base, version, variant))
+        data = json.dumps(body, sort_keys=True, separators=(",", ":")).encode()
+        etag = '"%s"' % hashlib.sha256(data).hexdigest()[:32]
+        headers = {"Content-Type": "application/json", "ETag": etag, "Cache-Control": "no-cache"}
+        if etag in req.headers.get("if-none-match", ""):
+            return await self.respond(writer, 304, headers=headers, keep=keep)
+        return await self.respond(writer, 200, data, headers, keep, req.method == "HEAD")
+
+    async def image(self, req, writer, keep, image):
+        if not image:
+            return await self.respond(writer, 404, b"no such image\n", keep=keep)
+        size = len(image.data)
+        headers = {"Content-Type": "application/octet-stream", "ETag": image.etag,
+                   "Accept-Ranges": "bytes", "Cache-Control": "no-cache"}
+        inm = req.headers.get("if-none-match")
+        if inm and (inm.strip() == "*" or image.etag in [t.strip() for t in inm.split(",")]):
+            return await self.respond(writer, 304, headers=headers, keep=keep)
+
+        start, end, status = 0, size, 200
+        rng = req.headers.get("range")
+        if rng and req.headers.get("if-range", image.etag) == image.etag:
+            r = parse_range(rng, size)
+            if r is False:
+                headers["Content-Range"] = "bytes */%d" % size
+                return await self.respond(writer, 416, headers=headers, keep=keep)
+            if r is not None:
+                start, end, status = r[0], r[1], 206
+                headers["Content-Range"] = "bytes %d-%d/%d" % (start, end - 1, size)
+
+        m = self.metrics
+        if req.method == "HEAD":
+            return await self.respond(writer, status, headers=headers, keep=keep, length=end - start)
+        if self.args.max_transfers and m.transfers >= self.args.max_transfers:
+            m.rejected += 1
+            headers = {"Retry-After": str(self.args.retry_after)}
+            return await self.respond(writer, 503, b"busy, retry later\n", headers, keep)
+
+        # counted before the first await, or a burst of requests all pass the cap
+        m.transfers += 1
+        m.transfers_peak = max(m.transfers_peak, m.transfers)
+        try:
+            await self.respond(writer, status, headers=headers, keep=keep, length=end - start)
+            await self.stream(writer, memoryview(image.data)[start:end])
+            if end == size:
+                # the last byte went out: a whole image, resumed or not. A
+                # client gone mid-stream raised above and is not counted.
+                m.downloads[image.version] = m.downloads.get(image.version, 0) + 1
+        finally:
+            m.transfers -= 1
+        return keep
+
+    async def stream(self, writer, view):
+        """Writes view at no more than --rate-kbps"""
+        rate = self.args.rate_kbps * 1000 / 8
+        # at a limit, about ten writes a second instead of a burst and a long pause
+        chunk = min(CHUNK, max(1024, int(rate / 10))) if rate else CHUNK
+        loop = asyncio.get_running_loop()
+        start = loop.time()
+        sent = 0
+        while sent < len(view):
+            n = min(chunk, len(view) - sent)
+            writer.write(view[sent:sent + n])
+            # a client that stops reading is dropped after --idle-timeout
+            await asyncio.wait_for(writer.drain(), self.args.idle_timeout)
+            sent += n
+            self.metrics.bytes += n
+            if rate:
+                ahead = sent / rate - (loop.time() - start)
+                if ahead > 0:
+                    await asyncio.sleep(ahead)
+
+    async def report(self):
+        while True:
+            await asyncio.sleep(1)
+            self.metrics.sample()
+            m = self.metrics
+            if self.args.report and int(time.monotonic() - m.started) % self.args.report == 0:
+                print("%d connections, %d transfers (peak %d, %d turned away), %.2f MB/s, "
+                      "%.1f handshakes/s (%d of %d resumed), downloads %s" %
+                      (m.connections, m.transfers, m.transfers_peak, m.rejected, m.rates["bytes_per_s"] / 1e6,
+                       m.rates["handshakes_per_s"], m.resumed, m.handshakes,
+                       json.dumps(m.downloads, sort_keys=True)))
+
+
+async def serve(args):
+    context = None
+    if not args.no_tls:
+        context = ssl.SSLContext(ssl.PROTOCOL_TLS_SERVER)
+        context.load_cert_chain(args.cert, args.key)
+    server = Server(args)
+    listener = await asyncio.start_server(server.handle, args.host, args.port, ssl=context,
+                                          limit=MAX_HEADER, backlog=args.backlog)
+    versions = server.releases.versions()
+    print("serving %s (%s) on %s://%s:%d" % (args.root, ", ".join(versions) or "no releases",
+                                            server.scheme, args.host, args.port))
+    reporter = asyncio.ensure_future(server.report())
+    try:
+        async with listener:
+            await listener.serve_forever()
+    finally:
+        reporter.cancel()
+        print(json.dumps(server.metrics.snapshot()))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--root", default="releases", help="firmware root, <version>/<variant>/firmware.bin")
+    parser.add_argument("--host", default="0.0.0.0")
+    parser.add_argument("--port", type=int, default=5000)
+    parser.add_argument("--cert", default="ca_cert.pem")
+    parser.add_argument("--key", default="ca_key.pem")
+    parser.add_argument("--no-tls", action="store_true", help="plain HTTP, for load tests of the server alone")
+    parser.add_argument("--rate-kbps", type=float, default=0, help="per-connection limit, 0 is unlimited")
+    parser.add_argument("--max-transfers", type=int, default=0, help="concurrent image transfers, 0 is unlimited")
+    parser.add_argument("--retry-after", type=int, default=30, help="seconds, sent with a 503")
+    parser.add_argument("--idle-timeout", type=float, default=30.0)
+    parser.add_argument("--backlog", type=int, default=1024)
+    parser.add_argument("--report", type=int, default=0, help="print the metrics every N seconds")
+    args = parser.parse_args()
+    try:
+        asyncio.run(serve(args))
+    except KeyboardInterrupt:
+        pass
+
+
+if __name__ == "__main__":
+    main()
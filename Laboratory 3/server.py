@@ -1,17 +1,315 @@
-import io
-from flask import Flask, send_file
+import hashlib
+import json
+import os
 import os.path
+import re
+import shutil
+import threading
+from flask import Flask, Response, make_response, request, send_file
+from werkzeug.exceptions import RequestedRangeNotSatisfiable
+from werkzeug.http import is_resource_modified
+
+import delta
 
 app = Flask(__name__)
 
+# one PlatformIO environment per hardware variant, .pio/build/<variant>/firmware.bin
+BUILD_DIR = os.path.join(".pio", "build")
+DEFAULT_VARIANT = "esp-wrover-kit"
+FIRMWARE_PATH = os.path.join(BUILD_DIR, DEFAULT_VARIANT, "firmware.bin")
+VERSION_PATH = "versioning"
+
+# every image served is kept as <version>.bin, patches between them in patches/
+FIRMWARE_REPO = "firmware_repo"
+PATCH_DIR = os.path.join(FIRMWARE_REPO, "patches")
+
+# images asked for this often are kept in memory, up to the byte budget
+HOT_AFTER_REQUESTS = 3
+HOT_CACHE_BYTES = 16 * 1024 * 1024
+# a cached image goes out this many bytes at a time
+SEND_CHUNK = 64 * 1024
+
+
+class ImageCache:
+    """ETags of the served images, plus the bytes of the hot ones.
+
+    An entry is valid while the file keeps its size and mtime; any change
+    on disk drops it, so a rebuilt firmware.bin is picked up by the next
+    request.
+    """
+
+    def __init__(self, budget):
+        self.budget = budget
+        self.used = 0
+        self.entries = {}       # path -> dict(key, etag, sha256, image_hash, requests, data, loading)
+        self.lock = threading.Lock()
+
+    def _entry(self, path):
+        st = os.stat(path)
+        key = (st.st_size, st.st_mtime_ns)
+        with self.lock:
+            entry = self.entries.get(path)
+            if entry is not None and entry["key"] != key:
+                self._drop(path)
+                entry = None
+        if entry is None:
+            # hashed outside the lock; concurrent first requests may both hash
+            sha256, image_hash = file_digests(path)
+            fresh = dict(key=key, etag=sha256[:32], sha256=sha256, image_hash=image_hash,
+                         requests=0, data=None, loading=False)
+            with self.lock:
+                entry = self.entries.get(path)
+                if entry is None or entry["key"] != key:
+                    self._drop(path)
+                    self.entries[path] = entry = fresh
+        return st, entry
+
+    def describe(self, path):
+        """Returns (size, sha256, image hash) without counting a request"""
+        st, entry = self._entry(path)
+        return st.st_size, entry["sha256"], entry["image_hash"]
+
+    def get(self, path):
+        """Returns (stat, etag, data or None) for the current file"""
+        st, entry = self._entry(path)
+        with self.lock:
+            entry["requests"] += 1
+            load = (entry["data"] is None and not entry["loading"]
+                    and entry["requests"] >= HOT_AFTER_REQUESTS
+                    and self.used + st.st_size <= self.budget)
+            if load:
+                entry["loading"] = True
+                self.used += st.st_size
+        if load:
+            with open(path, "rb") as f:
+                data = f.read()
+            with self.lock:
+                entry["loading"] = False
+                if len(data) == st.st_size and self.entries.get(path) is entry:
+                    entry["data"] = data
+                else:
+                    # rewritten while reading
+                    self.used -= st.st_size
+        return st, entry["etag"], entry["data"]
+
+    def _drop(self, path):
+        entry = self.entries.pop(path, None)
+        if entry is not None and entry["data"] is not None:
+            self.used -= len(entry["data"])
+
+
+def file_etag(path):
+    h = hashlib.sha256()
+    with open(path, "rb") as f:
+        for block in iter(lambda: f.read(1 << 16), b""):
+            h.update(block)
+    return h.hexdigest()[:32]
+
+
+def file_digests(path):
+    """sha256 of the file, and the hash the device reports for it once flashed"""
+    with open(path, "rb") as f:
+        data = f.read()
+    return hashlib.sha256(data).hexdigest(), delta.image_hash(data).hex()
+
+
+cache = ImageCache(HOT_CACHE_BYTES)
+
+
+def chunks(data, start, stop):
+    view = memoryview(data)
+    for at in range(start, stop, SEND_CHUNK):
+        # WSGI servers take bytes: one chunk is copied at a time, never the image
+        yield bytes(view[at:min(at + SEND_CHUNK, stop)])
+
+
+def send_cached(data, etag, mtime):
+    """send_file(conditional=True) for an image held in memory.
+
+    send_file() on a BytesIO calls getbuffer() for the length, which
+    unshares the buffer and copies the whole image per request. This
+    streams slices of the one cached copy instead and answers
+    If-None-Match / If-Modified-Since with 304 and Range (honouring
+    If-Range) with 206 or 416 itself.
+    """
+    resp = Response(mimetype='application/octet-stream', direct_passthrough=True)
+    resp.set_etag(etag)
+    resp.last_modified = mtime
+    resp.cache_control.no_cache = True
+    resp.cache_control.max_age = 0
+    resp.accept_ranges = "bytes"
+    env = request.environ
+    if not is_resource_modified(env, etag, last_modified=resp.last_modified):
+        resp.status_code = 304
+        return resp
+
+    start, stop = 0, len(data)
+    if "HTTP_RANGE" in env and ("HTTP_IF_RANGE" not in env or not is_resource_modified(
+            env, etag, last_modified=resp.last_modified, ignore_if_range=False)):
+        wanted = request.range
+        span = wanted.range_for_length(len(data)) if wanted is not None else None
+        if span is None:
+            raise RequestedRangeNotSatisfiable(len(data))
+        start, stop = span
+        resp.status_code = 206
+        resp.content_range = wanted.to_content_range_header(len(data))
+    resp.content_length = stop - start
+    resp.response = chunks(data, start, stop)
+    return resp
+
+
+def current_version():
+    with open(VERSION_PATH) as f:
+        return f.readline().strip()
+
+
+def safe_name(v):
+    """Versions and variants become file names; anything else is treated as unknown"""
+    return v if re.fullmatch(r"[0-9A-Za-z._+-]{1,32}", v) and v not in (".", "..") else None
+
+
+def variants():
+    try:
+        names = os.listdir(BUILD_DIR)
+    except OSError:
+        return []
+    return sorted(n for n in names if safe_name(n) and os.path.isfile(os.path.join(BUILD_DIR, n, "firmware.bin")))
+
+
+class PatchStore:
+    """Archives firmware.bin under its version and builds patches on demand.
+
+    Patches are named after the base version and the first bytes of the
+    new image's sha256, so a rebuild under the same version number gets
+    a fresh patch. Each one is generated once; concurrent requests for the
+    same patch wait for the first.
+    """
+
+    def __init__(self):
+        self.lock = threading.Lock()
+        self.building = {}      # patch path -> Event
+        self.archived = None    # (version, etag) last copied
+
+    def archive(self, version, etag):
+        """Copies firmware.bin into the repository if that image is not there yet"""
+        path = os.path.join(FIRMWARE_REPO, version + ".bin")
+        with self.lock:
+            if self.archived == (version, etag):
+                return
+            if not (os.path.exists(path) and file_etag(path) == etag):
+                os.makedirs(PATCH_DIR, exist_ok=True)
+                tmp = path + ".tmp"
+                shutil.copyfile(FIRMWARE_PATH, tmp)
+                os.replace(tmp, path)
+            self.archived = (version, etag)
+
+    def patch(self, base_version, version, etag):
+        """Path of the patch from base_version (None: compressed full image)"""
+        name = "%s-%s-%s.ldp" % (base_version or "full", version, etag[:16])
+        path = os.path.join(PATCH_DIR, name)
+        while True:
+            with self.lock:
+                if os.path.exists(path):
+                    return path
+                done = self.building.get(path)
+                if done is None:
+                    done = self.building[path] = threading.Event()
+                    break
+            done.wait()
+        try:
+            base = None
+            if base_version is not None:
+                with open(os.path.join(FIRMWARE_REPO, base_version + ".bin"), "rb") as f:
+                    base = f.read()
+            with open(os.path.join(FIRMWARE_REPO, version + ".bin"), "rb") as f:
+                new = f.read()
+            tmp = path + ".tmp"
+            with open(tmp, "wb") as f:
+                f.write(delta.make_patch(base, new))
+            os.replace(tmp, path)
+            print("patch %s: %d -> %d bytes" % (name, len(new), os.path.getsize(path)))
+            return path
+        finally:
+            with self.lock:
+                del self.building[path]
+            done.set()
+
+
+patches = PatchStore()
+
+
 @app.route('/firmware.bin')
 def firm():
-    with open(".pio\\build\\esp-wrover-kit\\firmware.bin", 'rb') as bites:
-        print(bites)
-        return send_file(
-                     io.BytesIO(bites.read()),
-                     mimetype='application/octet-stream'
-               )
+    variant = safe_name(request.args.get("variant", DEFAULT_VARIANT))
+    if variant not in variants():
+        return "unknown variant\n", 404
+    path = os.path.join(BUILD_DIR, variant, "firmware.bin")
+    st, etag, data = cache.get(path)
+    # conditional: Range -> 206, If-None-Match / If-Modified-Since -> 304
+    if data is not None:
+        return send_cached(data, etag, st.st_mtime)
+    # streamed from disk; servers with wsgi.file_wrapper use sendfile().
+    # Absolute: send_file() would resolve a relative path against
+    # app.root_path, the cache above against the working directory.
+    return send_file(os.path.abspath(path), mimetype='application/octet-stream', conditional=True,
+                     etag=etag, last_modified=st.st_mtime, max_age=0)
+
+
+@app.route('/firmware.delta')
+def firm_delta():
+    """Patch from ?from=<version> to the current image, see delta.py.
+
+    204 when the device already runs the current version; a compressed
+    full image (no base) when its version is not in the repository, i.e.
+    was never served from here nor copied into FIRMWARE_REPO by hand.
+    """
+    version = safe_name(current_version())
+    if version is None:
+        return "bad version in %s\n" % VERSION_PATH, 500
+    base = safe_name(request.args.get("from", ""))
+    if base == version:
+        return "", 204
+    _, etag, _ = cache.get(FIRMWARE_PATH)
+    patches.archive(version, etag)
+    if base is not None and not os.path.exists(os.path.join(FIRMWARE_REPO, base + ".bin")):
+        base = None
+    path = patches.patch(base, version, etag)
+    # absolute for the same reason as in firm()
+    resp = send_file(os.path.abspath(path), mimetype='application/octet-stream', conditional=True, max_age=0)
+    resp.headers["X-Firmware-Version"] = version
+    resp.headers["X-Delta-Base"] = base or "none"
+    return resp
+
+
+@app.route('/manifest.json')
+def manifest():
+    """What an update check needs, a few hundred bytes.
+
+    Per variant: the image's size and sha256, image_hash (what
+    esp_partition_get_sha256() reports once it runs, so a device can tell
+    it already has it) and where to get it. Devices send If-None-Match
+    with the last ETag and mostly get an empty 304.
+    """
+    version = safe_name(current_version())
+    if version is None:
+        return "bad version in %s\n" % VERSION_PATH, 500
+    base = request.host_url.rstrip("/")
+    body = dict(version=version, variants={})
+    for variant in variants():
+        size, sha256, image_hash = cache.describe(os.path.join(BUILD_DIR, variant, "firmware.bin"))
+        entry = dict(size=size, sha256=sha256, image_hash=image_hash,
+                     url="%s/firmware.bin?variant=%s" % (base, variant))
+        if variant == DEFAULT_VARIANT:
+            entry["delta"] = base + "/firmware.delta"
+        body["variants"][variant] = entry
+    data = json.dumps(body, sort_keys=True, separators=(",", ":"))
+    resp = make_response(data)
+    resp.mimetype = "application/json"
+    resp.set_etag(hashlib.sha256(data.encode()).hexdigest()[:32])
+    # always revalidated, the 304 is the cheap path
+    resp.cache_control.no_cache = True
+    return resp.make_conditional(request)
+
 
 @app.route("/")
 def hello():
@@ -26,4 +324,7 @@ def version():
         return v
 
 if __name__ == '__main__':
-    app.run(host='0.0.0.0', ssl_context=('ca_cert.pem', 'ca_key.pem'), debug=True)
\ No newline at end of file
+    from werkzeug.serving import WSGIRequestHandler
+    # keep-alive: the device sends its checks and patch requests over one connection
+    WSGIRequestHandler.protocol_version = 'HTTP/1.1'
+    app.run(host='0.0.0.0', ssl_context=('ca_cert.pem', 'ca_key.pem'), debug=True, threaded=True)
@@ -0,0 +1,147 @@
+"""Local TLS stand-in for the update server, to watch the device's
+connection handling.
+
+Serves the files under --root over HTTPS with HTTP/1.1 keep-alive and logs
+every TLS handshake: how long it took, whether the client resumed an
+earlier session and how many requests the connection carried before it
+closed. GET /stats answers the totals as JSON. --max-requests closes a
+connection after that many requests, the way a server with a keep-alive
+limit does, so the device's reconnect and session resumption show up in
+the log.
+
+  python tls_server.py --root build --port 8070
+  python tls_server.py --root build --max-requests 2
+  curl -k https://localhost:8070/stats
+
+Uses the same ca_cert.pem/ca_key.pem as server.py.
+"""
+import argparse
+import http.server
+import json
+import ssl
+import threading
+import time
+
+
+class Stats:
+    def __init__(self):
+        self.lock = threading.Lock()
+        self.handshakes = 0
+        self.resumed = 0
+        self.failed = 0
+        self.handshake_ms = []
+        self.connections = 0
+        self.requests = 0
+
+    def handshake(self, ms, resumed):
+        with self.lock:
+            self.handshakes += 1
+            self.resumed += resumed
+            self.handshake_ms.append(ms)
+
+    def summary(self):
+        with self.lock:
+            ms = sorted(self.handshake_ms)
+            return {
+                'handshakes': self.handshakes,
+                'resumed': self.resumed,
+                'failed': self.failed,
+                'handshake_ms_avg': round(sum(ms) / len(ms), 2) if ms else 0,
+                'handshake_ms_max': round(ms[-1], 2) if ms else 0,
+                'connections_closed': self.connections,
+                'requests': self.requests,
+                'requests_per_connection': round(self.requests / self.connections, 2) if self.connections else 0,
+            }
+
+
+class Handler(http.server.SimpleHTTPRequestHandler):
+    protocol_version = 'HTTP/1.1'       # keep-alive unless the client says otherwise
+
+    def setup(self):
+        # handshake here, in the connection's thread, not in accept()
+        start = time.perf_counter()
+        try:
+            self.request.do_handshake()
+        except (ssl.SSLError, OSError) as e:
+            with self.server.stats.lock:
+                self.server.stats.failed += 1
+            self.log_message('handshake failed: %s', e)
+            raise
+        ms = (time.perf_counter() - start) * 1000
+        resumed = self.request.session_reused
+        self.server.stats.handshake(ms, resumed)
+        self.log_message('%s handshake, %s, %.1f ms', self.request.version(),
+                         'session resumed' if resumed else 'full', ms)
+        self.served = 0
+        super().setup()
+
+    def handle_one_request(self):
+        self.command = None
+        super().handle_one_request()
+        if self.command:
+            self.served += 1
+            with self.server.stats.lock:
+                self.server.stats.requests += 1
+
+    def finish(self):
+        super().finish()
+        with self.server.stats.lock:
+            self.server.stats.connections += 1
+        self.log_message('connection closed after %d requests', self.served)
+
+    def end_headers(self):
+        # send_header() also sets close_connection for this one
+        if self.server.max_requests and self.served + 1 >= self.server.max_requests:
+            self.send_header('Connection', 'close')
+        super().end_headers()
+
+    def do_GET(self):
+        if self.path == '/stats':
+            body = json.dumps(self.server.stats.summary()).encode()
+            self.send_response(200)
+            self.send_header('Content-Type', 'application/json')
+            self.send_header('Content-Length', str(len(body)))
+            self.end_headers()
+            self.wfile.write(body)
+            return
+        super().do_GET()
+
+
+class TLSServer(http.server.ThreadingHTTPServer):
+    daemon_threads = True
+
+    def __init__(self, address, context, root, max_requests):
+        self.context = context
+        self.max_requests = max_requests
+        self.stats = Stats()
+        super().__init__(address, lambda *a: Handler(*a, directory=root))
+
+    def get_request(self):
+        sock, addr = super().get_request()
+        return self.context.wrap_socket(sock, server_side=True, do_handshake_on_connect=False), addr
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument('--root', default='.', help='directory to serve')
+    parser.add_argument('--host', default='0.0.0.0')
+    parser.add_argument('--port', type=int, default=8070)
+    parser.add_argument('--cert', default='ca_cert.pem')
+    parser.add_argument('--key', default='ca_key.pem')
+    parser.add_argument('--max-requests', type=int, default=0,
+                        help='close a connection after this many requests (0: never)')
+    args = parser.parse_args()
+
+    context = ssl.SSLContext(ssl.PROTOCOL_TLS_SERVER)
+    context.load_cert_chain(args.cert, args.key)
+    server = TLSServer((args.host, args.port), context, args.root, args.max_requests)
+    print('serving %s on https://%s:%d' % (args.root, args.host, args.port))
+    try:
+        server.serve_forever()
+    except KeyboardInterrupt:
+        pass
+    print(json.dumps(server.stats.summary()))
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,79 @@
+#ifndef _MDNS_STUB_H_
+#define _MDNS_STUB_H_
+
+/* The part of the mdns component and esp_netif that mdns_flat.c and
+ * mdns_flat_bench.c use, with the same layout and print macros, for the
+ * host build. */
+
+#include <stdint.h>
+#include <inttypes.h>
+#include <arpa/inet.h>
+
+#define IPADDR_TYPE_V4 0
+#define IPADDR_TYPE_V6 6
+
+typedef struct {
+    uint32_t addr;
+} esp_ip4_addr_t;
+
+typedef struct {
+    uint32_t addr[4];
+    uint8_t zone;
+} esp_ip6_addr_t;
+
+typedef struct {
+    union {
+        esp_ip6_addr_t ip6;
+        esp_ip4_addr_t ip4;
+    } u_addr;
+    uint8_t type;
+} esp_ip_addr_t;
+
+#define esp_ip4_addr_get_byte(ipaddr, idx) (((const uint8_t *)(&(ipaddr)->addr))[idx])
+#define IP2STR(ipaddr) esp_ip4_addr_get_byte(ipaddr, 0), esp_ip4_addr_get_byte(ipaddr, 1), \
+                       esp_ip4_addr_get_byte(ipaddr, 2), esp_ip4_addr_get_byte(ipaddr, 3)
+#define IPSTR "%d.%d.%d.%d"
+
+#define IPV6_ADDR_BLOCK(ip6, i) ((uint16_t)((ntohl((ip6)->addr[(i) / 2]) >> ((i) & 1 ? 0 : 16)) & 0xffff))
+#define IPV62STR(ipaddr) IPV6_ADDR_BLOCK(&(ipaddr), 0), IPV6_ADDR_BLOCK(&(ipaddr), 1), \
+                         IPV6_ADDR_BLOCK(&(ipaddr), 2), IPV6_ADDR_BLOCK(&(ipaddr), 3), \
+                         IPV6_ADDR_BLOCK(&(ipaddr), 4), IPV6_ADDR_BLOCK(&(ipaddr), 5), \
+                         IPV6_ADDR_BLOCK(&(ipaddr), 6), IPV6_ADDR_BLOCK(&(ipaddr), 7)
+#define IPV6STR "%04" PRIx16 ":%04" PRIx16 ":%04" PRIx16 ":%04" PRIx16 ":%04" PRIx16 ":%04" PRIx16 ":%04" PRIx16 ":%04" PRIx16
+
+typedef enum {
+    MDNS_IP_PROTOCOL_V4,
+    MDNS_IP_PROTOCOL_V6,
+    MDNS_IP_PROTOCOL_MAX
+} mdns_ip_protocol_t;
+
+typedef struct {
+    const char *key;
+    const char *value;
+} mdns_txt_item_t;
+
+typedef struct mdns_ip_addr_s {
+    esp_ip_addr_t addr;
+    struct mdns_ip_addr_s *next;
+} mdns_ip_addr_t;
+
+typedef struct mdns_result_s {
+    struct mdns_result_s *next;
+    void *esp_netif;
+    uint32_t ttl;
+    mdns_ip_protocol_t ip_protocol;
+    char *instance_name;
+    char *service_type;
+    char *proto;
+    char *hostname;
+    uint16_t port;
+    mdns_txt_item_t *txt;
+    uint8_t *txt_value_len;
+    size_t txt_count;
+    mdns_ip_addr_t *addr;
+} mdns_result_t;
+
+// Frees every node, string, TXT array and address, as the component does
+void mdns_query_results_free(mdns_result_t *results);
+
+#endif
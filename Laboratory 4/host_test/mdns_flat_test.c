@@ -0,0 +1,111 @@
+/* Host driver for mdns_flat_bench.c, plus checks of mdns_flat's
+ * serialize/load round trip.
+ *
+ * The benchmark builds result lists the way the mdns component does and
+ * compares walking, listing and freeing them with the flat arena; the
+ * listing of both must match. Times are from CLOCK_MONOTONIC. The heap
+ * figures need heap_caps_get_largest_free_block() and are left out.
+ *
+ *   ./mdns_flat_test [results] [iterations] */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "mdns_flat.h"
+#include "mdns_flat_bench.h"
+
+static int failures;
+
+#define CHECK(cond) do { \
+        if (!(cond)) { \
+            failures++; \
+            fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #cond); \
+        } \
+    } while (0)
+
+static uint32_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)((uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec);
+}
+
+static mdns_result_t *result(const char *instance, const char *host, const char *key, const char *value)
+{
+    mdns_result_t *r = calloc(1, sizeof(*r));
+    r->instance_name = instance ? strdup(instance) : NULL;
+    r->hostname = host ? strdup(host) : NULL;
+    r->port = 80;
+    r->ip_protocol = MDNS_IP_PROTOCOL_V4;
+    if (key) {
+        r->txt_count = 1;
+        r->txt = calloc(1, sizeof(*r->txt));
+        r->txt_value_len = calloc(1, 1);
+        r->txt[0].key = strdup(key);
+        r->txt[0].value = value ? strdup(value) : NULL;
+    }
+    r->addr = calloc(1, sizeof(*r->addr));
+    r->addr->addr.type = IPADDR_TYPE_V4;
+    r->addr->addr.u_addr.ip4.addr = 0x0a59a8c0;
+    return r;
+}
+
+static void test_round_trip(void)
+{
+    mdns_result_t *list = result("Lab device", "esp32-node0", "board", "esp32");
+    list->next = result(NULL, "esp32-node0", "board", NULL);
+    list->next->next = result("Other", NULL, NULL, NULL);
+
+    mdns_flat_t *f = mdns_flat_from_results(list);
+    mdns_query_results_free(list);
+    CHECK(f != NULL);
+    if (f == NULL) {
+        return;
+    }
+    CHECK(f->count == 3 && f->txt_count == 2 && f->addr_count == 3);
+    CHECK(f->interned == 2);   // the second hostname and TXT key
+
+    static uint32_t buf[256];
+    CHECK(mdns_flat_serialize(f, buf, f->size - 1) == 0);
+    size_t len = mdns_flat_serialize(f, buf, sizeof(buf));
+    CHECK(len == f->size);
+    const mdns_flat_t *g = mdns_flat_load(buf, len);
+    CHECK(g != NULL);
+    if (g) {
+        char a[512], b[512];
+        size_t n = mdns_flat_format(f, a, sizeof(a));
+        CHECK(mdns_flat_format(g, b, sizeof(b)) == n && strcmp(a, b) == 0);
+        CHECK(strstr(a, "  A   : 192.168.89.10\n") != NULL);
+        // a short buffer still reports the full length
+        CHECK(mdns_flat_format(g, b, 10) == n && strlen(b) == 9);
+    }
+
+    // malformed: cut short, a string offset out of the pool, misaligned
+    CHECK(mdns_flat_load(buf, len - 1) == NULL);
+    mdns_flat_result_t *r = (mdns_flat_result_t *)mdns_flat_results((mdns_flat_t *)buf);
+    uint16_t saved = r->hostname;
+    r->hostname = ((mdns_flat_t *)buf)->strings_len;
+    CHECK(mdns_flat_load(buf, len) == NULL);
+    r->hostname = saved;
+    CHECK(mdns_flat_load((uint8_t *)buf + 1, len) == NULL);
+    mdns_flat_free(f);
+}
+
+int main(int argc, char **argv)
+{
+    int results = argc > 1 ? atoi(argv[1]) : 16;
+    int iterations = argc > 2 ? atoi(argv[2]) : 1000;
+    const mdns_flat_bench_hal_t hal = {
+        .now = now_ns,
+        .tick_hz = 1000000000,
+        .largest_free = NULL,
+    };
+
+    test_round_trip();
+    CHECK(mdns_flat_bench_run(&hal, 1, iterations));
+    CHECK(mdns_flat_bench_run(&hal, results, iterations));
+
+    printf("mdns_flat: %s\n", failures ? "FAIL" : "ok");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,27 @@
+#include <stdlib.h>
+
+#include "mdns.h"
+
+void mdns_query_results_free(mdns_result_t *results)
+{
+    while (results) {
+        mdns_result_t *r = results;
+        results = r->next;
+        free(r->instance_name);
+        free(r->service_type);
+        free(r->proto);
+        free(r->hostname);
+        for (size_t t = 0; t < r->txt_count; t++) {
+            free((char *)r->txt[t].key);
+            free((char *)r->txt[t].value);
+        }
+        free(r->txt);
+        free(r->txt_value_len);
+        while (r->addr) {
+            mdns_ip_addr_t *a = r->addr;
+            r->addr = a->next;
+            free(a);
+        }
+        free(r);
+    }
+}
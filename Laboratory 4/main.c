@@ -11,15 +11,13 @@
 #include "freertos/task.h"
 #include "freertos/event_groups.h"
 
-#include <freertos/FreeRTOS.h>
-#include <freertos/timers.h>
-
-TimerHandle_t periodicTimer;
-
 #include "esp_system.h"
 #include "esp_wifi.h"
 #include "esp_event.h"
 #include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_cpu.h"
+#include "esp_heap_caps.h"
 #include "nvs_flash.h"
 
 #include "lwip/err.h"
@@ -30,6 +28,13 @@ TimerHandle_t periodicTimer;
 
 #include "..\mdns\include\mdns.h"
 #include "..\mdns\include\mdns_console.h"
+#include "../telemetry/include/telemetry.h"
+#include "udp_rx.h"
+#include "mdns_browse.h"
+#include "mdns_resolve.h"
+#include "mdns_flat.h"
+#include "mdns_flat_bench.h"
+#include "../dlog/include/dlog.h"
 
 #define CONFIG_ESP_WIFI_SSID      "lab-iot"
 #define CONFIG_ESP_WIFI_PASS      "IoT-IoT-IoT"
@@ -46,6 +51,13 @@ bool toggle = false;
 
 #define CONFIG_LOCAL_PORT         10001
 
+// 1: time the result list against the mdns_flat arena at boot
+#define MDNS_FLAT_BENCH 0
+#define CPU_TICK_HZ (CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ * 1000000)
+
+// every port is served by the same select() loop in udp_rx.c
+static const uint16_t s_local_ports[] = { CONFIG_LOCAL_PORT, CONFIG_LOCAL_PORT + 1 };
+
 /* FreeRTOS event group to signal when we are connected*/
 static EventGroupHandle_t s_wifi_event_group;
 
@@ -58,7 +70,6 @@ static EventGroupHandle_t s_wifi_event_group;
 static const char *TAG = "wifi station";
 
 static int s_retry_num = 0;
-void vTask_handler(TimerHandle_t xTimer);
 void start_mdns_service()
 {
     //initialize mDNS service
@@ -75,24 +86,32 @@ void start_mdns_service()
     mdns_instance_name_set("CVTVLIN's ESP32 Thing");
 }
 
-void resolve_mdns_host(const char * host_name)
+static void on_host_resolved(const char *host_name, esp_err_t err, uint32_t addr, void *arg)
 {
-    printf("Query A: %s.local", host_name);
-
-    struct ip4_addr addr;
-    addr.addr = 0;
+    mdns_resolve_stats_t st;
+    mdns_resolve_get_stats(&st);
 
-    esp_err_t err = mdns_query_a(host_name, 2000,  &addr);
-    if(err){
-        if(err == ESP_ERR_NOT_FOUND){
-            printf("\nHost was not found!\n");
-            return;
-        }
-        printf("Query Failed");
-        return;
+    if (err == ESP_OK) {
+        ESP_LOGI(TAG, "%s.local: " IPSTR, host_name, IP2STR((struct ip4_addr *)&addr));
+    } else if (err == ESP_ERR_NOT_FOUND) {
+        ESP_LOGW(TAG, "%s.local: host was not found", host_name);
+    } else {
+        ESP_LOGE(TAG, "%s.local: query failed", host_name);
     }
+    ESP_LOGD(TAG, "resolver: %lu hits, %lu negative hits, %lu misses (%lu coalesced), %lu queries",
+             (unsigned long)st.hits, (unsigned long)st.negative_hits, (unsigned long)st.misses,
+             (unsigned long)st.coalesced, (unsigned long)st.queries);
+}
 
-    printf(IPSTR, IP2STR(&addr));
+// answered from the resolver cache when it can, otherwise later from its task
+void resolve_mdns_host(const char * host_name)
+{
+    ESP_LOGI(TAG, "Query A: %s.local", host_name);
+
+    esp_err_t err = mdns_resolve_host(host_name, on_host_resolved, NULL);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Query not started: %s", esp_err_to_name(err));
+    }
 }
 
 static const char * if_str[] = {"STA", "AP", "ETH", "MAX"};
@@ -146,10 +165,39 @@ void find_mdns_service(const char * service_name, const char * proto)
         return;
     }
 
-    mdns_print_results(results);
+    // one allocation for as long as the results are kept, one console write
+    mdns_flat_t *flat = mdns_flat_from_results(results);
+    if (flat == NULL) {
+        mdns_print_results(results);
+        mdns_query_results_free(results);
+        return;
+    }
     mdns_query_results_free(results);
+
+    static char listing[2048];
+    size_t len = mdns_flat_format(flat, listing, sizeof(listing));
+    fwrite(listing, 1, len < sizeof(listing) ? len : sizeof(listing) - 1, stdout);
+    mdns_flat_free(flat);
 }
 
+#if MDNS_FLAT_BENCH
+static uint32_t bench_now(void)
+{
+    return esp_cpu_get_cycle_count();
+}
+
+static size_t bench_largest_free(void)
+{
+    return heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+}
+
+static const mdns_flat_bench_hal_t bench_hal = {
+    .now = bench_now,
+    .tick_hz = CPU_TICK_HZ,
+    .largest_free = bench_largest_free,
+};
+#endif
+
 static void event_handler(void* arg, esp_event_base_t event_base,
                                 int32_t event_id, void* event_data)
 {
@@ -232,76 +280,199 @@ bool wifi_init_sta(void)
     return false;
 }
 
-static void udp_task(void *pvParameters)
+// per sender state, the least recently heard one makes room
+#define SEQ_DEVICES 8
+
+typedef struct {
+    uint32_t device_id;
+    uint32_t last_heard;
+    bool used;
+    bool seq_synced;
+    uint32_t next_seq;
+    // receive window for frames that request ACKs
+    bool rx_synced;
+    uint32_t rx_cum;            // every frame before this one was received
+    uint32_t rx_sack;           // bit i: frame rx_cum + 1 + i received
+    uint32_t last_pins;         // state changes are logged at info level
+} seq_entry_t;
+
+static seq_entry_t s_seq[SEQ_DEVICES];
+static uint32_t s_seq_clock;
+static uint32_t s_lost;
+static uint32_t s_reordered;
+static uint32_t s_duplicates;
+static uint32_t s_resyncs;
+
+// The device's entry, a fresh one (evicting the least recently heard) if it has none
+static seq_entry_t *seq_entry(uint32_t device_id)
 {
-    char rx_buffer[128];
-    char addr_str[128];
-    int addr_family = 0;
-    int ip_protocol = 0;
-
-    /*
-    struct sockaddr_in dest_addr;
-    dest_addr.sin_addr.s_addr = inet_addr(CONFIG_PEER_IP_ADDR); // unde #define CONFIG_PEER_IP_ADDR "192.168.89.abc"
-    dest_addr.sin_family = AF_INET;
-    dest_addr.sin_port = htons(CONFIG_PEER_PORT);
-    addr_family = AF_INET;
-    ip_protocol = IPPROTO_IP;
-    */
-
-    struct sockaddr_in local_addr;
-    local_addr.sin_addr.s_addr = htonl(INADDR_ANY);
-    local_addr.sin_family = AF_INET;
-    local_addr.sin_port = htons(CONFIG_LOCAL_PORT);
-    ip_protocol = IPPROTO_IP;
-    addr_family = AF_INET;
-
-    while(1)
-    {
-        int sock = socket(addr_family, SOCK_DGRAM, ip_protocol);
-
-        if (sock < 0) {
-            ESP_LOGE(TAG, "Unable to create socket: errno %d", errno);
-            break;
+    seq_entry_t *victim = &s_seq[0];
+
+    s_seq_clock++;
+    for (int i = 0; i < SEQ_DEVICES; i++) {
+        if (s_seq[i].used && s_seq[i].device_id == device_id) {
+            s_seq[i].last_heard = s_seq_clock;
+            return &s_seq[i];
+        }
+        if (victim->used && (!s_seq[i].used || (int32_t)(s_seq[i].last_heard - victim->last_heard) < 0)) {
+            victim = &s_seq[i];
         }
-        ESP_LOGI(TAG, "Socket created");
+    }
+    *victim = (seq_entry_t){
+        .device_id = device_id,
+        .last_heard = s_seq_clock,
+        .used = true,
+        .last_pins = UINT32_MAX,
+    };
+    return victim;
+}
+
+/* Gaps and steps back in a device's sequence reveal lost and reordered
+ * frames, as SeqTracker does in telemetry.py. The first frame from a
+ * device (or after it was evicted) only sets where its sequence stands,
+ * so a receiver started mid-stream does not count a huge loss. */
+static void seq_track(seq_entry_t *e, uint32_t seq)
+{
+    if (!e->seq_synced) {
+        e->seq_synced = true;
+        e->next_seq = seq + 1;
+        return;
+    }
+
+    int32_t gap = (int32_t)(seq - e->next_seq);
+    if (gap < 0) {
+        s_reordered++;
+    } else {
+        s_lost += gap;
+        e->next_seq = seq + 1;
+    }
+}
+
+// Returns false for a retransmitted frame that was already delivered
+static bool rx_window_accept(seq_entry_t *e, uint32_t seq)
+{
+    int32_t d = (int32_t)(seq - e->rx_cum);
+    bool fresh = true;
 
-        int err = bind(sock, (struct sockaddr *)&local_addr, sizeof(local_addr));
-        if (err < 0) {
-            ESP_LOGE(TAG, "Socket unable to bind: errno %d", errno);
+    if (!e->rx_synced || d > 32 || d < -0x10000) {
+        // first frame, sender restarted or gave up on frames beyond our bitmap
+        if (e->rx_synced) {
+            s_resyncs++;
+        }
+        e->rx_synced = true;
+        e->rx_cum = seq + 1;
+        e->rx_sack = 0;
+    } else if (d < 0) {
+        fresh = false;
+    } else if (d == 0) {
+        // bit 0 now stands for rx_cum itself, consume the contiguous run
+        e->rx_cum++;
+        while (e->rx_sack & 1) {
+            e->rx_sack >>= 1;
+            e->rx_cum++;
         }
+        e->rx_sack >>= 1;
+    } else if (e->rx_sack & (1u << (d - 1))) {
+        fresh = false;
+    } else {
+        e->rx_sack |= 1u << (d - 1);
+    }
 
-        ESP_LOGI(TAG, "Socket bound, port %d", CONFIG_LOCAL_PORT);
+    if (!fresh) {
+        s_duplicates++;
+    }
+    return fresh;
+}
 
-        while (1) {
-            struct sockaddr source_addr;
-            socklen_t socklen = sizeof(source_addr);
-            int len = recvfrom(sock, rx_buffer, sizeof(rx_buffer) - 1, 0, &source_addr, &socklen);
+static void handle_telemetry(const udp_rx_peer_t *from, const telemetry_header_t *hdr, const telemetry_record_t *recs)
+{
+    seq_entry_t *e = seq_entry(hdr->device_id);
 
-            // Error occurred during receiving
-            if (len < 0) {
-                ESP_LOGE(TAG, "recvfrom failed: errno %d", errno);
-                break;
-            }
-            // Data received
-            else {
-                 inet_ntoa_r(((struct sockaddr_in *)&source_addr)->sin_addr, addr_str, sizeof(addr_str) - 1);
-                rx_buffer[len] = 0; 
-                ESP_LOGI(TAG, "Received %d bytes from %s:", len, addr_str);
-                ESP_LOGI(TAG, "%s", rx_buffer);
+    if (hdr->type & TELEMETRY_FLAG_ACK_REQ) {
+        bool fresh = rx_window_accept(e, hdr->seq);
 
-            }
+        // ack duplicates as well, the previous ACK may be the one that got lost
+        uint8_t ack[TELEMETRY_ACK_LEN];
+        size_t len = telemetry_encode_ack(ack, sizeof(ack), hdr->device_id, e->rx_cum, e->rx_sack);
+        if (udp_rx_reply(from, ack, len) != ESP_OK) {
+            DLOGE(TAG, "ACK send failed");
+        }
+        if (!fresh) {
+            return;
+        }
+    }
+
+    seq_track(e, hdr->seq);
 
-            vTaskDelay(200 / portTICK_PERIOD_MS);
+    // deferred: only the arguments are queued here, dlog renders them later.
+    // State changes at info level, every record at debug (compiled out).
+    for (int i = 0; i < hdr->count; i++) {
+        uint32_t ts_us = (uint32_t)(hdr->ts_us + recs[i].offset_us);
+        if (recs[i].pins != e->last_pins) {
+            e->last_pins = recs[i].pins;
+            DLOGI(TAG, "dev %08lx seq %lu @%lu us: pins %08lx", (unsigned long)hdr->device_id,
+                  (unsigned long)hdr->seq, (unsigned long)ts_us, (unsigned long)recs[i].pins);
+        } else {
+            DLOGD(TAG, "dev %08lx seq %lu @%lu us: pins %08lx", (unsigned long)hdr->device_id,
+                  (unsigned long)hdr->seq, (unsigned long)ts_us, (unsigned long)recs[i].pins);
         }
+    }
+}
 
-        if (sock != -1) {
-            ESP_LOGE(TAG, "Shutting down socket and restarting...");
-            shutdown(sock, 0);
-            close(sock);
+static void on_datagram(const udp_rx_view_t *view, const udp_rx_peer_t *from, void *arg)
+{
+    static telemetry_record_t recs[TELEMETRY_MAX_RECORDS];
+    static uint8_t scratch[TELEMETRY_MAX_LEN];
+    telemetry_header_t hdr;
+
+    // decodes straight out of the pbuf unless the frame spans segments
+    const uint8_t *frame = udp_rx_view_linear(view, scratch, sizeof(scratch));
+    if (frame && telemetry_decode(frame, view->tot_len, &hdr, recs, TELEMETRY_MAX_RECORDS) >= 0) {
+        if ((hdr.type & TELEMETRY_TYPE_MASK) == TELEMETRY_TYPE_STATE) {
+            handle_telemetry(from, &hdr, recs);
         }
+    } else {
+        // not a telemetry frame, older text senders
+        ESP_LOGI(TAG, "Received %d bytes from " IPSTR ":", (int)view->tot_len, IP2STR(from));
+        ESP_LOGI(TAG, "%.*s", (int)view->len, (const char *)view->data);
     }
+}
 
-    vTaskDelete(NULL);
+static void on_http_service(mdns_browse_event_t event, const mdns_service_info_t *svc, void *arg)
+{
+    if (event == MDNS_BROWSE_REMOVED) {
+        ESP_LOGI(TAG, "HTTP service gone: %s", svc->instance);
+    } else {
+        ESP_LOGI(TAG, "HTTP service %s: %s.local:%u (" IPSTR "), ttl %lld s", svc->instance,
+                 svc->hostname, svc->port, IP2STR((struct ip4_addr *)&svc->addr),
+                 (long long)((svc->expires_us - esp_timer_get_time()) / 1000000));
+    }
+}
+
+static void rx_stats_task(void *pvParameters)
+{
+    udp_rx_stats_t prev = {0}, st;
+
+    while (1) {
+        vTaskDelay(pdMS_TO_TICKS(1000));
+        udp_rx_get_stats(&st);
+        if (st.packets == prev.packets) {
+            continue;
+        }
+        ESP_LOGI(TAG, "rx: %lu pkt/s, %lu B/s, %lu wakeups/s, batch high water %lu (mailbox %d), %lu full drains",
+                 (unsigned long)(st.packets - prev.packets), (unsigned long)(st.bytes - prev.bytes),
+                 (unsigned long)(st.wakeups - prev.wakeups), (unsigned long)st.batch_high_water,
+                 CONFIG_LWIP_UDP_RECVMBOX_SIZE, (unsigned long)st.mailbox_full);
+        ESP_LOGI(TAG, "rx: lost %lu, reordered %lu, duplicates %lu, resyncs %lu, errors %lu (%d)",
+                 (unsigned long)s_lost, (unsigned long)s_reordered, (unsigned long)s_duplicates,
+                 (unsigned long)s_resyncs, (unsigned long)st.recv_errors, st.last_errno);
+        // same load, UDP_RX_NETCONN 0 vs 1: compares the two receive paths
+        ESP_LOGI(TAG, "rx: %s backend, %lu cycles/pkt, %lu linearized",
+                 UDP_RX_NETCONN ? "netconn" : "socket",
+                 (unsigned long)((st.cycles - prev.cycles) / (st.packets - prev.packets)),
+                 (unsigned long)st.linearized);
+        prev = st;
+    }
 }
 
 void app_main(void)
@@ -314,12 +485,21 @@ void app_main(void)
     }
     ESP_ERROR_CHECK(ret);
 
+    dlog_start();
+#if MDNS_FLAT_BENCH
+    mdns_flat_bench_run(&bench_hal, 16, 100);
+#endif
     ESP_LOGI(TAG, "ESP_WIFI_MODE_STA");
     bool connected = wifi_init_sta();
 
     if (connected) {
         start_mdns_service();
-        xTaskCreate(udp_task, "udp_task", 4096, NULL, 5, NULL);
+        ESP_ERROR_CHECK(mdns_resolve_start());
+        for (int i = 0; i < sizeof(s_local_ports) / sizeof(s_local_ports[0]); i++) {
+            ESP_ERROR_CHECK(udp_rx_add_port(s_local_ports[i], on_datagram, NULL));
+        }
+        ESP_ERROR_CHECK(udp_rx_start());
+        xTaskCreate(rx_stats_task, "rx_stats", 3072, NULL, 3, NULL);
     }
     
    // xTaskCreate(vTask_handler, "vTask_handler", 4096, NULL, 5, NULL);    
@@ -327,31 +507,8 @@ void app_main(void)
     
     find_mdns_service("_services._dns-sd", "_udp");
 
-    periodicTimer = xTimerCreate(
-        "Periodic Timer",
-        pdMS_TO_TICKS(1000), 
-        pdTRUE,          
-        (void *)0,         
-        vTask_handler       
-    );
-
-    if (periodicTimer != NULL) {
-        xTimerStart(periodicTimer, 0);
-      }
-
+    // replaces the 1 s blocking PTR query that ran in the timer daemon task
+    if (connected) {
+        ESP_ERROR_CHECK(mdns_browse_start("_http", "_tcp", on_http_service, NULL));
+    }
 }
-
-
-void vTask_handler(TimerHandle_t xTimer) {
-  //  resolve_mdns_host("esp32-Nazi");
-
-   // find_mdns_service("_services._dns-sd", "_udp");
-  //  find_mdns_service("_services", "_dns-sd._udp");
-
-    //search for esp32-mdns.local
-   // resolve_mdns_host("esp32-mdns");
-
-    //search for HTTP servers
-    find_mdns_service("_http", "_tcp");
-
-  }
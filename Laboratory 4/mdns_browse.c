@@ -0,0 +1,298 @@
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "..\mdns\include\mdns.h"
+#include "mdns_browse.h"
+
+#define TABLE_SIZE      (MDNS_BROWSE_MAX_SERVICES * 2)     // power of two, load factor <= 0.5
+#define QUERY_TIMEOUT_MS 3000
+#define QUERY_MAX_RESULTS 20
+
+typedef enum {
+    SLOT_EMPTY,
+    SLOT_USED,
+    SLOT_DELETED,               // keeps probe chains intact
+} slot_state_t;
+
+typedef struct {
+    slot_state_t state;
+    bool seen;                  // answered the current query
+    int64_t refresh_us;
+    mdns_service_info_t info;
+} slot_t;
+
+static const char *TAG = "mdns_browse";
+
+static slot_t s_table[TABLE_SIZE];
+static int s_count;
+static SemaphoreHandle_t s_lock;
+static TaskHandle_t s_task;
+static char s_service[32];
+static char s_proto[8];
+static mdns_browse_cb_t s_cb;
+static void *s_cb_arg;
+static int64_t s_last_query_us;
+
+static uint32_t hash(const char *s)
+{
+    // FNV-1a
+    uint32_t h = 2166136261u;
+    while (*s) {
+        h = (h ^ (uint8_t)*s++) * 16777619u;
+    }
+    return h;
+}
+
+// Returns the slot holding instance, or NULL
+static slot_t *find(const char *instance)
+{
+    for (uint32_t i = hash(instance), n = 0; n < TABLE_SIZE; i++, n++) {
+        slot_t *s = &s_table[i & (TABLE_SIZE - 1)];
+        if (s->state == SLOT_EMPTY) {
+            return NULL;
+        }
+        if (s->state == SLOT_USED && strcmp(s->info.instance, instance) == 0) {
+            return s;
+        }
+    }
+    return NULL;
+}
+
+// Returns a free slot on the probe chain of instance, or NULL when full
+static slot_t *insert_slot(const char *instance)
+{
+    if (s_count == MDNS_BROWSE_MAX_SERVICES) {
+        return NULL;
+    }
+    for (uint32_t i = hash(instance), n = 0; n < TABLE_SIZE; i++, n++) {
+        slot_t *s = &s_table[i & (TABLE_SIZE - 1)];
+        if (s->state != SLOT_USED) {
+            return s;
+        }
+    }
+    return NULL;
+}
+
+static void notify(mdns_browse_event_t event, const mdns_service_info_t *info)
+{
+    ESP_LOGD(TAG, "%s %s -> %s:%u", event == MDNS_BROWSE_ADDED ? "added" :
+             event == MDNS_BROWSE_UPDATED ? "updated" : "removed",
+             info->instance, info->hostname, info->port);
+    if (s_cb) {
+        s_cb(event, info, s_cb_arg);
+    }
+}
+
+static void apply_result(const mdns_result_t *r, int64_t now)
+{
+    mdns_service_info_t info = { 0 };
+    mdns_browse_event_t event = MDNS_BROWSE_ADDED;
+    bool report = true;
+
+    if (r->instance_name == NULL) {
+        return;
+    }
+    strlcpy(info.instance, r->instance_name, sizeof(info.instance));
+    if (r->hostname) {
+        strlcpy(info.hostname, r->hostname, sizeof(info.hostname));
+    }
+    info.port = r->port;
+    for (mdns_ip_addr_t *a = r->addr; a; a = a->next) {
+        if (a->addr.type == IPADDR_TYPE_V4) {
+            info.addr = a->addr.u_addr.ip4.addr;
+            break;
+        }
+    }
+    info.expires_us = now + (int64_t)r->ttl * 1000000;
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    slot_t *s = find(info.instance);
+    if (r->ttl == 0) {
+        // goodbye packet
+        if (s == NULL) {
+            xSemaphoreGive(s_lock);
+            return;
+        }
+        info = s->info;
+        s->state = SLOT_DELETED;
+        s_count--;
+        event = MDNS_BROWSE_REMOVED;
+    } else if (s) {
+        bool changed = s->info.port != info.port || s->info.addr != info.addr ||
+                       strcmp(s->info.hostname, info.hostname) != 0;
+        s->info = info;
+        event = MDNS_BROWSE_UPDATED;
+        report = changed;
+    } else if ((s = insert_slot(info.instance)) != NULL) {
+        s->state = SLOT_USED;
+        s->info = info;
+        s_count++;
+    } else {
+        xSemaphoreGive(s_lock);
+        ESP_LOGW(TAG, "cache full, %s not stored", info.instance);
+        return;
+    }
+    if (event != MDNS_BROWSE_REMOVED) {
+        s->seen = true;
+        s->refresh_us = now + (int64_t)r->ttl * 1000000 * MDNS_BROWSE_REFRESH_PCT / 100;
+    }
+    xSemaphoreGive(s_lock);
+
+    if (report) {
+        notify(event, &info);
+    }
+}
+
+static void query(void)
+{
+    mdns_result_t *results = NULL;
+    uint8_t num = 0;
+
+    s_last_query_us = esp_timer_get_time();
+    mdns_search_once_t *search = mdns_query_async_new(NULL, s_service, s_proto, MDNS_TYPE_PTR,
+                                                      QUERY_TIMEOUT_MS, QUERY_MAX_RESULTS, NULL);
+    if (search == NULL) {
+        ESP_LOGE(TAG, "query failed to start");
+        return;
+    }
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    for (int i = 0; i < TABLE_SIZE; i++) {
+        s_table[i].seen = false;
+    }
+    xSemaphoreGive(s_lock);
+
+    // waits in this task only, the mdns task collects the answers
+    mdns_query_async_get_results(search, QUERY_TIMEOUT_MS + 100, &results, &num);
+    int64_t now = esp_timer_get_time();
+    for (mdns_result_t *r = results; r; r = r->next) {
+        apply_result(r, now);
+    }
+    mdns_query_results_free(results);
+    mdns_query_async_delete(search);
+
+    // instances that did not answer are left to expire, no more refreshes
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    for (int i = 0; i < TABLE_SIZE; i++) {
+        if (s_table[i].state == SLOT_USED && !s_table[i].seen) {
+            s_table[i].refresh_us = s_table[i].info.expires_us;
+        }
+    }
+    xSemaphoreGive(s_lock);
+}
+
+/* Removes expired entries and returns the time of the next refresh or
+ * expiry, INT64_MAX if the cache is empty. */
+static int64_t expire(int64_t now)
+{
+    mdns_service_info_t gone[MDNS_BROWSE_MAX_SERVICES];
+    int n_gone = 0;
+    int64_t next = INT64_MAX;
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    for (int i = 0; i < TABLE_SIZE; i++) {
+        slot_t *s = &s_table[i];
+        if (s->state != SLOT_USED) {
+            continue;
+        }
+        if (now >= s->info.expires_us) {
+            gone[n_gone++] = s->info;
+            s->state = SLOT_DELETED;
+            s_count--;
+            continue;
+        }
+        int64_t t = s->refresh_us < s->info.expires_us ? s->refresh_us : s->info.expires_us;
+        if (t < next) {
+            next = t;
+        }
+    }
+    if (s_count == 0) {
+        // nothing live left, tombstones only slow the probes down
+        memset(s_table, 0, sizeof(s_table));
+    }
+    xSemaphoreGive(s_lock);
+
+    for (int i = 0; i < n_gone; i++) {
+        notify(MDNS_BROWSE_REMOVED, &gone[i]);
+    }
+    return next;
+}
+
+static void mdns_browse_task(void *pvParameters)
+{
+    uint32_t idle_ms = MDNS_BROWSE_MIN_QUERY_MS;
+    int64_t next_query = 0;
+
+    while (1) {
+        int64_t now = esp_timer_get_time();
+        if (now >= next_query) {
+            query();
+            now = esp_timer_get_time();
+
+            // the earliest refresh or expiry decides when to ask again
+            int64_t next = expire(now);
+            if (next == INT64_MAX) {
+                // nothing cached: look again with a growing interval
+                next_query = now + (int64_t)idle_ms * 1000;
+                idle_ms = idle_ms * 2 > MDNS_BROWSE_IDLE_MAX_MS ? MDNS_BROWSE_IDLE_MAX_MS : idle_ms * 2;
+            } else {
+                next_query = next;
+                idle_ms = MDNS_BROWSE_MIN_QUERY_MS;
+            }
+        }
+
+        TickType_t wait = next_query > now ? pdMS_TO_TICKS((next_query - now) / 1000) + 1 : 0;
+        if (ulTaskNotifyTake(pdTRUE, wait)) {
+            // a lookup missed, query now unless one just ran
+            int64_t earliest = s_last_query_us + MDNS_BROWSE_MIN_QUERY_MS * 1000;
+            if (earliest < next_query) {
+                next_query = earliest;
+            }
+        }
+    }
+}
+
+esp_err_t mdns_browse_start(const char *service, const char *proto, mdns_browse_cb_t cb, void *arg)
+{
+    strlcpy(s_service, service, sizeof(s_service));
+    strlcpy(s_proto, proto, sizeof(s_proto));
+    s_cb = cb;
+    s_cb_arg = arg;
+
+    s_lock = xSemaphoreCreateMutex();
+    if (s_lock == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    TaskHandle_t task;
+    if (xTaskCreate(mdns_browse_task, "mdns_browse", 4096, NULL, 4, &task) != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+    // published last: a lookup may already run once s_lock is set
+    __atomic_store_n(&s_task, task, __ATOMIC_RELEASE);
+    return ESP_OK;
+}
+
+bool mdns_browse_lookup(const char *instance, mdns_service_info_t *out)
+{
+    if (s_lock == NULL) {
+        return false;
+    }
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    slot_t *s = find(instance);
+    if (s) {
+        *out = s->info;
+    }
+    xSemaphoreGive(s_lock);
+
+    // no task yet while mdns_browse_start() is creating it
+    TaskHandle_t task = __atomic_load_n(&s_task, __ATOMIC_ACQUIRE);
+    if (s == NULL && task != NULL) {
+        xTaskNotifyGive(task);
+    }
+    return s != NULL;
+}
@@ -0,0 +1,43 @@
+#ifndef _MDNS_BROWSE_H_
+#define _MDNS_BROWSE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+#define MDNS_BROWSE_MAX_SERVICES  16
+#define MDNS_BROWSE_NAME_LEN      64
+#define MDNS_BROWSE_REFRESH_PCT   80    // re-query at this share of the record TTL (RFC 6762, 5.2)
+#define MDNS_BROWSE_MIN_QUERY_MS  1000  // cache misses trigger at most one query this often
+#define MDNS_BROWSE_IDLE_MAX_MS   60000 // discovery backoff cap while nothing is cached
+
+typedef enum {
+    MDNS_BROWSE_ADDED,
+    MDNS_BROWSE_UPDATED,
+    MDNS_BROWSE_REMOVED,
+} mdns_browse_event_t;
+
+typedef struct {
+    char instance[MDNS_BROWSE_NAME_LEN];
+    char hostname[MDNS_BROWSE_NAME_LEN];
+    uint16_t port;
+    uint32_t addr;              // IPv4, network byte order, 0 if none was announced
+    int64_t expires_us;         // esp_timer time the records run out
+} mdns_service_info_t;
+
+// Runs in the browse task, never while the cache is locked
+typedef void (*mdns_browse_cb_t)(mdns_browse_event_t event, const mdns_service_info_t *svc, void *arg);
+
+/* Starts the browse task for one service type (e.g. "_http", "_tcp").
+ * It keeps a cache of the instances found, re-queries the network when a
+ * cached record reaches MDNS_BROWSE_REFRESH_PCT of its TTL or a lookup
+ * misses, drops records when their TTL runs out, and reports every change
+ * through cb. Queries run asynchronously in that task; nothing else waits
+ * on the network. */
+esp_err_t mdns_browse_start(const char *service, const char *proto, mdns_browse_cb_t cb, void *arg);
+
+/* Copies the cached instance into out, O(1). A miss returns false at once
+ * and schedules a query, so a later lookup may succeed. */
+bool mdns_browse_lookup(const char *instance, mdns_service_info_t *out);
+
+#endif
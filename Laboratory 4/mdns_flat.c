@@ -0,0 +1,300 @@
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mdns_flat.h"
+
+#define INTERN_SLOTS 64             // power of two; once full, strings are stored again
+
+static const char *ip_protocol_str[] = {"V4", "V6", "MAX"};
+
+typedef struct {
+    char *strings;
+    size_t len;
+    uint16_t slots[INTERN_SLOTS];   // offset + 1, 0 is free
+    uint16_t interned;
+} pool_t;
+
+static uint32_t hash(const char *s)
+{
+    // FNV-1a
+    uint32_t h = 2166136261u;
+    while (*s) {
+        h = (h ^ (uint8_t)*s++) * 16777619u;
+    }
+    return h;
+}
+
+static uint16_t add(pool_t *p, const char *s)
+{
+    if (s == NULL) {
+        return MDNS_FLAT_NONE;
+    }
+    size_t n = strlen(s) + 1;
+    uint16_t off = p->len;
+    memcpy(p->strings + p->len, s, n);
+    p->len += n;
+    return off;
+}
+
+// Like add(), but a string seen before returns the earlier copy
+static uint16_t intern(pool_t *p, const char *s)
+{
+    if (s == NULL) {
+        return MDNS_FLAT_NONE;
+    }
+    for (uint32_t i = hash(s), n = 0; n < INTERN_SLOTS; i++, n++) {
+        uint16_t *slot = &p->slots[i & (INTERN_SLOTS - 1)];
+        if (*slot == 0) {
+            uint16_t off = add(p, s);
+            *slot = off + 1;
+            return off;
+        }
+        if (strcmp(p->strings + *slot - 1, s) == 0) {
+            p->interned++;
+            return *slot - 1;
+        }
+    }
+    return add(p, s);
+}
+
+static size_t str_size(const char *s)
+{
+    return s ? strlen(s) + 1 : 0;
+}
+
+mdns_flat_t *mdns_flat_from_results(const mdns_result_t *results)
+{
+    size_t count = 0, txt_count = 0, addr_count = 0, strings_max = 0;
+
+    // first pass sizes the arena, interning can only make the strings shorter
+    for (const mdns_result_t *r = results; r; r = r->next) {
+        size_t addrs = 0;
+        count++;
+        strings_max += str_size(r->instance_name) + str_size(r->hostname);
+        if (r->txt_count > UINT8_MAX) {
+            return NULL;
+        }
+        txt_count += r->txt_count;
+        for (size_t t = 0; t < r->txt_count; t++) {
+            strings_max += str_size(r->txt[t].key) + str_size(r->txt[t].value);
+        }
+        for (const mdns_ip_addr_t *a = r->addr; a; a = a->next) {
+            addrs++;
+        }
+        if (addrs > UINT8_MAX) {
+            return NULL;
+        }
+        addr_count += addrs;
+    }
+    if (count > UINT16_MAX || txt_count > UINT16_MAX || addr_count > UINT16_MAX ||
+        strings_max >= MDNS_FLAT_NONE) {
+        return NULL;
+    }
+
+    size_t fixed = sizeof(mdns_flat_t) + count * sizeof(mdns_flat_result_t) +
+                   txt_count * sizeof(mdns_flat_txt_t) + addr_count * sizeof(mdns_flat_addr_t);
+    mdns_flat_t *f = malloc(fixed + strings_max);
+    if (f == NULL) {
+        return NULL;
+    }
+    memset(f, 0, fixed);
+    f->count = count;
+    f->txt_count = txt_count;
+    f->addr_count = addr_count;
+
+    mdns_flat_result_t *out = (mdns_flat_result_t *)mdns_flat_results(f);
+    mdns_flat_txt_t *txt = (mdns_flat_txt_t *)mdns_flat_txt(f);
+    mdns_flat_addr_t *addr = (mdns_flat_addr_t *)mdns_flat_addrs(f);
+    pool_t pool = { .strings = (char *)(addr + addr_count) };
+    uint16_t txt_next = 0, addr_next = 0;
+
+    for (const mdns_result_t *r = results; r; r = r->next, out++) {
+        out->instance = add(&pool, r->instance_name);
+        out->hostname = intern(&pool, r->hostname);
+        out->port = r->port;
+        out->ip_protocol = r->ip_protocol;
+        out->ttl = r->ttl;
+
+        out->txt_first = txt_next;
+        out->txt_count = r->txt_count;
+        for (size_t t = 0; t < r->txt_count; t++, txt_next++) {
+            txt[txt_next].key = intern(&pool, r->txt[t].key);
+            txt[txt_next].value = add(&pool, r->txt[t].value);
+        }
+
+        out->addr_first = addr_next;
+        for (const mdns_ip_addr_t *a = r->addr; a; a = a->next, addr_next++) {
+            addr[addr_next].type = a->addr.type;
+            if (a->addr.type == IPADDR_TYPE_V6) {
+                memcpy(addr[addr_next].addr, a->addr.u_addr.ip6.addr, 16);
+            } else {
+                memcpy(addr[addr_next].addr, &a->addr.u_addr.ip4.addr, 4);
+            }
+            out->addr_count++;
+        }
+    }
+
+    f->strings_len = pool.len;
+    f->interned = pool.interned;
+    f->size = fixed + pool.len;
+    return f;
+}
+
+void mdns_flat_free(mdns_flat_t *f)
+{
+    free(f);
+}
+
+typedef struct {
+    char *buf;
+    size_t cap;
+    size_t len;
+} out_t;
+
+// Appenders keep counting past cap so the caller learns the full length
+static void put_mem(out_t *o, const char *s, size_t n)
+{
+    if (o->len < o->cap) {
+        size_t room = o->cap - o->len - 1;
+        memcpy(o->buf + o->len, s, n < room ? n : room);
+        o->buf[o->len + (n < room ? n : room)] = '\0';
+    }
+    o->len += n;
+}
+
+static void put_str(out_t *o, const char *s)
+{
+    put_mem(o, s, strlen(s));
+}
+
+static void put_uint(out_t *o, uint32_t v)
+{
+    char tmp[10];
+    int n = 0;
+    do {
+        tmp[sizeof(tmp) - ++n] = '0' + v % 10;
+        v /= 10;
+    } while (v);
+    put_mem(o, tmp + sizeof(tmp) - n, n);
+}
+
+static void put_hex_byte(char *p, uint8_t b)
+{
+    static const char hex[] = "0123456789abcdef";
+    p[0] = hex[b >> 4];
+    p[1] = hex[b & 15];
+}
+
+size_t mdns_flat_format(const mdns_flat_t *f, char *buf, size_t cap)
+{
+    out_t o = { buf, cap, 0 };
+    const mdns_flat_result_t *r = mdns_flat_results(f);
+    const mdns_flat_txt_t *txt = mdns_flat_txt(f);
+    const mdns_flat_addr_t *addr = mdns_flat_addrs(f);
+
+    if (cap) {
+        buf[0] = '\0';
+    }
+    // same text as mdns_print_results(), without a printf per field
+    for (int i = 0; i < f->count; i++, r++) {
+        put_uint(&o, i + 1);
+        put_str(&o, ": Interface:, Type: ");
+        put_str(&o, ip_protocol_str[r->ip_protocol < 2 ? r->ip_protocol : 2]);
+        put_str(&o, "\n");
+        if (r->instance != MDNS_FLAT_NONE) {
+            put_str(&o, "  PTR : ");
+            put_str(&o, mdns_flat_str(f, r->instance));
+            put_str(&o, "\n");
+        }
+        if (r->hostname != MDNS_FLAT_NONE) {
+            put_str(&o, "  SRV : ");
+            put_str(&o, mdns_flat_str(f, r->hostname));
+            put_str(&o, ".local:");
+            put_uint(&o, r->port);
+            put_str(&o, "\n");
+        }
+        if (r->txt_count) {
+            put_str(&o, "  TXT : [");
+            put_uint(&o, r->txt_count);
+            put_str(&o, "] ");
+            for (int t = r->txt_first; t < r->txt_first + r->txt_count; t++) {
+                const char *key = mdns_flat_str(f, txt[t].key);
+                const char *value = mdns_flat_str(f, txt[t].value);
+                put_str(&o, key ? key : "");
+                put_str(&o, "=");
+                put_str(&o, value ? value : "");
+                put_str(&o, "; ");
+            }
+            put_str(&o, "\n");
+        }
+        for (int a = r->addr_first; a < r->addr_first + r->addr_count; a++) {
+            const uint8_t *b = addr[a].addr;
+            if (addr[a].type == IPADDR_TYPE_V6) {
+                char text[8 + 39 + 1] = "  AAAA: ";
+                char *p = text + 8;
+                for (int k = 0; k < 16; k += 2) {
+                    put_hex_byte(p, b[k]);
+                    put_hex_byte(p + 2, b[k + 1]);
+                    p[4] = k < 14 ? ':' : '\n';
+                    p += 5;
+                }
+                put_mem(&o, text, sizeof(text));
+            } else {
+                put_str(&o, "  A   : ");
+                for (int k = 0; k < 4; k++) {
+                    put_uint(&o, b[k]);
+                    put_str(&o, k < 3 ? "." : "\n");
+                }
+            }
+        }
+    }
+    return o.len;
+}
+
+size_t mdns_flat_serialize(const mdns_flat_t *f, void *buf, size_t cap)
+{
+    if (cap < f->size) {
+        return 0;
+    }
+    memcpy(buf, f, f->size);
+    return f->size;
+}
+
+static bool str_ok(const mdns_flat_t *f, uint16_t off)
+{
+    return off == MDNS_FLAT_NONE || off < f->strings_len;
+}
+
+const mdns_flat_t *mdns_flat_load(const void *buf, size_t len)
+{
+    const mdns_flat_t *f = buf;
+
+    if (((uintptr_t)buf & 3) || len < sizeof(mdns_flat_t)) {
+        return NULL;
+    }
+    size_t size = sizeof(mdns_flat_t) + f->count * sizeof(mdns_flat_result_t) +
+                  f->txt_count * sizeof(mdns_flat_txt_t) + f->addr_count * sizeof(mdns_flat_addr_t) +
+                  f->strings_len;
+    if (f->size != size || size > len) {
+        return NULL;
+    }
+    // every string ends inside the pool
+    if (f->strings_len && mdns_flat_str(f, 0)[f->strings_len - 1] != '\0') {
+        return NULL;
+    }
+
+    const mdns_flat_result_t *r = mdns_flat_results(f);
+    const mdns_flat_txt_t *txt = mdns_flat_txt(f);
+    for (int i = 0; i < f->count; i++, r++) {
+        if (!str_ok(f, r->instance) || !str_ok(f, r->hostname) ||
+            r->txt_first + r->txt_count > f->txt_count || r->addr_first + r->addr_count > f->addr_count) {
+            return NULL;
+        }
+    }
+    for (int t = 0; t < f->txt_count; t++) {
+        if (!str_ok(f, txt[t].key) || !str_ok(f, txt[t].value)) {
+            return NULL;
+        }
+    }
+    return f;
+}
@@ -0,0 +1,100 @@
+#ifndef _MDNS_FLAT_H_
+#define _MDNS_FLAT_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef ESP_PLATFORM
+#include "..\mdns\include\mdns.h"
+#else
+// host builds (host_test/) use a stub with the same types
+#include "mdns.h"
+#endif
+
+/* Query results copied out of the mdns_result_t list into one allocation:
+ *
+ *   mdns_flat_t                        header
+ *   mdns_flat_result_t[count]          one per result, in list order
+ *   mdns_flat_txt_t[txt_count]         TXT items, each result owns a run
+ *   mdns_flat_addr_t[addr_count]       addresses, each result owns a run
+ *   char strings[]                     NUL-terminated, referenced by offset
+ *
+ * Hostnames and TXT keys repeat across results and are stored once. Nothing
+ * inside holds a pointer, so the arena can be copied, sent or stored as is
+ * (mdns_flat_serialize / mdns_flat_load) and freed with one free(). */
+
+#define MDNS_FLAT_NONE  0xFFFF      // string offset of a missing field
+
+typedef struct {
+    uint16_t instance;
+    uint16_t hostname;
+    uint16_t port;
+    uint8_t ip_protocol;            // mdns_ip_protocol_t
+    uint8_t txt_count;
+    uint16_t txt_first;
+    uint16_t addr_first;
+    uint8_t addr_count;
+    uint8_t reserved;
+    uint32_t ttl;
+} mdns_flat_result_t;
+
+typedef struct {
+    uint16_t key;
+    uint16_t value;                 // MDNS_FLAT_NONE for a key without value
+} mdns_flat_txt_t;
+
+typedef struct {
+    uint8_t type;                   // IPADDR_TYPE_V4 / IPADDR_TYPE_V6
+    uint8_t reserved[3];
+    uint8_t addr[16];               // network order, IPv4 in the first 4 bytes
+} mdns_flat_addr_t;
+
+typedef struct {
+    uint32_t size;                  // whole arena in bytes, header included
+    uint16_t count;
+    uint16_t txt_count;
+    uint16_t addr_count;
+    uint16_t strings_len;
+    uint16_t interned;              // repeated strings that were stored once
+    uint16_t reserved;
+} mdns_flat_t;
+
+static inline const mdns_flat_result_t *mdns_flat_results(const mdns_flat_t *f)
+{
+    return (const mdns_flat_result_t *)(f + 1);
+}
+
+static inline const mdns_flat_txt_t *mdns_flat_txt(const mdns_flat_t *f)
+{
+    return (const mdns_flat_txt_t *)(mdns_flat_results(f) + f->count);
+}
+
+static inline const mdns_flat_addr_t *mdns_flat_addrs(const mdns_flat_t *f)
+{
+    return (const mdns_flat_addr_t *)(mdns_flat_txt(f) + f->txt_count);
+}
+
+// Returns the string at off, NULL for MDNS_FLAT_NONE
+static inline const char *mdns_flat_str(const mdns_flat_t *f, uint16_t off)
+{
+    return off == MDNS_FLAT_NONE ? NULL : (const char *)(mdns_flat_addrs(f) + f->addr_count) + off;
+}
+
+/* Copies results into a new arena, NULL when out of memory or when the
+ * strings do not fit 16-bit offsets. The list is not freed. */
+mdns_flat_t *mdns_flat_from_results(const mdns_result_t *results);
+
+/* Writes the listing mdns_print_results() used to print into buf and
+ * returns its full length like snprintf, so a short buf can be retried. */
+size_t mdns_flat_format(const mdns_flat_t *f, char *buf, size_t cap);
+
+// Returns f->size, or 0 without writing when buf is too small
+size_t mdns_flat_serialize(const mdns_flat_t *f, void *buf, size_t cap);
+
+/* Checks a serialized arena (same byte order, 4-byte aligned buf) and
+ * returns it in place, NULL if it is malformed. */
+const mdns_flat_t *mdns_flat_load(const void *buf, size_t len);
+
+void mdns_flat_free(mdns_flat_t *f);
+
+#endif
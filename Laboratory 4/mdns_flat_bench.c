@@ -0,0 +1,205 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include "mdns_flat.h"
+#include "mdns_flat_bench.h"
+
+#define HELD_QUERIES 8              // results kept alive at once for the heap figures
+#define FORMAT_BUF   4096
+
+static const char *ip_protocol_str[] = {"V4", "V6", "MAX"};
+
+typedef struct {
+    uint32_t allocs;
+    size_t bytes;
+} list_cost_t;
+
+static void *bench_alloc(list_cost_t *c, size_t n)
+{
+    c->allocs++;
+    c->bytes += n;
+    return calloc(1, n);
+}
+
+static char *bench_strdup(list_cost_t *c, const char *s)
+{
+    char *d = bench_alloc(c, strlen(s) + 1);
+    strcpy(d, s);
+    return d;
+}
+
+// Same shape as a browse answer: PTR/SRV/TXT per instance, A and AAAA per host
+static mdns_result_t *make_results(int n, list_cost_t *c)
+{
+    static const char *keys[] = {"board", "path", "version"};
+    mdns_result_t *head = NULL, **tail = &head;
+    char text[32];
+
+    for (int i = 0; i < n; i++) {
+        mdns_result_t *r = bench_alloc(c, sizeof(*r));
+        snprintf(text, sizeof(text), "Lab device %d", i);
+        r->instance_name = bench_strdup(c, text);
+        // a few hosts announce several instances each
+        snprintf(text, sizeof(text), "esp32-node%d", i % 4);
+        r->hostname = bench_strdup(c, text);
+        r->port = 80 + i;
+        r->ip_protocol = MDNS_IP_PROTOCOL_V4;
+        r->ttl = 120;
+
+        r->txt_count = 3;
+        r->txt = bench_alloc(c, r->txt_count * sizeof(mdns_txt_item_t));
+        r->txt_value_len = bench_alloc(c, r->txt_count);
+        for (int t = 0; t < r->txt_count; t++) {
+            snprintf(text, sizeof(text), "v%d", i + t);
+            r->txt[t].key = bench_strdup(c, keys[t]);
+            r->txt[t].value = bench_strdup(c, text);
+            r->txt_value_len[t] = strlen(text);
+        }
+
+        mdns_ip_addr_t *v4 = bench_alloc(c, sizeof(*v4));
+        v4->addr.type = IPADDR_TYPE_V4;
+        v4->addr.u_addr.ip4.addr = 0x0059a8c0 | ((uint32_t)(i % 4 + 10) << 24);
+        mdns_ip_addr_t *v6 = bench_alloc(c, sizeof(*v6));
+        v6->addr.type = IPADDR_TYPE_V6;
+        v6->addr.u_addr.ip6.addr[0] = 0x000080fe;
+        v6->addr.u_addr.ip6.addr[3] = i;
+        v4->next = v6;
+        r->addr = v4;
+
+        *tail = r;
+        tail = &r->next;
+    }
+    return head;
+}
+
+// mdns_print_results() with the output going to buf instead of the console
+static size_t format_list(const mdns_result_t *results, char *buf, size_t cap)
+{
+    size_t len = 0;
+    int i = 1;
+
+#define PUT(...) len += snprintf(buf + len, len < cap ? cap - len : 0, __VA_ARGS__)
+    for (const mdns_result_t *r = results; r; r = r->next) {
+        PUT("%d: Interface:, Type: %s\n", i++, ip_protocol_str[r->ip_protocol]);
+        if (r->instance_name) {
+            PUT("  PTR : %s\n", r->instance_name);
+        }
+        if (r->hostname) {
+            PUT("  SRV : %s.local:%u\n", r->hostname, r->port);
+        }
+        if (r->txt_count) {
+            PUT("  TXT : [%u] ", (unsigned)r->txt_count);
+            for (int t = 0; t < r->txt_count; t++) {
+                PUT("%s=%s; ", r->txt[t].key, r->txt[t].value);
+            }
+            PUT("\n");
+        }
+        for (const mdns_ip_addr_t *a = r->addr; a; a = a->next) {
+            if (a->addr.type == IPADDR_TYPE_V6) {
+                PUT("  AAAA: " IPV6STR "\n", IPV62STR(a->addr.u_addr.ip6));
+            } else {
+                PUT("  A   : " IPSTR "\n", IP2STR(&(a->addr.u_addr.ip4)));
+            }
+        }
+    }
+#undef PUT
+    return len;
+}
+
+static uint32_t per_iter(const mdns_flat_bench_hal_t *hal, uint64_t ticks, int iterations)
+{
+    return (uint32_t)(ticks * 1000000000ULL / hal->tick_hz / iterations);
+}
+
+/* Returns the largest free block while HELD_QUERIES results are kept
+ * alive, each followed by a small allocation of some other task. */
+static size_t held_heap(const mdns_flat_bench_hal_t *hal, int results, bool flat)
+{
+    void *held[HELD_QUERIES], *other[HELD_QUERIES];
+    list_cost_t c = {0};
+
+    for (int q = 0; q < HELD_QUERIES; q++) {
+        mdns_result_t *list = make_results(results, &c);
+        if (flat) {
+            held[q] = mdns_flat_from_results(list);
+            mdns_query_results_free(list);
+        } else {
+            held[q] = list;
+        }
+        other[q] = malloc(32);
+    }
+    size_t largest = hal->largest_free();
+    for (int q = 0; q < HELD_QUERIES; q++) {
+        if (flat) {
+            mdns_flat_free(held[q]);
+        } else {
+            mdns_query_results_free(held[q]);
+        }
+        free(other[q]);
+    }
+    return largest;
+}
+
+bool mdns_flat_bench_run(const mdns_flat_bench_hal_t *hal, int results, int iterations)
+{
+    static char buf[FORMAT_BUF], flat_buf[FORMAT_BUF];
+    uint64_t list_walk = 0, list_free = 0, convert = 0, flat_walk = 0, flat_free = 0;
+    list_cost_t cost = {0};
+    size_t list_len = 0, flat_len = 0, arena = 0, interned = 0;
+    bool same = true;
+
+    for (int it = 0; it < iterations; it++) {
+        list_cost_t c = {0};
+        mdns_result_t *list = make_results(results, &c);
+        cost = c;
+
+        uint32_t t0 = hal->now();
+        list_len = format_list(list, buf, sizeof(buf));
+        uint32_t t1 = hal->now();
+        mdns_flat_t *f = mdns_flat_from_results(list);
+        uint32_t t2 = hal->now();
+        mdns_query_results_free(list);
+        uint32_t t3 = hal->now();
+        if (f == NULL) {
+            printf("mdns_flat: out of memory\n");
+            return false;
+        }
+        flat_len = mdns_flat_format(f, flat_buf, sizeof(flat_buf));
+        uint32_t t4 = hal->now();
+        arena = f->size;
+        interned = f->interned;
+        mdns_flat_free(f);
+        uint32_t t5 = hal->now();
+
+        if (list_len != flat_len || memcmp(buf, flat_buf, list_len < sizeof(buf) ? list_len : sizeof(buf)) != 0) {
+            printf("mdns_flat: listing differs from the list walk\n");
+            same = false;
+        }
+        list_walk += t1 - t0;
+        convert += t2 - t1;
+        list_free += t3 - t2;
+        flat_walk += t4 - t3;
+        flat_free += t5 - t4;
+    }
+
+    printf("\nmdns_flat: %d results, %d iterations\n", results, iterations);
+    printf("list : %lu allocs, %lu bytes, walk %lu ns, free %lu ns, %lu chars\n",
+           (unsigned long)cost.allocs, (unsigned long)cost.bytes,
+           (unsigned long)per_iter(hal, list_walk, iterations),
+           (unsigned long)per_iter(hal, list_free, iterations), (unsigned long)list_len);
+    printf("arena: 1 alloc, %lu bytes (%lu strings interned), convert %lu ns, walk %lu ns, free %lu ns, %lu chars\n",
+           (unsigned long)arena, (unsigned long)interned,
+           (unsigned long)per_iter(hal, convert, iterations),
+           (unsigned long)per_iter(hal, flat_walk, iterations),
+           (unsigned long)per_iter(hal, flat_free, iterations), (unsigned long)flat_len);
+    if (hal->largest_free) {
+        size_t before = hal->largest_free();
+        size_t list_after = held_heap(hal, results, false);
+        size_t flat_after = held_heap(hal, results, true);
+        printf("largest free block: %lu idle, %lu holding %d lists, %lu holding %d arenas\n",
+               (unsigned long)before, (unsigned long)list_after, HELD_QUERIES,
+               (unsigned long)flat_after, HELD_QUERIES);
+    }
+    return same;
+}
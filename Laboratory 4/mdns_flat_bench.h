@@ -0,0 +1,23 @@
+#ifndef _MDNS_FLAT_BENCH_H_
+#define _MDNS_FLAT_BENCH_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/* Compares the mdns_result_t list with the mdns_flat arena. The results
+ * are synthesised with the allocation pattern of the mdns component (every
+ * node, string, TXT array and address allocated on its own), so no network
+ * is needed. Time comes from now() in ticks of tick_hz; heap figures come
+ * from largest_free(), which may be NULL where there is no such query. */
+typedef struct {
+    uint32_t (*now)(void);
+    uint32_t tick_hz;
+    size_t (*largest_free)(void);
+} mdns_flat_bench_hal_t;
+
+/* results per simulated query, iterations to average over. Returns false
+ * if the arena's listing ever differed from the list's, or on no memory. */
+bool mdns_flat_bench_run(const mdns_flat_bench_hal_t *hal, int results, int iterations);
+
+#endif
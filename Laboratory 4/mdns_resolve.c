@@ -0,0 +1,243 @@
+#include <string.h>
+#include <strings.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "..\mdns\include\mdns.h"
+#include "mdns_resolve.h"
+
+#define POLL_MS 100             // fallback when a query ends without its notifier
+
+typedef enum {
+    ENTRY_EMPTY,
+    ENTRY_PENDING,              // query in flight, callers wait in the entry
+    ENTRY_FOUND,
+    ENTRY_NOT_FOUND,
+} entry_state_t;
+
+typedef struct {
+    mdns_resolve_cb_t cb;
+    void *arg;
+} waiter_t;
+
+typedef struct {
+    entry_state_t state;
+    char name[MDNS_RESOLVE_NAME_LEN];
+    uint32_t addr;
+    int64_t expires_us;
+    int64_t used_us;            // last lookup, picks the eviction victim
+    mdns_search_once_t *search; // resolver task only, NULL until it starts the query
+    uint8_t n_waiters;
+    waiter_t waiters[MDNS_RESOLVE_MAX_WAITERS];
+} entry_t;
+
+static const char *TAG = "mdns_resolve";
+
+static entry_t s_cache[MDNS_RESOLVE_CACHE_SIZE];
+static mdns_resolve_stats_t s_stats;
+static SemaphoreHandle_t s_lock;
+static TaskHandle_t s_task;
+
+static entry_t *find(const char *host)
+{
+    for (int i = 0; i < MDNS_RESOLVE_CACHE_SIZE; i++) {
+        if (s_cache[i].state != ENTRY_EMPTY && strcasecmp(s_cache[i].name, host) == 0) {
+            return &s_cache[i];
+        }
+    }
+    return NULL;
+}
+
+// Free entry, else an expired one, else the least recently used; never a pending one
+static entry_t *victim(int64_t now)
+{
+    entry_t *lru = NULL;
+
+    for (int i = 0; i < MDNS_RESOLVE_CACHE_SIZE; i++) {
+        entry_t *e = &s_cache[i];
+        if (e->state == ENTRY_EMPTY) {
+            return e;
+        }
+        if (e->state == ENTRY_PENDING) {
+            continue;
+        }
+        if (now >= e->expires_us) {
+            return e;
+        }
+        if (lru == NULL || e->used_us < lru->used_us) {
+            lru = e;
+        }
+    }
+    if (lru) {
+        s_stats.evictions++;
+    }
+    return lru;
+}
+
+esp_err_t mdns_resolve_host(const char *host, mdns_resolve_cb_t cb, void *arg)
+{
+    if (s_lock == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    int64_t now = esp_timer_get_time();
+    entry_t *e = find(host);
+
+    if (e && e->state != ENTRY_PENDING && now < e->expires_us) {
+        bool found = e->state == ENTRY_FOUND;
+        uint32_t addr = e->addr;
+        e->used_us = now;
+        if (found) {
+            s_stats.hits++;
+        } else {
+            s_stats.negative_hits++;
+        }
+        xSemaphoreGive(s_lock);
+        cb(host, found ? ESP_OK : ESP_ERR_NOT_FOUND, addr, arg);
+        return ESP_OK;
+    }
+
+    if (e && e->state == ENTRY_PENDING) {
+        // same name already on the wire: wait for that answer
+        if (e->n_waiters == MDNS_RESOLVE_MAX_WAITERS) {
+            xSemaphoreGive(s_lock);
+            return ESP_ERR_NO_MEM;
+        }
+        s_stats.coalesced++;
+    } else {
+        if (e == NULL && (e = victim(now)) == NULL) {
+            xSemaphoreGive(s_lock);
+            ESP_LOGW(TAG, "every entry has a query in flight, %s dropped", host);
+            return ESP_ERR_NO_MEM;
+        }
+        e->state = ENTRY_PENDING;
+        strlcpy(e->name, host, sizeof(e->name));
+        e->search = NULL;
+        e->n_waiters = 0;
+    }
+    s_stats.misses++;
+    e->used_us = now;
+    e->waiters[e->n_waiters].cb = cb;
+    e->waiters[e->n_waiters].arg = arg;
+    e->n_waiters++;
+    xSemaphoreGive(s_lock);
+
+    xTaskNotifyGive(s_task);
+    return ESP_OK;
+}
+
+static void complete(entry_t *e, esp_err_t err, uint32_t addr, uint32_t ttl)
+{
+    waiter_t waiters[MDNS_RESOLVE_MAX_WAITERS];
+    char name[MDNS_RESOLVE_NAME_LEN];
+    int64_t now = esp_timer_get_time();
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    int n = e->n_waiters;
+    memcpy(waiters, e->waiters, n * sizeof(waiter_t));
+    strlcpy(name, e->name, sizeof(name));
+    e->n_waiters = 0;
+    e->search = NULL;
+    if (err == ESP_OK) {
+        e->state = ENTRY_FOUND;
+        e->addr = addr;
+        e->expires_us = now + (int64_t)(ttl < MDNS_RESOLVE_POSITIVE_MAX_S ? ttl : MDNS_RESOLVE_POSITIVE_MAX_S) * 1000000;
+    } else if (err == ESP_ERR_NOT_FOUND) {
+        e->state = ENTRY_NOT_FOUND;
+        e->expires_us = now + (int64_t)MDNS_RESOLVE_NEGATIVE_S * 1000000;
+    } else {
+        // failed locally, nothing learned about the host
+        e->state = ENTRY_EMPTY;
+    }
+    xSemaphoreGive(s_lock);
+
+    ESP_LOGD(TAG, "%s: %s", name, esp_err_to_name(err));
+    for (int i = 0; i < n; i++) {
+        waiters[i].cb(name, err, addr, waiters[i].arg);
+    }
+}
+
+static void on_query_done(mdns_search_once_t *search)
+{
+    // runs in the mdns task
+    xTaskNotifyGive(s_task);
+}
+
+static void mdns_resolve_task(void *pvParameters)
+{
+    while (1) {
+        bool in_flight = false;
+
+        for (int i = 0; i < MDNS_RESOLVE_CACHE_SIZE; i++) {
+            entry_t *e = &s_cache[i];
+            char name[MDNS_RESOLVE_NAME_LEN];
+
+            // only this task moves an entry out of PENDING, it stays put once seen
+            xSemaphoreTake(s_lock, portMAX_DELAY);
+            bool pending = e->state == ENTRY_PENDING;
+            bool start = pending && e->search == NULL;
+            if (start) {
+                strlcpy(name, e->name, sizeof(name));
+                s_stats.queries++;
+            }
+            xSemaphoreGive(s_lock);
+            if (!pending) {
+                continue;
+            }
+            if (start) {
+                e->search = mdns_query_async_new(name, NULL, NULL, MDNS_TYPE_A,
+                                                 MDNS_RESOLVE_TIMEOUT_MS, 1, on_query_done);
+                if (e->search == NULL) {
+                    complete(e, ESP_FAIL, 0, 0);
+                    continue;
+                }
+            }
+
+            mdns_result_t *results = NULL;
+            uint8_t num = 0;
+            if (!mdns_query_async_get_results(e->search, 0, &results, &num)) {
+                in_flight = true;
+                continue;
+            }
+
+            uint32_t addr = 0, ttl = 0;
+            for (mdns_result_t *r = results; r && addr == 0; r = r->next) {
+                for (mdns_ip_addr_t *a = r->addr; a; a = a->next) {
+                    if (a->addr.type == IPADDR_TYPE_V4) {
+                        addr = a->addr.u_addr.ip4.addr;
+                        ttl = r->ttl;
+                        break;
+                    }
+                }
+            }
+            mdns_query_results_free(results);
+            mdns_query_async_delete(e->search);
+            complete(e, addr ? ESP_OK : ESP_ERR_NOT_FOUND, addr, ttl);
+        }
+
+        ulTaskNotifyTake(pdTRUE, in_flight ? pdMS_TO_TICKS(POLL_MS) : portMAX_DELAY);
+    }
+}
+
+esp_err_t mdns_resolve_start(void)
+{
+    s_lock = xSemaphoreCreateMutex();
+    if (s_lock == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    if (xTaskCreate(mdns_resolve_task, "mdns_resolve", 3072, NULL, 4, &s_task) != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+void mdns_resolve_get_stats(mdns_resolve_stats_t *out)
+{
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    *out = s_stats;
+    xSemaphoreGive(s_lock);
+}
@@ -0,0 +1,40 @@
+#ifndef _MDNS_RESOLVE_H_
+#define _MDNS_RESOLVE_H_
+
+#include <stdint.h>
+#include "esp_err.h"
+
+#define MDNS_RESOLVE_CACHE_SIZE    8
+#define MDNS_RESOLVE_MAX_WAITERS   4     // callers coalesced onto one in-flight query
+#define MDNS_RESOLVE_NAME_LEN      64
+#define MDNS_RESOLVE_TIMEOUT_MS    2000
+#define MDNS_RESOLVE_POSITIVE_MAX_S 120  // caps the record TTL (host records, RFC 6762 10)
+#define MDNS_RESOLVE_NEGATIVE_S    10    // a missing host is not asked for again before this
+
+/* Completion of a lookup: err is ESP_OK with addr set (IPv4, network byte
+ * order), ESP_ERR_NOT_FOUND when no host answered within
+ * MDNS_RESOLVE_TIMEOUT_MS, ESP_FAIL if the query could not be sent (not
+ * cached). Cache hits complete in the caller before mdns_resolve_host()
+ * returns, everything else in the resolver task. */
+typedef void (*mdns_resolve_cb_t)(const char *host, esp_err_t err, uint32_t addr, void *arg);
+
+typedef struct {
+    uint32_t hits;              // answered from a positive entry
+    uint32_t negative_hits;     // answered from a negative entry
+    uint32_t misses;            // needed a query
+    uint32_t coalesced;         // misses that joined a query already in flight
+    uint32_t queries;
+    uint32_t evictions;
+} mdns_resolve_stats_t;
+
+esp_err_t mdns_resolve_start(void);
+
+/* Resolves host (without ".local") and reports the result through cb.
+ * Never blocks on the network. Returns ESP_ERR_NO_MEM when every cache
+ * entry has a query in flight or the query for host has
+ * MDNS_RESOLVE_MAX_WAITERS callers already; cb is not called then. */
+esp_err_t mdns_resolve_host(const char *host, mdns_resolve_cb_t cb, void *arg);
+
+void mdns_resolve_get_stats(mdns_resolve_stats_t *out);
+
+#endif
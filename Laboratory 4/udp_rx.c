@@ -0,0 +1,327 @@
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_cpu.h"
+
+#include "lwip/sockets.h"
+#include "lwip/api.h"
+#include "lwip/pbuf.h"
+
+#include "udp_rx.h"
+
+typedef struct {
+#if UDP_RX_NETCONN
+    struct netconn *conn;
+#else
+    int sock;
+#endif
+    uint16_t port;
+    udp_rx_handler_t handler;
+    void *arg;
+} udp_rx_port_t;
+
+static const char *TAG = "udp_rx";
+
+static udp_rx_port_t s_ports[UDP_RX_MAX_PORTS];
+static int s_port_count;
+static TaskHandle_t s_task;
+static udp_rx_stats_t s_stats;
+static portMUX_TYPE s_stats_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static void count_error(int err, uint16_t port)
+{
+    portENTER_CRITICAL(&s_stats_lock);
+    s_stats.recv_errors++;
+    s_stats.last_errno = err;
+    portEXIT_CRITICAL(&s_stats_lock);
+    ESP_LOGE(TAG, "receive failed on port %d: %d", port, err);
+}
+
+#if UDP_RX_NETCONN
+
+// runs in the tcpip thread for every datagram queued on a bound port
+static void rx_event(struct netconn *conn, enum netconn_evt evt, u16_t len)
+{
+    if (evt == NETCONN_EVT_RCVPLUS && s_task != NULL) {
+        xTaskNotifyGive(s_task);
+    }
+}
+
+static esp_err_t port_open(udp_rx_port_t *p)
+{
+    p->conn = netconn_new_with_callback(NETCONN_UDP, rx_event);
+    if (p->conn == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    if (netconn_bind(p->conn, IP_ADDR_ANY, p->port) != ERR_OK) {
+        netconn_delete(p->conn);
+        return ESP_FAIL;
+    }
+    netconn_set_nonblocking(p->conn, 1);
+    return ESP_OK;
+}
+
+static uint32_t drain(udp_rx_port_t *p, uint8_t local, uint32_t *bytes)
+{
+    struct netbuf *nb;
+    uint32_t n = 0;
+    err_t err = ERR_OK;
+
+    while (n < UDP_RX_BATCH && (err = netconn_recv(p->conn, &nb)) == ERR_OK) {
+        struct pbuf *pb = nb->p;
+        udp_rx_view_t view = {
+            .data = pb->payload,
+            .len = pb->len,
+            .tot_len = pb->tot_len,
+            .chain = pb,
+        };
+        udp_rx_peer_t from = {
+            .addr = ip4_addr_get_u32(ip_2_ip4(netbuf_fromaddr(nb))),
+            .port = netbuf_fromport(nb),
+            .local = local,
+        };
+        p->handler(&view, &from, p->arg);
+        *bytes += view.tot_len;
+        n++;
+        // releases the pbuf chain
+        netbuf_delete(nb);
+    }
+    if (n == UDP_RX_BATCH) {
+        /* Stopped at the batch cap with datagrams still queued. The take in
+         * wait_readable() cleared their notifications: come straight back,
+         * after the other ports had their turn. */
+        xTaskNotifyGive(xTaskGetCurrentTaskHandle());
+    } else if (err != ERR_OK && err != ERR_WOULDBLOCK) {
+        count_error(err, p->port);
+    }
+    return n;
+}
+
+static void wait_readable(bool *ready)
+{
+    /* Notifications count datagrams queued on any port; one take clears
+     * them all, drain() re-notifies when it leaves some behind. A spurious
+     * wake-up drains nothing. */
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    for (int i = 0; i < s_port_count; i++) {
+        ready[i] = true;
+    }
+}
+
+esp_err_t udp_rx_reply(const udp_rx_peer_t *to, const void *data, size_t len)
+{
+    struct netbuf *nb = netbuf_new();
+    ip_addr_t addr = IPADDR4_INIT(to->addr);
+    if (nb == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    // no copy: netconn_sendto() completes before netbuf_delete()
+    netbuf_ref(nb, data, len);
+    err_t err = netconn_sendto(s_ports[to->local].conn, nb, &addr, to->port);
+    netbuf_delete(nb);
+    return err == ERR_OK ? ESP_OK : ESP_FAIL;
+}
+
+#else
+
+static esp_err_t port_open(udp_rx_port_t *p)
+{
+    p->sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_IP);
+    if (p->sock < 0) {
+        ESP_LOGE(TAG, "Unable to create socket: errno %d", errno);
+        return ESP_FAIL;
+    }
+
+    struct sockaddr_in local_addr;
+    local_addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    local_addr.sin_family = AF_INET;
+    local_addr.sin_port = htons(p->port);
+    if (bind(p->sock, (struct sockaddr *)&local_addr, sizeof(local_addr)) < 0) {
+        close(p->sock);
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+static uint32_t drain(udp_rx_port_t *p, uint8_t local, uint32_t *bytes)
+{
+    static uint8_t buf[UDP_RX_BUF_LEN];
+    uint32_t n = 0;
+
+    while (n < UDP_RX_BATCH) {
+        struct sockaddr_in src;
+        socklen_t srclen = sizeof(src);
+        int len = recvfrom(p->sock, buf, sizeof(buf), MSG_DONTWAIT, (struct sockaddr *)&src, &srclen);
+        if (len < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                count_error(errno, p->port);
+            }
+            break;
+        }
+        udp_rx_view_t view = {
+            .data = buf,
+            .len = len,
+            .tot_len = len,
+            .chain = NULL,
+        };
+        udp_rx_peer_t from = {
+            .addr = src.sin_addr.s_addr,
+            .port = ntohs(src.sin_port),
+            .local = local,
+        };
+        p->handler(&view, &from, p->arg);
+        *bytes += len;
+        n++;
+    }
+    return n;
+}
+
+static void wait_readable(bool *ready)
+{
+    fd_set readfds;
+    int maxfd = -1;
+
+    while (1) {
+        FD_ZERO(&readfds);
+        for (int i = 0; i < s_port_count; i++) {
+            FD_SET(s_ports[i].sock, &readfds);
+            if (s_ports[i].sock > maxfd) {
+                maxfd = s_ports[i].sock;
+            }
+        }
+        if (select(maxfd + 1, &readfds, NULL, NULL, NULL) >= 0) {
+            break;
+        }
+        ESP_LOGE(TAG, "select failed: errno %d", errno);
+        vTaskDelay(pdMS_TO_TICKS(100));
+    }
+    for (int i = 0; i < s_port_count; i++) {
+        ready[i] = FD_ISSET(s_ports[i].sock, &readfds);
+    }
+}
+
+esp_err_t udp_rx_reply(const udp_rx_peer_t *to, const void *data, size_t len)
+{
+    struct sockaddr_in dest = {
+        .sin_family = AF_INET,
+        .sin_port = htons(to->port),
+        .sin_addr.s_addr = to->addr,
+    };
+    if (sendto(s_ports[to->local].sock, data, len, 0, (struct sockaddr *)&dest, sizeof(dest)) < 0) {
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+#endif
+
+esp_err_t udp_rx_add_port(uint16_t port, udp_rx_handler_t handler, void *arg)
+{
+    if (s_port_count == UDP_RX_MAX_PORTS) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    udp_rx_port_t *p = &s_ports[s_port_count];
+    p->port = port;
+    p->handler = handler;
+    p->arg = arg;
+    esp_err_t err = port_open(p);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Unable to bind port %d", port);
+        return err;
+    }
+    s_port_count++;
+    ESP_LOGI(TAG, "Bound port %d (%s)", port, UDP_RX_NETCONN ? "netconn" : "socket");
+    return ESP_OK;
+}
+
+static void udp_rx_task(void *pvParameters)
+{
+    bool ready[UDP_RX_MAX_PORTS];
+
+    while (1) {
+        // the only blocking point: an idle receiver costs nothing
+        wait_readable(ready);
+
+        uint32_t start = esp_cpu_get_cycle_count();
+        uint32_t packets = 0, bytes = 0, batch_max = 0, full = 0;
+        for (int i = 0; i < s_port_count; i++) {
+            if (!ready[i]) {
+                continue;
+            }
+            uint32_t n = drain(&s_ports[i], i, &bytes);
+            packets += n;
+            if (n > batch_max) {
+                batch_max = n;
+            }
+            if (n >= CONFIG_LWIP_UDP_RECVMBOX_SIZE) {
+                full++;
+            }
+        }
+        uint32_t cycles = esp_cpu_get_cycle_count() - start;
+
+        portENTER_CRITICAL(&s_stats_lock);
+        s_stats.wakeups++;
+        s_stats.packets += packets;
+        s_stats.bytes += bytes;
+        s_stats.mailbox_full += full;
+        s_stats.cycles += cycles;
+        if (batch_max > s_stats.batch_high_water) {
+            s_stats.batch_high_water = batch_max;
+        }
+        portEXIT_CRITICAL(&s_stats_lock);
+    }
+}
+
+esp_err_t udp_rx_start(void)
+{
+    if (s_port_count == 0) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (xTaskCreate(udp_rx_task, "udp_rx", 4096, NULL, 5, &s_task) != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+#if UDP_RX_NETCONN
+    // datagrams queued before the task existed raised no notification
+    xTaskNotifyGive(s_task);
+#endif
+    return ESP_OK;
+}
+
+size_t udp_rx_view_copy(const udp_rx_view_t *view, void *dst, size_t len, size_t offset)
+{
+    if (view->chain == NULL) {
+        if (offset >= view->tot_len) {
+            return 0;
+        }
+        if (len > view->tot_len - offset) {
+            len = view->tot_len - offset;
+        }
+        memcpy(dst, view->data + offset, len);
+        return len;
+    }
+    return pbuf_copy_partial((const struct pbuf *)view->chain, dst, len, offset);
+}
+
+const uint8_t *udp_rx_view_linear(const udp_rx_view_t *view, uint8_t *scratch, size_t cap)
+{
+    if (view->len == view->tot_len) {
+        return view->data;
+    }
+    if (view->tot_len > cap) {
+        return NULL;
+    }
+    udp_rx_view_copy(view, scratch, view->tot_len, 0);
+    portENTER_CRITICAL(&s_stats_lock);
+    s_stats.linearized++;
+    portEXIT_CRITICAL(&s_stats_lock);
+    return scratch;
+}
+
+void udp_rx_get_stats(udp_rx_stats_t *out)
+{
+    portENTER_CRITICAL(&s_stats_lock);
+    *out = s_stats;
+    portEXIT_CRITICAL(&s_stats_lock);
+}
@@ -0,0 +1,70 @@
+#ifndef _UDP_RX_H_
+#define _UDP_RX_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+/* Receive backend:
+ * 1: lwIP netconn, handlers read the received pbuf in place
+ * 0: BSD sockets, every datagram is first copied into a static buffer */
+#ifndef UDP_RX_NETCONN
+#define UDP_RX_NETCONN       1
+#endif
+
+#define UDP_RX_MAX_PORTS     4
+#define UDP_RX_BUF_LEN       1472   // socket backend, largest datagram without IP fragmentation
+#define UDP_RX_BATCH         32     // per port per wake-up, so one busy port cannot starve the rest
+
+/* Read-only view of one received datagram, valid only during the handler
+ * call. data/len cover the first segment; tot_len is the datagram length,
+ * the rest (netconn backend only) continues in the pbuf chain. */
+typedef struct {
+    const uint8_t *data;
+    size_t len;
+    size_t tot_len;
+    const void *chain;          // struct pbuf *, NULL on the socket backend
+} udp_rx_view_t;
+
+typedef struct {
+    uint32_t addr;              // IPv4, network byte order
+    uint16_t port;
+    uint8_t local;              // index of the bound port it arrived on
+} udp_rx_peer_t;
+
+typedef void (*udp_rx_handler_t)(const udp_rx_view_t *view, const udp_rx_peer_t *from, void *arg);
+
+typedef struct {
+    uint32_t packets;
+    uint32_t bytes;
+    uint32_t wakeups;
+    uint32_t recv_errors;
+    int last_errno;
+    uint32_t batch_high_water;  // datagrams drained from one port in one wake-up
+    uint32_t mailbox_full;      // drains that reached the lwIP mailbox size, datagrams may have been dropped
+    uint32_t linearized;        // chained datagrams copied by udp_rx_view_linear()
+    uint64_t cycles;            // CPU cycles spent receiving and dispatching
+} udp_rx_stats_t;
+
+// Binds a port, call before udp_rx_start()
+esp_err_t udp_rx_add_port(uint16_t port, udp_rx_handler_t handler, void *arg);
+
+/* Starts the receive task. It sleeps until any bound port has data and,
+ * once woken, drains every port with non-blocking reads until empty. */
+esp_err_t udp_rx_start(void);
+
+// Sends from the bound port the datagram in from arrived on
+esp_err_t udp_rx_reply(const udp_rx_peer_t *to, const void *data, size_t len);
+
+// Copies up to len bytes starting at offset, returns the number copied
+size_t udp_rx_view_copy(const udp_rx_view_t *view, void *dst, size_t len, size_t offset);
+
+/* Returns the whole datagram as one contiguous buffer: the view itself
+ * when it is a single segment, else a copy in scratch (NULL if it does
+ * not fit). */
+const uint8_t *udp_rx_view_linear(const udp_rx_view_t *view, uint8_t *scratch, size_t cap);
+
+void udp_rx_get_stats(udp_rx_stats_t *out);
+
+#endif
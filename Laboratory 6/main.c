@@ -24,8 +24,10 @@
 #include "http-server.h"
 #include "driver/gpio.h"
 #include "../mdns/include/mdns.h"
+#include "../button/include/button_gpio.h"
 
 #define RESET_BUTTON GPIO_NUM_2
+#define RESET_HOLD_MS 5000
 
 #define DEFAULT_SCAN_LIST_SIZE 5
 #define NVS_COMPARE_KEY_PARAM "nvs"
@@ -204,27 +206,36 @@ esp_err_t nvs_wifi_connect(void)
     return ESP_ERR_INVALID_ARG;
 }
 
+static button_gpio_t reset_button;
+static TaskHandle_t reset_nvs_handle;
+
+static void reset_button_cb(button_t *btn, button_event_t event, void *arg)
+{
+    if (event == BUTTON_EVENT_LONG_PRESS) {
+        xTaskNotifyGive(reset_nvs_handle);
+    }
+}
+
 void reset_nvs_task(void *arg) {
+    button_config_t btn_conf = {
+        .active_level = 0,
+        .debounce_ms = 50,
+        .long_ms = RESET_HOLD_MS,
+    };
     gpio_reset_pin(RESET_BUTTON);
-    gpio_set_direction(RESET_BUTTON, GPIO_MODE_INPUT);
-    gpio_set_pull_mode(RESET_BUTTON, GPIO_PULLUP_ONLY);
-    while (1) {
-        if (gpio_get_level(RESET_BUTTON) == 0) {
-            vTaskDelay(pdMS_TO_TICKS(5000));
-            if (gpio_get_level(RESET_BUTTON) == 0) {
-                ESP_LOGI(TAG, "Resetting Wi-Fi credentials...");
-                nvs_handle_t nvs_handle;
-                if (nvs_open("storage", NVS_READWRITE, &nvs_handle) == ESP_OK) {
-                    nvs_erase_key(nvs_handle, "ssid");
-                    nvs_erase_key(nvs_handle, "pass");
-                    nvs_commit(nvs_handle);
-                    nvs_close(nvs_handle);
-                }
-                esp_restart();
-            }
-        }
-        vTaskDelay(pdMS_TO_TICKS(100));
+    button_gpio_init(&reset_button, RESET_BUTTON, &btn_conf, reset_button_cb, NULL);
+
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+    ESP_LOGI(TAG, "Resetting Wi-Fi credentials...");
+    nvs_handle_t nvs_handle;
+    if (nvs_open("storage", NVS_READWRITE, &nvs_handle) == ESP_OK) {
+        nvs_erase_key(nvs_handle, "ssid");
+        nvs_erase_key(nvs_handle, "pass");
+        nvs_commit(nvs_handle);
+        nvs_close(nvs_handle);
     }
+    esp_restart();
 }
 
 void app_main(void)
@@ -259,5 +270,5 @@ void app_main(void)
         wifi_init_softap();
         start_webserver();
     }
-    xTaskCreate(reset_nvs_task, "reset_nvs_task", 4096, NULL, 5, NULL);
+    xTaskCreate(reset_nvs_task, "reset_nvs_task", 4096, NULL, 5, &reset_nvs_handle);
 }
\ No newline at end of file
@@ -32,6 +32,9 @@
 #include "app_assert.h"
 #include "app.h"
 #include "app_log.h"
+#include "../dlog/include/dlog.h"
+
+static const char *TAG = "scanner";
 
 // The advertising set handle allocated from Bluetooth stack.
 static uint8_t advertising_set_handle = 0xff;
@@ -80,6 +83,9 @@ SL_WEAK void app_process_action(void)
     // Do not call blocking functions from here!                               //
     /////////////////////////////////////////////////////////////////////////////
   }
+
+  // advertisement reports only queue their log records, print a few per pass
+  dlog_flush(8);
 }
 
 /**************************************************************************//**
@@ -169,8 +175,7 @@ void sl_bt_on_event(sl_bt_msg_t *evt)
         if (ad_len == 26 && ad_type == 0xFF) {
           uint16_t c_id = *((uint16_t*) (p + 2));
           if (c_id == 0x004C && (!memcmp(p + 6, uuid, sizeof(uuid)/sizeof(uint8_t)))) {
-            app_log_hexdump_info(p + 2, 25);
-            app_log("\r\n");
+            DLOG_HEX(DLOG_INFO, TAG, "beacon:", p + 2, 25);
           }
         }
         
@@ -188,8 +193,8 @@ void sl_bt_on_event(sl_bt_msg_t *evt)
             discovered_devices[device_count].rssi = evt->data.evt_scanner_legacy_advertisement_report.rssi;
             device_count++;
             
-            app_log("Device found: %s, RSSI: %d\n", device_name, 
-                   evt->data.evt_scanner_legacy_advertisement_report.rssi);
+            DLOG_STR(DLOG_INFO, TAG, "Device found: %.*s, RSSI: %d", device_name, name_len,
+                     evt->data.evt_scanner_legacy_advertisement_report.rssi);
           }
         }
         
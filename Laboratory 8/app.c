@@ -36,16 +36,58 @@
 #include "em_gpio.h"
 #include "gatt_db.h"
 #include "app_log.h"
+#include "gpiointerrupt.h"
+#include "sl_sleeptimer.h"
+#include "../button/include/button.h"
+
+#define BUTTON_PORT gpioPortC
+#define BUTTON_PIN  7
 
 // Global variables for button state and connection handling
 static volatile uint8_t button_state = 0;
-static volatile uint8_t prev_button_state = 0;
 static uint8_t connection_handle = 0xFF;
 static bool button_io_notification_enabled = false;
 
 // The advertising set handle allocated from Bluetooth stack.
 static uint8_t advertising_set_handle = 0xff;
 
+// Debounce engine for the button, fed from the pin interrupt and one sleeptimer
+static button_t button;
+static sl_sleeptimer_timer_handle_t button_timer;
+
+static uint32_t button_now_ms(void)
+{
+  return sl_sleeptimer_tick_to_ms(sl_sleeptimer_get_tick_count());
+}
+
+static void button_timer_cb(sl_sleeptimer_timer_handle_t *handle, void *data)
+{
+  (void)handle;
+  (void)data;
+  uint32_t delay = button_update(&button, GPIO_PinInGet(BUTTON_PORT, BUTTON_PIN), button_now_ms());
+  if (delay != BUTTON_IDLE) {
+    sl_sleeptimer_restart_timer_ms(&button_timer, delay, button_timer_cb, NULL, 0, 0);
+  }
+}
+
+static void button_irq_cb(uint8_t int_no)
+{
+  (void)int_no;
+  button_edge(&button, button_now_ms());
+  sl_sleeptimer_restart_timer_ms(&button_timer, button.cfg.debounce_ms, button_timer_cb, NULL, 0, 0);
+}
+
+// Debounced press/release is forwarded to the Bluetooth stack
+static void button_event_cb(button_t *btn, button_event_t event, void *arg)
+{
+  (void)btn;
+  (void)arg;
+  if (event == BUTTON_EVENT_DOWN || event == BUTTON_EVENT_UP) {
+    button_state = (event == BUTTON_EVENT_DOWN);
+    sl_bt_external_signal(1);  // Signal the stack to handle button state change
+  }
+}
+
 /**************************************************************************//**
  * Application Init.
  *****************************************************************************/
@@ -65,16 +107,19 @@ SL_WEAK void app_init(void)
   // Configure GPIOC 07 as input (button)
   GPIO_PinModeSet(gpioPortC, 7, gpioModeInputPullFilter, 1);
   
-  // Configure interrupt for button on both edges
-  GPIO_ExtIntConfig(gpioPortC, 7, 7, true, true, true);
-  
-  // Enable GPIO interrupts
-  NVIC_ClearPendingIRQ(GPIO_ODD_IRQn);
-  NVIC_EnableIRQ(GPIO_ODD_IRQn);
-  
   // Initialize button state
-  button_state = !GPIO_PinInGet(gpioPortC, 7);
-  prev_button_state = button_state;
+  button_config_t button_conf = {
+    .active_level = 0,
+    .debounce_ms = 20,
+  };
+  button_init(&button, &button_conf, button_event_cb, NULL);
+  button_state = !GPIO_PinInGet(BUTTON_PORT, BUTTON_PIN);
+  button.pressed = button_state;
+
+  // Configure interrupt for button on both edges
+  GPIOINT_Init();
+  GPIOINT_CallbackRegister(BUTTON_PIN, button_irq_cb);
+  GPIO_ExtIntConfig(BUTTON_PORT, BUTTON_PIN, BUTTON_PIN, true, true, true);
 }
 
 /**************************************************************************//**
@@ -87,14 +132,8 @@ SL_WEAK void app_process_action(void)
   // This is called infinitely.                                              //
   // Do not call blocking functions from here!                               //
   /////////////////////////////////////////////////////////////////////////////
-  
-  // Check button state
-  uint8_t current_state = !GPIO_PinInGet(gpioPortC, 7);
-  if (current_state != prev_button_state) {
-    button_state = current_state;
-    prev_button_state = current_state;
-    sl_bt_external_signal(1);  // Signal the stack to handle button state change
-  }
+
+  // Button changes arrive through button_event_cb(), nothing to poll here
 }
 
 /**************************************************************************//**
@@ -0,0 +1,107 @@
+#include <string.h>
+#include "button.h"
+
+#define ELAPSED(now, since) ((uint32_t)((now) - (since)))
+
+static void emit(button_t *btn, button_event_t ev)
+{
+    if (btn->cb) {
+        btn->cb(btn, ev, btn->arg);
+    }
+}
+
+static uint32_t next_delay(uint32_t current, uint32_t candidate)
+{
+    if (!candidate) {
+        candidate = 1;
+    }
+    return (current == BUTTON_IDLE || candidate < current) ? candidate : current;
+}
+
+void button_init(button_t *btn, const button_config_t *cfg, button_cb_t cb, void *arg)
+{
+    memset(btn, 0, sizeof(*btn));
+    btn->cfg = *cfg;
+    btn->cb = cb;
+    btn->arg = arg;
+}
+
+void button_edge(button_t *btn, uint32_t now_ms)
+{
+    btn->edge_ms = now_ms;
+    btn->edge_pending = 1;
+}
+
+uint32_t button_update(button_t *btn, int level, uint32_t now_ms)
+{
+    const button_config_t *cfg = &btn->cfg;
+    uint32_t delay = BUTTON_IDLE;
+
+    // wait until the pin has been quiet for the whole debounce interval
+    if (btn->edge_pending) {
+        uint32_t quiet = ELAPSED(now_ms, btn->edge_ms);
+        if (quiet < cfg->debounce_ms) {
+            return next_delay(BUTTON_IDLE, cfg->debounce_ms - quiet);
+        }
+        btn->edge_pending = 0;
+    }
+
+    uint8_t pressed = (level == cfg->active_level);
+    if (pressed != btn->pressed) {
+        btn->pressed = pressed;
+        if (pressed) {
+            btn->press_ms = now_ms;
+            btn->long_fired = 0;
+            emit(btn, BUTTON_EVENT_DOWN);
+        } else {
+            emit(btn, BUTTON_EVENT_UP);
+            if (btn->long_fired) {
+                btn->clicks = 0;
+            } else if (++btn->clicks >= 2) {
+                btn->clicks = 0;
+                emit(btn, BUTTON_EVENT_DOUBLE_CLICK);
+            } else if (!cfg->double_ms) {
+                btn->clicks = 0;
+                emit(btn, BUTTON_EVENT_CLICK);
+            } else {
+                btn->release_ms = now_ms;
+            }
+        }
+    }
+
+    if (btn->pressed) {
+        if (cfg->long_ms && !btn->long_fired) {
+            uint32_t held = ELAPSED(now_ms, btn->press_ms);
+            if (held >= cfg->long_ms) {
+                // a click waiting for its double-click partner is reported first
+                if (btn->clicks) {
+                    btn->clicks = 0;
+                    emit(btn, BUTTON_EVENT_CLICK);
+                }
+                btn->long_fired = 1;
+                btn->repeat_ms = now_ms + cfg->repeat_ms;
+                emit(btn, BUTTON_EVENT_LONG_PRESS);
+            } else {
+                delay = next_delay(delay, cfg->long_ms - held);
+            }
+        }
+        if (btn->long_fired && cfg->repeat_ms) {
+            if ((int32_t)(now_ms - btn->repeat_ms) >= 0) {
+                btn->repeat_ms += cfg->repeat_ms;
+                emit(btn, BUTTON_EVENT_HOLD_REPEAT);
+            }
+            int32_t left = (int32_t)(btn->repeat_ms - now_ms);
+            delay = next_delay(delay, left > 0 ? (uint32_t)left : 1);
+        }
+    } else if (btn->clicks) {
+        uint32_t since = ELAPSED(now_ms, btn->release_ms);
+        if (since >= cfg->double_ms) {
+            btn->clicks = 0;
+            emit(btn, BUTTON_EVENT_CLICK);
+        } else {
+            delay = next_delay(delay, cfg->double_ms - since);
+        }
+    }
+
+    return delay;
+}
@@ -0,0 +1,74 @@
+#include "freertos/FreeRTOS.h"
+#include "driver/gpio.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+
+#include "button_gpio.h"
+
+static const char *TAG = "button";
+
+static uint32_t now_ms(void)
+{
+    return (uint32_t)(esp_timer_get_time() / 1000);
+}
+
+static void button_gpio_isr(void *arg)
+{
+    button_gpio_t *bg = (button_gpio_t *)arg;
+
+    // every bounce pushes the settle timer out again
+    button_edge(&bg->btn, now_ms());
+    esp_timer_stop(bg->timer);
+    esp_timer_start_once(bg->timer, (uint64_t)bg->btn.cfg.debounce_ms * 1000);
+}
+
+static void button_gpio_timer(void *arg)
+{
+    button_gpio_t *bg = (button_gpio_t *)arg;
+
+    uint32_t delay = button_update(&bg->btn, gpio_get_level(bg->pin), now_ms());
+    if (delay != BUTTON_IDLE) {
+        // fails harmlessly if an edge re-armed the timer in the meantime
+        esp_timer_start_once(bg->timer, (uint64_t)delay * 1000);
+    }
+}
+
+esp_err_t button_gpio_init(button_gpio_t *bg, gpio_num_t pin, const button_config_t *cfg,
+                           button_cb_t cb, void *arg)
+{
+    button_init(&bg->btn, cfg, cb, arg);
+    bg->pin = pin;
+
+    gpio_config_t io_conf = {};
+    io_conf.intr_type = GPIO_INTR_ANYEDGE;
+    io_conf.mode = GPIO_MODE_INPUT;
+    io_conf.pin_bit_mask = 1ULL << pin;
+    io_conf.pull_up_en = cfg->active_level == 0;
+    io_conf.pull_down_en = cfg->active_level != 0;
+    esp_err_t err = gpio_config(&io_conf);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    esp_timer_create_args_t args = {
+        .callback = button_gpio_timer,
+        .arg = bg,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "button",
+    };
+    err = esp_timer_create(&args, &bg->timer);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    // the ISR service may already be installed by the application
+    err = gpio_install_isr_service(0);
+    if (err != ESP_OK && err != ESP_ERR_INVALID_STATE) {
+        ESP_LOGE(TAG, "gpio_install_isr_service failed: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    // pick up a button that is already held at boot
+    esp_timer_start_once(bg->timer, (uint64_t)cfg->debounce_ms * 1000);
+    return gpio_isr_handler_add(pin, button_gpio_isr, bg);
+}
@@ -0,0 +1,312 @@
+/* Host tests for the button engine, driven by synthetic bounce traces.
+ *
+ * A trace is a list of raw pin transitions. The simulator steps through it
+ * a millisecond at a time and does what button_gpio.c does on the target:
+ * every raw edge calls button_edge() and re-arms the one-shot timer for
+ * debounce_ms, and when the timer fires button_update() gets the raw
+ * level and returns the next delay. The events the engine emits, with
+ * their times, are checked against what the gesture should produce. */
+#include <stdio.h>
+#include <string.h>
+
+#include "button.h"
+
+#define MAX_EDGES 256
+#define MAX_EVENTS 64
+
+// Active low with a pull-up, like the boot button on most boards
+#define RELEASED 1
+#define PRESSED 0
+
+static const button_config_t cfg = {
+    .active_level = PRESSED,
+    .debounce_ms = 20,
+    .double_ms = 250,
+    .long_ms = 1000,
+    .repeat_ms = 200,
+};
+
+typedef struct {
+    uint32_t t;
+    int level;
+} raw_edge_t;
+
+typedef struct {
+    raw_edge_t edges[MAX_EDGES];
+    int n;
+} trace_t;
+
+typedef struct {
+    button_event_t ev;
+    uint32_t t;
+} event_t;
+
+static event_t events[MAX_EVENTS];
+static int n_events;
+static uint32_t sim_now;
+static int failures;
+
+static const char *names[] = {
+    [BUTTON_EVENT_DOWN] = "DOWN",
+    [BUTTON_EVENT_UP] = "UP",
+    [BUTTON_EVENT_CLICK] = "CLICK",
+    [BUTTON_EVENT_DOUBLE_CLICK] = "DOUBLE_CLICK",
+    [BUTTON_EVENT_LONG_PRESS] = "LONG_PRESS",
+    [BUTTON_EVENT_HOLD_REPEAT] = "HOLD_REPEAT",
+};
+
+static void on_event(button_t *btn, button_event_t ev, void *arg)
+{
+    (void)btn;
+    (void)arg;
+    if (n_events < MAX_EVENTS) {
+        events[n_events].ev = ev;
+        events[n_events].t = sim_now;
+        n_events++;
+    }
+}
+
+static void raw(trace_t *tr, uint32_t t, int level)
+{
+    tr->edges[tr->n].t = t;
+    tr->edges[tr->n].level = level;
+    tr->n++;
+}
+
+/* The contact bounces bounces times, a millisecond each, before settling
+ * at level at t + 2 * bounces. */
+static void bouncy(trace_t *tr, uint32_t t, int level, int bounces)
+{
+    for (int i = 0; i < bounces; i++) {
+        raw(tr, t++, level);
+        raw(tr, t++, !level);
+    }
+    raw(tr, t, level);
+}
+
+// A press held for held_ms, starting and ending with bounces
+static void press(trace_t *tr, uint32_t t, uint32_t held_ms, int bounces)
+{
+    bouncy(tr, t, PRESSED, bounces);
+    bouncy(tr, t + held_ms, RELEASED, bounces);
+}
+
+// Plays the trace until end_ms, the events land in events[]
+static void run(const button_config_t *c, const trace_t *tr, uint32_t end_ms)
+{
+    button_t btn;
+    int level = RELEASED;
+    int next = 0;
+    uint32_t timer_due;
+    int armed;
+
+    button_init(&btn, c, on_event, NULL);
+    n_events = 0;
+    // button_gpio_init() arms the timer once to pick up a button held at boot
+    timer_due = c->debounce_ms;
+    armed = 1;
+
+    for (sim_now = 0; sim_now <= end_ms; sim_now++) {
+        while (next < tr->n && tr->edges[next].t == sim_now) {
+            if (tr->edges[next].level != level) {
+                level = tr->edges[next].level;
+                button_edge(&btn, sim_now);
+                timer_due = sim_now + c->debounce_ms;
+                armed = 1;
+            }
+            next++;
+        }
+        if (armed && timer_due == sim_now) {
+            armed = 0;
+            uint32_t delay = button_update(&btn, level, sim_now);
+            if (delay != BUTTON_IDLE) {
+                timer_due = sim_now + delay;
+                armed = 1;
+            }
+        }
+    }
+}
+
+static void expect(const char *test, const button_event_t *want, int n)
+{
+    int ok = n_events == n;
+    for (int i = 0; ok && i < n; i++) {
+        ok = events[i].ev == want[i];
+    }
+    if (ok) {
+        return;
+    }
+    failures++;
+    fprintf(stderr, "%s: expected", test);
+    for (int i = 0; i < n; i++) {
+        fprintf(stderr, " %s", names[want[i]]);
+    }
+    fprintf(stderr, "\n%s: got     ", test);
+    for (int i = 0; i < n_events; i++) {
+        fprintf(stderr, " %s@%u", names[events[i].ev], (unsigned)events[i].t);
+    }
+    fprintf(stderr, "\n");
+}
+
+static void expect_at(const char *test, int i, uint32_t t)
+{
+    if (i >= n_events || events[i].t != t) {
+        failures++;
+        fprintf(stderr, "%s: event %d at %u, expected at %u\n", test, i,
+                i < n_events ? (unsigned)events[i].t : 0, (unsigned)t);
+    }
+}
+
+static void test_short_press(void)
+{
+    trace_t tr = { 0 };
+    press(&tr, 100, 120, 4);
+    run(&cfg, &tr, 1000);
+
+    const button_event_t want[] = { BUTTON_EVENT_DOWN, BUTTON_EVENT_UP, BUTTON_EVENT_CLICK };
+    expect("short press", want, 3);
+    // settled at 108 and 228, debounced 20 ms later, CLICK once double_ms has passed
+    expect_at("short press", 0, 128);
+    expect_at("short press", 1, 248);
+    expect_at("short press", 2, 248 + cfg.double_ms);
+}
+
+static void test_click_without_double(void)
+{
+    button_config_t c = cfg;
+    c.double_ms = 0;
+    trace_t tr = { 0 };
+    press(&tr, 100, 120, 4);
+    press(&tr, 300, 120, 4);
+    run(&c, &tr, 1000);
+
+    const button_event_t want[] = {
+        BUTTON_EVENT_DOWN, BUTTON_EVENT_UP, BUTTON_EVENT_CLICK,
+        BUTTON_EVENT_DOWN, BUTTON_EVENT_UP, BUTTON_EVENT_CLICK,
+    };
+    expect("double_ms 0", want, 6);
+    expect_at("double_ms 0", 2, 248);
+}
+
+static void test_long_press(void)
+{
+    button_config_t c = cfg;
+    c.repeat_ms = 0;
+    trace_t tr = { 0 };
+    press(&tr, 100, 1500, 3);
+    run(&c, &tr, 3000);
+
+    const button_event_t want[] = { BUTTON_EVENT_DOWN, BUTTON_EVENT_LONG_PRESS, BUTTON_EVENT_UP };
+    expect("long press", want, 3);
+    expect_at("long press", 1, 126 + c.long_ms);
+}
+
+static void test_double_click(void)
+{
+    trace_t tr = { 0 };
+    press(&tr, 100, 80, 3);
+    press(&tr, 300, 80, 3);
+    run(&cfg, &tr, 1500);
+
+    const button_event_t want[] = {
+        BUTTON_EVENT_DOWN, BUTTON_EVENT_UP, BUTTON_EVENT_DOWN, BUTTON_EVENT_UP,
+        BUTTON_EVENT_DOUBLE_CLICK,
+    };
+    expect("double click", want, 5);
+    expect_at("double click", 4, 406);
+}
+
+// Second press comes too late: two single clicks
+static void test_slow_second_click(void)
+{
+    trace_t tr = { 0 };
+    press(&tr, 100, 80, 3);
+    press(&tr, 600, 80, 3);
+    run(&cfg, &tr, 1500);
+
+    const button_event_t want[] = {
+        BUTTON_EVENT_DOWN, BUTTON_EVENT_UP, BUTTON_EVENT_CLICK,
+        BUTTON_EVENT_DOWN, BUTTON_EVENT_UP, BUTTON_EVENT_CLICK,
+    };
+    expect("slow second click", want, 6);
+}
+
+// A click, then a press held long: the click is reported before LONG_PRESS
+static void test_click_then_hold(void)
+{
+    button_config_t c = cfg;
+    c.repeat_ms = 0;
+    trace_t tr = { 0 };
+    press(&tr, 100, 80, 3);
+    press(&tr, 300, 1200, 3);
+    run(&c, &tr, 2500);
+
+    const button_event_t want[] = {
+        BUTTON_EVENT_DOWN, BUTTON_EVENT_UP, BUTTON_EVENT_DOWN, BUTTON_EVENT_CLICK,
+        BUTTON_EVENT_LONG_PRESS, BUTTON_EVENT_UP,
+    };
+    expect("click then hold", want, 6);
+}
+
+static void test_hold_repeat(void)
+{
+    trace_t tr = { 0 };
+    press(&tr, 100, 2050, 3);
+    run(&cfg, &tr, 3000);
+
+    // LONG_PRESS at 1126, repeats every 200 ms until the release settles at 2176
+    const button_event_t want[] = {
+        BUTTON_EVENT_DOWN, BUTTON_EVENT_LONG_PRESS,
+        BUTTON_EVENT_HOLD_REPEAT, BUTTON_EVENT_HOLD_REPEAT, BUTTON_EVENT_HOLD_REPEAT,
+        BUTTON_EVENT_HOLD_REPEAT, BUTTON_EVENT_HOLD_REPEAT, BUTTON_EVENT_UP,
+    };
+    expect("hold repeat", want, 8);
+    expect_at("hold repeat", 1, 1126);
+    for (int i = 2; i < 7; i++) {
+        expect_at("hold repeat", i, 1126 + (uint32_t)(i - 1) * cfg.repeat_ms);
+    }
+}
+
+static void test_bounce_rejection(void)
+{
+    trace_t tr = { 0 };
+    // glitches that never stay low for the debounce interval
+    bouncy(&tr, 100, PRESSED, 6);
+    raw(&tr, 113, RELEASED);
+    raw(&tr, 300, PRESSED);
+    raw(&tr, 315, RELEASED);
+    // a press that chatters for 30 ms: one DOWN, one UP
+    press(&tr, 500, 200, 15);
+    run(&cfg, &tr, 1500);
+
+    const button_event_t want[] = { BUTTON_EVENT_DOWN, BUTTON_EVENT_UP, BUTTON_EVENT_CLICK };
+    expect("bounce rejection", want, 3);
+    expect_at("bounce rejection", 0, 550);
+}
+
+// Held through boot: picked up by the first timer run without any edge
+static void test_held_at_boot(void)
+{
+    trace_t tr = { 0 };
+    raw(&tr, 0, PRESSED);
+    bouncy(&tr, 400, RELEASED, 2);
+    run(&cfg, &tr, 1000);
+
+    const button_event_t want[] = { BUTTON_EVENT_DOWN, BUTTON_EVENT_UP, BUTTON_EVENT_CLICK };
+    expect("held at boot", want, 3);
+}
+
+int main(void)
+{
+    test_short_press();
+    test_click_without_double();
+    test_long_press();
+    test_double_click();
+    test_slow_second_click();
+    test_click_then_hold();
+    test_hold_repeat();
+    test_bounce_rejection();
+    test_held_at_boot();
+    printf("button: %s\n", failures ? "FAIL" : "ok");
+    return failures ? 1 : 0;
+}
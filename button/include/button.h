@@ -0,0 +1,57 @@
+#ifndef _BUTTON_H_
+#define _BUTTON_H_
+
+#include <stdint.h>
+
+/* Portable debounce and gesture engine. The platform port calls
+ * button_edge() from the pin interrupt and button_update() from a single
+ * one-shot timer; button_update() returns how long to arm that timer for,
+ * or BUTTON_IDLE when nothing is pending, so an idle button costs no CPU. */
+
+#define BUTTON_IDLE 0
+
+typedef enum {
+    BUTTON_EVENT_DOWN,          // debounced press
+    BUTTON_EVENT_UP,            // debounced release
+    BUTTON_EVENT_CLICK,         // short press with no second press within double_ms
+    BUTTON_EVENT_DOUBLE_CLICK,
+    BUTTON_EVENT_LONG_PRESS,    // held for long_ms
+    BUTTON_EVENT_HOLD_REPEAT,   // every repeat_ms while still held after LONG_PRESS
+} button_event_t;
+
+typedef struct {
+    uint8_t active_level;       // pin level that means "pressed"
+    uint16_t debounce_ms;
+    uint16_t double_ms;         // 0 = report CLICK on release, no double clicks
+    uint16_t long_ms;           // 0 = no long press
+    uint16_t repeat_ms;         // 0 = no hold repeat
+} button_config_t;
+
+typedef struct button button_t;
+typedef void (*button_cb_t)(button_t *btn, button_event_t event, void *arg);
+
+struct button {
+    button_config_t cfg;
+    button_cb_t cb;
+    void *arg;
+
+    volatile uint32_t edge_ms;
+    volatile uint8_t edge_pending;
+
+    uint8_t pressed;            // debounced state
+    uint8_t long_fired;
+    uint8_t clicks;
+    uint32_t press_ms;
+    uint32_t release_ms;
+    uint32_t repeat_ms;         // time of the next HOLD_REPEAT
+};
+
+void button_init(button_t *btn, const button_config_t *cfg, button_cb_t cb, void *arg);
+
+// Interrupt context: a raw edge was seen, arm the timer for cfg.debounce_ms
+void button_edge(button_t *btn, uint32_t now_ms);
+
+// Timer context: feed the current raw level, returns the next timer delay in ms
+uint32_t button_update(button_t *btn, int level, uint32_t now_ms);
+
+#endif
@@ -0,0 +1,22 @@
+#ifndef _BUTTON_GPIO_H_
+#define _BUTTON_GPIO_H_
+
+#include "driver/gpio.h"
+#include "esp_timer.h"
+#include "esp_err.h"
+
+#include "button.h"
+
+/* ESP-IDF port of the button engine: an any-edge GPIO interrupt plus one
+ * esp_timer one-shot per button. Callbacks run in the esp_timer task. */
+typedef struct {
+    button_t btn;
+    gpio_num_t pin;
+    esp_timer_handle_t timer;
+} button_gpio_t;
+
+// Configures the pin as an input with a pull towards the released level
+esp_err_t button_gpio_init(button_gpio_t *bg, gpio_num_t pin, const button_config_t *cfg,
+                           button_cb_t cb, void *arg);
+
+#endif
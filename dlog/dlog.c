@@ -0,0 +1,270 @@
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include "dlog.h"
+
+#if defined(ESP_PLATFORM)
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_attr.h"
+#include "esp_timer.h"
+#define DLOG_CORES          portNUM_PROCESSORS
+#define dlog_core()         xPortGetCoreID()
+// one clock for both cores, unlike the per-core cycle counters; in IRAM
+#define dlog_now()          ((uint32_t)esp_timer_get_time())
+#define DLOG_IRAM           IRAM_ATTR
+#else
+#include "sl_sleeptimer.h"
+#define DLOG_CORES          1
+#define dlog_core()         0
+#define dlog_now()          sl_sleeptimer_get_tick_count()
+#define DLOG_IRAM
+#endif
+
+// per core, a power of two
+#ifndef DLOG_RING_CELLS
+#define DLOG_RING_CELLS     (DLOG_CORES > 1 ? 256 : 64)
+#endif
+#define DLOG_MASK           (DLOG_RING_CELLS - 1)
+#define DLOG_CELL_WORDS     7
+#define DLOG_CELL_BYTES     (DLOG_CELL_WORDS * 4)
+#define DLOG_MAX_CELLS      (1 + DLOG_MAX_BLOB / DLOG_CELL_BYTES)
+#define DLOG_RENDER_PERIOD_MS 20
+
+#define DLOG_FRAME_MARKER   0xD1
+
+/* Bounded multi-producer queue after Vyukov, one consumer. Each cell
+ * carries a sequence number: free for position pos when it equals pos,
+ * holding the record of pos when it equals pos + 1. Values are stored
+ * minus the cell index so that a zeroed ring is already initialised and
+ * logging works from the first instruction, ISRs included. */
+typedef struct {
+    uint32_t seq;
+    uint32_t w[DLOG_CELL_WORDS];    // head cell: site, timestamp, info, arguments; then blob bytes
+} dlog_cell_t;
+
+typedef struct {
+    dlog_cell_t cells[DLOG_RING_CELLS];
+    uint32_t head;                  // next position to reserve, producers
+    uint32_t tail;                  // next position to render, consumer
+    uint32_t written;
+    uint32_t dropped;
+    uint32_t high_water;
+} dlog_ring_t;
+
+#define FREE_SEQ(pos)       ((pos) - ((pos) & DLOG_MASK))
+#define READY_SEQ(pos)      ((pos) + 1 - ((pos) & DLOG_MASK))
+#define INFO(nargs, ncells, blob_len) ((nargs) | (ncells) << 4 | (blob_len) << 8)
+#define INFO_NARGS(info)    ((info) & 0xF)
+#define INFO_NCELLS(info)   (((info) >> 4) & 0xF)
+#define INFO_BLOB_LEN(info) ((info) >> 8)
+
+static dlog_ring_t s_rings[DLOG_CORES];
+static uint32_t s_reported_drops;
+
+// in IRAM: callable from ISRs that run while the flash cache is off
+void DLOG_IRAM dlog_write(const dlog_site_t *site, const void *blob, size_t blob_len, int nargs, ...)
+{
+    uint32_t ts = dlog_now();
+    dlog_ring_t *r = &s_rings[dlog_core()];
+
+    if (blob_len > DLOG_MAX_BLOB) {
+        blob_len = DLOG_MAX_BLOB;
+    }
+    uint32_t ncells = 1 + (blob_len + DLOG_CELL_BYTES - 1) / DLOG_CELL_BYTES;
+
+    // reserve ncells consecutive positions; the consumer frees cells in
+    // order, so when the last one is free all of them are
+    uint32_t pos = __atomic_load_n(&r->head, __ATOMIC_RELAXED);
+    while (1) {
+        uint32_t last = pos + ncells - 1;
+        uint32_t seq = __atomic_load_n(&r->cells[last & DLOG_MASK].seq, __ATOMIC_ACQUIRE);
+        int32_t dif = (int32_t)(seq - FREE_SEQ(last));
+        if (dif == 0) {
+            if (__atomic_compare_exchange_n(&r->head, &pos, pos + ncells, true,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                break;
+            }
+        } else if (dif < 0) {
+            __atomic_fetch_add(&r->dropped, 1, __ATOMIC_RELAXED);
+            return;
+        } else {
+            pos = __atomic_load_n(&r->head, __ATOMIC_RELAXED);
+        }
+    }
+
+    dlog_cell_t *c = &r->cells[pos & DLOG_MASK];
+    c->w[0] = (uint32_t)(uintptr_t)site;
+    c->w[1] = ts;
+    c->w[2] = INFO(nargs, ncells, blob_len);
+    va_list ap;
+    va_start(ap, nargs);
+    for (int i = 0; i < nargs; i++) {
+        c->w[3 + i] = va_arg(ap, uint32_t);
+    }
+    va_end(ap);
+
+    for (uint32_t k = 1; k < ncells; k++) {
+        size_t off = (k - 1) * DLOG_CELL_BYTES;
+        size_t n = blob_len - off < DLOG_CELL_BYTES ? blob_len - off : DLOG_CELL_BYTES;
+        memcpy(r->cells[(pos + k) & DLOG_MASK].w, (const uint8_t *)blob + off, n);
+    }
+    for (uint32_t k = 0; k < ncells; k++) {
+        __atomic_store_n(&r->cells[(pos + k) & DLOG_MASK].seq, READY_SEQ(pos + k), __ATOMIC_RELEASE);
+    }
+
+    __atomic_fetch_add(&r->written, 1, __ATOMIC_RELAXED);
+    uint32_t used = pos + ncells - __atomic_load_n(&r->tail, __ATOMIC_RELAXED);
+    if (used > r->high_water) {
+        r->high_water = used;
+    }
+}
+
+// Copies out the oldest record if all its cells are published, returns its cell count
+static uint32_t take(dlog_ring_t *r, uint32_t *w, uint8_t *blob)
+{
+    uint32_t pos = r->tail;
+    dlog_cell_t *c = &r->cells[pos & DLOG_MASK];
+    if (__atomic_load_n(&c->seq, __ATOMIC_ACQUIRE) != READY_SEQ(pos)) {
+        return 0;
+    }
+    memcpy(w, c->w, sizeof(c->w));
+    uint32_t ncells = INFO_NCELLS(w[2]);
+    for (uint32_t k = 1; k < ncells; k++) {
+        // a producer preempted halfway through, try again next time
+        if (__atomic_load_n(&r->cells[(pos + k) & DLOG_MASK].seq, __ATOMIC_ACQUIRE) != READY_SEQ(pos + k)) {
+            return 0;
+        }
+    }
+    for (uint32_t k = 1; k < ncells; k++) {
+        memcpy(blob + (k - 1) * DLOG_CELL_BYTES, r->cells[(pos + k) & DLOG_MASK].w, DLOG_CELL_BYTES);
+    }
+    for (uint32_t k = 0; k < ncells; k++) {
+        __atomic_store_n(&r->cells[(pos + k) & DLOG_MASK].seq, FREE_SEQ(pos + k + DLOG_RING_CELLS), __ATOMIC_RELEASE);
+    }
+    __atomic_store_n(&r->tail, pos + ncells, __ATOMIC_RELAXED);
+    return ncells;
+}
+
+#if DLOG_OUTPUT_BINARY
+
+/* marker, core, nargs, blob length, site u32, timestamp u32, nargs x u32,
+ * blob; little-endian, decoded by dlog_decode.py with the firmware ELF */
+static void render(int core, const uint32_t *w, const uint8_t *blob)
+{
+    uint8_t frame[12 + DLOG_MAX_ARGS * 4 + DLOG_MAX_BLOB];
+    uint32_t nargs = INFO_NARGS(w[2]);
+    uint32_t blob_len = INFO_BLOB_LEN(w[2]);
+
+    frame[0] = DLOG_FRAME_MARKER;
+    frame[1] = core;
+    frame[2] = nargs;
+    frame[3] = blob_len;
+    memcpy(frame + 4, &w[0], 8);
+    memcpy(frame + 12, &w[3], nargs * 4);
+    memcpy(frame + 12 + nargs * 4, blob, blob_len);
+    fwrite(frame, 1, 12 + nargs * 4 + blob_len, stdout);
+}
+
+#else
+
+static uint32_t timestamp_ms(uint32_t ts)
+{
+#if defined(ESP_PLATFORM)
+    // the 32-bit microsecond stamp wraps every 71 minutes, go by the age of the record
+    int64_t now = esp_timer_get_time();
+    uint32_t age = (uint32_t)now - ts;
+    return (uint32_t)((now - age) / 1000);
+#else
+    return sl_sleeptimer_tick_to_ms(ts);
+#endif
+}
+
+static void render(int core, const uint32_t *w, const uint8_t *blob)
+{
+    const dlog_site_t *site = (const dlog_site_t *)(uintptr_t)w[0];
+    uint32_t a[DLOG_MAX_ARGS] = { 0 };
+    uint32_t blob_len = INFO_BLOB_LEN(w[2]);
+
+    memcpy(a, &w[3], INFO_NARGS(w[2]) * 4);
+    printf("%c (%lu) %s: ", "NEWID"[site->level], (unsigned long)timestamp_ms(w[1]), *site->tag);
+    if (site->flags & DLOG_FLAG_STR) {
+        printf(site->fmt, (int)blob_len, blob, a[0], a[1], a[2], a[3]);
+    } else {
+        printf(site->fmt, a[0], a[1], a[2], a[3]);
+    }
+    if (site->flags & DLOG_FLAG_HEX) {
+        for (uint32_t i = 0; i < blob_len; i++) {
+            printf(" %02x", blob[i]);
+        }
+    }
+    putchar('\n');
+}
+
+#endif
+
+size_t dlog_flush(size_t max)
+{
+    static uint32_t w[DLOG_CELL_WORDS];
+    static uint8_t blob[DLOG_MAX_BLOB];
+    size_t n = 0;
+    bool more = true;
+
+    // round robin over the cores, a record at a time
+    while (more && n < max) {
+        more = false;
+        for (int core = 0; core < DLOG_CORES && n < max; core++) {
+            if (take(&s_rings[core], w, blob)) {
+                render(core, w, blob);
+                n++;
+                more = true;
+            }
+        }
+    }
+
+    dlog_stats_t st;
+    dlog_get_stats(&st);
+    if (st.dropped != s_reported_drops) {
+        printf("W dlog: %lu records dropped\n", (unsigned long)(st.dropped - s_reported_drops));
+        s_reported_drops = st.dropped;
+    }
+    if (n) {
+        fflush(stdout);
+    }
+    return n;
+}
+
+#if defined(ESP_PLATFORM)
+
+static void dlog_task(void *arg)
+{
+    while (1) {
+        size_t n = dlog_flush(32);
+        // a tick between batches keeps a flood from starving the idle task
+        vTaskDelay(n ? 1 : pdMS_TO_TICKS(DLOG_RENDER_PERIOD_MS));
+    }
+}
+
+bool dlog_start(void)
+{
+    return xTaskCreate(dlog_task, "dlog", 3072, NULL, 1, NULL) == pdPASS;
+}
+
+#else
+
+bool dlog_start(void)
+{
+    return true;
+}
+
+#endif
+
+void dlog_get_stats(dlog_stats_t *out)
+{
+    memset(out, 0, sizeof(*out));
+    for (int core = 0; core < DLOG_CORES; core++) {
+        out->written += __atomic_load_n(&s_rings[core].written, __ATOMIC_RELAXED);
+        out->dropped += __atomic_load_n(&s_rings[core].dropped, __ATOMIC_RELAXED);
+        out->high_water += s_rings[core].high_water;
+    }
+}
@@ -0,0 +1,203 @@
+"""Expands the binary records of dlog (firmware built with DLOG_OUTPUT_BINARY=1).
+
+Records carry only the address of their call site descriptor and raw
+32-bit arguments; the format strings and tags are read back from the
+firmware ELF. Anything between records (boot messages, ESP_LOG output) is
+passed through unchanged.
+
+  python dlog_decode.py .pio/build/esp-wrover-kit/firmware.elf --port COM3
+  python dlog_decode.py firmware.elf --clock-hz 32768 < capture.bin
+
+Needs pyelftools, and pyserial for --port.
+"""
+import argparse
+import re
+import struct
+import sys
+
+from elftools.elf.constants import SH_FLAGS
+from elftools.elf.elffile import ELFFile
+
+MARKER = 0xD1
+HEADER = struct.Struct("<BBBBII")    # marker, core, nargs, blob length, site, timestamp
+MAX_ARGS = 4
+MAX_BLOB = 84
+FLAG_HEX = 1
+FLAG_STR = 2
+LEVELS = "NEWID"
+
+CONVERSION = re.compile(r"%(?P<flags>[-+ #0]*)(?P<width>\*|\d+)?(?:\.(?P<prec>\*|\d+))?"
+                        r"(?:hh|h|ll|l|z|j|t)?(?P<conv>[diouxXcsp%])")
+
+
+class Image:
+    """Read-only view of the loadable sections of the firmware"""
+
+    def __init__(self, path):
+        self.sections = []
+        with open(path, "rb") as f:
+            elf = ELFFile(f)
+            for s in elf.iter_sections():
+                if s["sh_flags"] & SH_FLAGS.SHF_ALLOC and s["sh_type"] != "SHT_NOBITS" and s["sh_size"]:
+                    self.sections.append((s["sh_addr"], s.data()))
+        self.sites = {}
+
+    def read(self, addr, n):
+        for base, data in self.sections:
+            if base <= addr and addr + n <= base + len(data):
+                return data[addr - base:addr - base + n]
+        return None
+
+    def u32(self, addr):
+        b = self.read(addr, 4)
+        return None if b is None else struct.unpack("<I", b)[0]
+
+    def cstr(self, addr):
+        for base, data in self.sections:
+            if base <= addr < base + len(data):
+                end = data.find(b"\0", addr - base)
+                return data[addr - base:end if end >= 0 else len(data)].decode("utf-8", "replace")
+        return None
+
+    def site(self, addr):
+        """(level, flags, tag, fmt) of a dlog_site_t, None if addr is not one"""
+        if addr not in self.sites:
+            raw = self.read(addr, 12)
+            site = None
+            if raw is not None:
+                level, flags, tag_ptr, fmt_ptr = struct.unpack("<BBxxII", raw)
+                tag_addr = self.u32(tag_ptr)
+                fmt = self.cstr(fmt_ptr)
+                if 1 <= level < len(LEVELS) and flags <= FLAG_HEX | FLAG_STR and fmt is not None:
+                    tag = self.cstr(tag_addr) if tag_addr is not None else None
+                    site = (level, flags, tag or "?", fmt)
+            self.sites[addr] = site
+        return self.sites[addr]
+
+
+def render(image, fmt, args, blob, flags):
+    args = list(args)
+    if flags & FLAG_STR:
+        args = [len(blob), blob] + args
+
+    def take():
+        return args.pop(0) if args else 0
+
+    def expand(m):
+        conv = m.group("conv")
+        if conv == "%":
+            return "%"
+        width, prec = m.group("width"), m.group("prec")
+        if width == "*":
+            width = str(take())
+        if prec == "*":
+            prec = str(take())
+        spec = "%" + m.group("flags") + (width or "") + ("." + prec if prec is not None else "")
+        value = take()
+        if conv == "s":
+            if isinstance(value, bytes):
+                value = value.decode("utf-8", "replace")
+            else:
+                value = image.cstr(value) or "<0x%08x>" % value
+            return (spec + "s") % value
+        if conv == "p":
+            return (spec + "s") % ("0x%08x" % value)
+        if conv == "c":
+            return (spec + "c") % chr(value & 0xFF)
+        if conv in "di":
+            value = value - (1 << 32) if value & 0x80000000 else value
+            return (spec + "d") % value
+        return (spec + ("d" if conv == "u" else conv)) % value
+
+    return CONVERSION.sub(expand, fmt)
+
+
+class Decoder:
+    def __init__(self, image, clock_hz, out):
+        self.image = image
+        self.clock_hz = clock_hz
+        self.out = out
+        self.buf = bytearray()
+        self.last_ts = {}
+        self.wraps = {}
+
+    def _time_ms(self, core, ts):
+        # 32-bit timestamps, in order within each core's records
+        if ts < self.last_ts.get(core, 0):
+            self.wraps[core] = self.wraps.get(core, 0) + 1
+        self.last_ts[core] = ts
+        return ((self.wraps.get(core, 0) << 32) + ts) * 1000.0 / self.clock_hz
+
+    def _frame(self):
+        """Decodes the record at the start of buf, returns its length, 0 if incomplete, -1 if not a record"""
+        if len(self.buf) < HEADER.size:
+            return 0
+        _, core, nargs, blob_len, site_addr, ts = HEADER.unpack_from(self.buf)
+        if nargs > MAX_ARGS or blob_len > MAX_BLOB:
+            return -1
+        site = self.image.site(site_addr)
+        if site is None:
+            return -1
+        size = HEADER.size + nargs * 4 + blob_len
+        if len(self.buf) < size:
+            return 0
+        args = struct.unpack_from("<%dI" % nargs, self.buf, HEADER.size)
+        blob = bytes(self.buf[HEADER.size + nargs * 4:size])
+        level, flags, tag, fmt = site
+        text = render(self.image, fmt, args, blob, flags)
+        if flags & FLAG_HEX:
+            text += "".join(" %02x" % b for b in blob)
+        self.out.write("%c (%.3f) %s: %s [%d]\n" % (LEVELS[level], self._time_ms(core, ts), tag, text, core))
+        return size
+
+    def feed(self, data):
+        self.buf += data
+        while self.buf:
+            start = self.buf.find(MARKER)
+            if start < 0:
+                self.out.write(self.buf.decode("utf-8", "replace"))
+                self.buf.clear()
+                break
+            if start:
+                self.out.write(self.buf[:start].decode("utf-8", "replace"))
+                del self.buf[:start]
+            n = self._frame()
+            if n == 0:
+                break
+            if n < 0:
+                # a stray marker byte in plain output
+                self.out.write(self.buf[:1].decode("latin-1"))
+                del self.buf[:1]
+            else:
+                del self.buf[:n]
+        self.out.flush()
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("elf", help="firmware ELF the log was produced by")
+    parser.add_argument("--port", help="serial port, default reads stdin")
+    parser.add_argument("--baud", type=int, default=115200)
+    parser.add_argument("--clock-hz", type=float, default=1e6,
+                        help="timestamp clock: 1 MHz (esp_timer) on ESP32, 32768 for the sleeptimer on EFR32")
+    args = parser.parse_args()
+
+    decoder = Decoder(Image(args.elf), args.clock_hz, sys.stdout)
+    if args.port:
+        import serial
+        stream = serial.Serial(args.port, args.baud, timeout=0.1)
+        read = lambda: stream.read(4096)
+    else:
+        read = lambda: sys.stdin.buffer.read1(4096)
+    try:
+        while True:
+            data = read()
+            if not data and not args.port:
+                break
+            decoder.feed(data)
+    except KeyboardInterrupt:
+        pass
+
+
+if __name__ == "__main__":
+    main()
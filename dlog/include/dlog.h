@@ -0,0 +1,99 @@
+#ifndef _DLOG_H_
+#define _DLOG_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Deferred logging. A call site stores a pointer to its static descriptor
+ * (level, tag, format string) plus raw 32-bit arguments into the ring of
+ * the calling core; nothing is formatted there. A low-priority consumer
+ * (the render task on ESP-IDF, dlog_flush() from a superloop elsewhere)
+ * formats the records to the console later, or emits them as binary
+ * frames for dlog_decode.py when DLOG_OUTPUT_BINARY is set.
+ *
+ * Arguments are stored as 32 bits: integers, chars and pointers only.
+ * A %s argument must point at a string that outlives the record, i.e. a
+ * literal; use DLOG_STR for anything else. No 64-bit or float arguments.
+ *
+ * Levels above DLOG_LEVEL compile to nothing. Define DLOG_LEVEL before
+ * including this header to change it for one file. */
+
+#define DLOG_NONE       0
+#define DLOG_ERROR      1
+#define DLOG_WARN       2
+#define DLOG_INFO       3
+#define DLOG_DEBUG      4
+
+#ifndef DLOG_LEVEL
+#define DLOG_LEVEL      DLOG_INFO
+#endif
+
+#define DLOG_MAX_ARGS   4
+#define DLOG_MAX_BLOB   84      // bytes copied by DLOG_HEX/DLOG_STR, three ring cells
+
+#define DLOG_FLAG_HEX   1       // blob rendered as hex after the message
+#define DLOG_FLAG_STR   2       // blob passed to the format as "%.*s" ahead of the arguments
+
+// One per call site, in flash; its address identifies the record
+typedef struct {
+    uint8_t level;
+    uint8_t flags;
+    const char *const *tag;
+    const char *fmt;
+} dlog_site_t;
+
+typedef struct {
+    uint32_t written;
+    uint32_t dropped;           // ring was full
+    uint32_t high_water;        // cells in use
+} dlog_stats_t;
+
+#define DLOG_NARGS(...)  DLOG_NARGS_(0, ##__VA_ARGS__, 8, 7, 6, 5, 4, 3, 2, 1, 0)
+#define DLOG_NARGS_(_0, _1, _2, _3, _4, _5, _6, _7, _8, N, ...) N
+
+#define DLOG_AT(level, tag, fmt, ...) do {                                          \
+        if ((level) <= DLOG_LEVEL) {                                                \
+            static const dlog_site_t _dlog_site = { (level), 0, &(tag), (fmt) };    \
+            _Static_assert(DLOG_NARGS(__VA_ARGS__) <= DLOG_MAX_ARGS, "dlog: too many arguments"); \
+            dlog_write(&_dlog_site, NULL, 0, DLOG_NARGS(__VA_ARGS__), ##__VA_ARGS__); \
+        }                                                                           \
+    } while (0)
+
+#define DLOG_BLOB_AT(level, flags, tag, fmt, ptr, len, ...) do {                    \
+        if ((level) <= DLOG_LEVEL) {                                                \
+            static const dlog_site_t _dlog_site = { (level), (flags), &(tag), (fmt) }; \
+            _Static_assert(DLOG_NARGS(__VA_ARGS__) <= DLOG_MAX_ARGS, "dlog: too many arguments"); \
+            dlog_write(&_dlog_site, (ptr), (len), DLOG_NARGS(__VA_ARGS__), ##__VA_ARGS__); \
+        }                                                                           \
+    } while (0)
+
+#define DLOGE(tag, fmt, ...)  DLOG_AT(DLOG_ERROR, tag, fmt, ##__VA_ARGS__)
+#define DLOGW(tag, fmt, ...)  DLOG_AT(DLOG_WARN, tag, fmt, ##__VA_ARGS__)
+#define DLOGI(tag, fmt, ...)  DLOG_AT(DLOG_INFO, tag, fmt, ##__VA_ARGS__)
+#define DLOGD(tag, fmt, ...)  DLOG_AT(DLOG_DEBUG, tag, fmt, ##__VA_ARGS__)
+
+// message, then up to DLOG_MAX_BLOB bytes of ptr in hex
+#define DLOG_HEX(level, tag, fmt, ptr, len, ...) \
+    DLOG_BLOB_AT(level, DLOG_FLAG_HEX, tag, fmt, ptr, len, ##__VA_ARGS__)
+
+// fmt starts with a "%.*s" consuming a copy of up to DLOG_MAX_BLOB bytes of ptr
+#define DLOG_STR(level, tag, fmt, ptr, len, ...) \
+    DLOG_BLOB_AT(level, DLOG_FLAG_STR, tag, fmt, ptr, len, ##__VA_ARGS__)
+
+/* Use the macros above. Safe from tasks and ISRs, never blocks, drops when
+ * full. On ESP-IDF it is in IRAM, so an ISR running with the flash cache
+ * disabled may call it too; its blob must then be in RAM. */
+void dlog_write(const dlog_site_t *site, const void *blob, size_t blob_len, int nargs, ...);
+
+/* ESP-IDF: starts the render task. Elsewhere nothing to start, call
+ * dlog_flush() from the main loop instead. */
+bool dlog_start(void);
+
+// Renders up to max records, returns how many; one consumer at a time
+size_t dlog_flush(size_t max);
+
+// Summed over every core
+void dlog_get_stats(dlog_stats_t *out);
+
+#endif
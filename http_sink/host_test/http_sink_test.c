@@ -0,0 +1,292 @@
+/* Host tests for the http_sink pool.
+ *
+ * Checks which size class a body lands in, growth of chunked bodies up
+ * to the limit and truncation past it, reserve/commit filling, that a
+ * reused sink takes nothing more from the pool, the heap fallback once a
+ * class is exhausted, and that the pool's counters balance after several
+ * threads took and returned buffers concurrently.
+ *
+ *   ./http_sink_test [responses per thread] */
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "http_sink.h"
+
+#define THREADS 4
+
+static int failures;
+
+#define CHECK_EQ(what, got, want) do { \
+        if ((got) != (want)) { \
+            failures++; \
+            fprintf(stderr, "%s:%d %s: got %" PRIu64 " want %" PRIu64 "\n", \
+                    __FILE__, __LINE__, what, (uint64_t)(got), (uint64_t)(want)); \
+        } \
+    } while (0)
+
+// counters are global, tests look at what changed
+static http_sink_stats_t s_before;
+
+static void mark(void)
+{
+    http_sink_get_stats(&s_before);
+}
+
+static http_sink_stats_t delta(void)
+{
+    http_sink_stats_t now, d;
+    const uint32_t *a = (const uint32_t *)&now, *b = (const uint32_t *)&s_before;
+    uint32_t *out = (uint32_t *)&d;
+
+    http_sink_get_stats(&now);
+    for (size_t i = 0; i < sizeof(d) / sizeof(uint32_t); i++) {
+        out[i] = a[i] - b[i];
+    }
+    return d;
+}
+
+static void fill(char *buf, size_t len, unsigned seed)
+{
+    for (size_t i = 0; i < len; i++) {
+        buf[i] = 'a' + (seed + i) % 26;
+    }
+}
+
+static void test_sized(void)
+{
+    http_sink_t s;
+    char body[3000];
+
+    mark();
+    http_sink_init(&s, 0);
+    CHECK_EQ("limit", s.limit, HTTP_SINK_MAX_LEN);
+    http_sink_begin(&s, 100);
+    CHECK_EQ("100 bytes: class", s.cls, 0);
+    http_sink_begin(&s, HTTP_SINK_SMALL_LEN);       // no room for the NUL in a small one
+    CHECK_EQ("512 bytes: class", s.cls, 1);
+    http_sink_begin(&s, 3000);
+    CHECK_EQ("3000 bytes: class", s.cls, 2);
+    fill(body, sizeof(body), 0);
+    CHECK_EQ("kept", http_sink_append(&s, body, sizeof(body)), sizeof(body));
+    CHECK_EQ("len", s.len, sizeof(body));
+    CHECK_EQ("same bytes", memcmp(s.data, body, sizeof(body)), 0);
+    CHECK_EQ("NUL", s.data[s.len], '\0');
+    // a smaller response keeps the large buffer
+    http_sink_begin(&s, 10);
+    CHECK_EQ("kept class", s.cls, 2);
+    CHECK_EQ("empty", s.len, 0);
+    http_sink_release(&s);
+
+    http_sink_stats_t d = delta();
+    CHECK_EQ("responses", d.responses, 4);
+    CHECK_EQ("takes", d.pool_takes, 3);
+    CHECK_EQ("returns", d.pool_returns, 3);
+    CHECK_EQ("heap", d.heap_allocs, 0);
+    CHECK_EQ("grows", d.grows, 0);
+    CHECK_EQ("copied", d.bytes_copied, sizeof(body));
+}
+
+static void test_chunked_growth(void)
+{
+    http_sink_t s;
+    char piece[100];
+    size_t kept = 0;
+
+    mark();
+    http_sink_init(&s, 0);
+    http_sink_begin(&s, -1);
+    CHECK_EQ("chunked starts small", s.cls, 0);
+    for (int i = 0; i < 90; i++) {
+        fill(piece, sizeof(piece), i);
+        kept += http_sink_append(&s, piece, sizeof(piece));
+    }
+    CHECK_EQ("kept up to the limit", kept, HTTP_SINK_MAX_LEN);
+    CHECK_EQ("len", s.len, HTTP_SINK_MAX_LEN);
+    CHECK_EQ("class", s.cls, 2);
+    CHECK_EQ("truncated", s.truncated, true);
+    // the moves kept the bytes in order
+    for (size_t at = 0, i = 0; at < s.len; at += sizeof(piece), i++) {
+        size_t n = s.len - at < sizeof(piece) ? s.len - at : sizeof(piece);
+        fill(piece, sizeof(piece), i);
+        if (memcmp(s.data + at, piece, n) != 0) {
+            failures++;
+            fprintf(stderr, "%s:%d piece at %zu changed by a grow\n", __FILE__, __LINE__, at);
+            break;
+        }
+    }
+    http_sink_release(&s);
+
+    http_sink_stats_t d = delta();
+    CHECK_EQ("grows", d.grows, 2);
+    // 500 bytes out of the small buffer, 2000 out of the medium one
+    CHECK_EQ("moved", d.bytes_moved, 500 + 2000);
+    CHECK_EQ("truncations", d.truncated, 1);
+    CHECK_EQ("takes", d.pool_takes, 3);
+    CHECK_EQ("returns", d.pool_returns, 3);
+}
+
+static void test_reserve_commit(void)
+{
+    http_sink_t s;
+    char *p;
+    size_t avail, total = 0;
+
+    // exactly the limit: filled, then NULL
+    http_sink_init(&s, 1000);
+    http_sink_begin(&s, 1000);
+    while ((p = http_sink_reserve(&s, 256, &avail)) != NULL) {
+        CHECK_EQ("room", avail > 0, true);
+        size_t n = avail < 300 ? avail : 300;
+        fill(p, n, total);
+        http_sink_commit(&s, n);
+        total += n;
+    }
+    CHECK_EQ("filled", s.len, 1000);
+    CHECK_EQ("avail when full", avail, 0);
+    CHECK_EQ("NUL", s.data[1000], '\0');
+    CHECK_EQ("not truncated", s.truncated, false);
+
+    // unknown length: reserve grows the buffer as commit fills it
+    mark();
+    http_sink_begin(&s, -1);
+    total = 0;
+    while (total < 900 && (p = http_sink_reserve(&s, 256, &avail)) != NULL) {
+        CHECK_EQ("at least min", avail >= 256 || avail == s.limit - s.len, true);
+        http_sink_commit(&s, avail);
+        total += avail;
+    }
+    CHECK_EQ("grew", s.cls >= 1, true);
+    http_sink_stats_t d = delta();
+    CHECK_EQ("nothing copied", d.bytes_copied, 0);
+    http_sink_release(&s);
+}
+
+static void test_reuse(void)
+{
+    http_sink_t s;
+    char body[400];
+
+    http_sink_init(&s, 0);
+    fill(body, sizeof(body), 1);
+    http_sink_begin(&s, sizeof(body));
+    http_sink_append(&s, body, sizeof(body));
+    mark();
+    for (int i = 0; i < 1000; i++) {
+        http_sink_begin(&s, sizeof(body));
+        http_sink_append(&s, body, sizeof(body));
+    }
+    http_sink_stats_t d = delta();
+    CHECK_EQ("responses", d.responses, 1000);
+    CHECK_EQ("no new takes", d.pool_takes, 0);
+    CHECK_EQ("no heap", d.heap_allocs, 0);
+    http_sink_release(&s);
+}
+
+static void test_heap_fallback(void)
+{
+    http_sink_t s[HTTP_SINK_SMALL_COUNT + 1];
+
+    mark();
+    for (int i = 0; i <= HTTP_SINK_SMALL_COUNT; i++) {
+        http_sink_init(&s[i], 0);
+        http_sink_begin(&s[i], 10);
+        CHECK_EQ("class", s[i].cls, 0);
+    }
+    CHECK_EQ("last from the heap", s[HTTP_SINK_SMALL_COUNT].slot, -1);
+    for (int i = 0; i <= HTTP_SINK_SMALL_COUNT; i++) {
+        http_sink_release(&s[i]);
+    }
+    http_sink_stats_t d = delta();
+    CHECK_EQ("takes", d.pool_takes, HTTP_SINK_SMALL_COUNT);
+    CHECK_EQ("returns", d.pool_returns, HTTP_SINK_SMALL_COUNT);
+    CHECK_EQ("heap allocs", d.heap_allocs, 1);
+    CHECK_EQ("heap frees", d.heap_frees, 1);
+}
+
+static int s_per_thread = 20000;
+
+static void *worker(void *arg)
+{
+    unsigned seed = (unsigned)(uintptr_t)arg;
+    char body[HTTP_SINK_MAX_LEN];
+    http_sink_t s;
+
+    fill(body, sizeof(body), seed);
+    http_sink_init(&s, 0);
+    for (int i = 0; i < s_per_thread; i++) {
+        seed = seed * 1103515245 + 12345;
+        size_t len = (seed >> 8) % sizeof(body);
+        // a third chunked, a third sized, a third released in between
+        http_sink_begin(&s, seed % 3 == 0 ? -1 : (int64_t)len);
+        if (http_sink_append(&s, body, len) != len || s.len != len || memcmp(s.data, body, len) != 0) {
+            __atomic_fetch_add(&failures, 1, __ATOMIC_RELAXED);
+            fprintf(stderr, "thread body mismatch, %zu bytes\n", len);
+            break;
+        }
+        if (seed % 3 == 1) {
+            http_sink_release(&s);
+        }
+    }
+    http_sink_release(&s);
+    return NULL;
+}
+
+static void test_threads(void)
+{
+    pthread_t t[THREADS];
+
+    mark();
+    for (int i = 0; i < THREADS; i++) {
+        pthread_create(&t[i], NULL, worker, (void *)(uintptr_t)(i + 1));
+    }
+    for (int i = 0; i < THREADS; i++) {
+        pthread_join(t[i], NULL);
+    }
+    http_sink_stats_t d = delta();
+    CHECK_EQ("responses", d.responses, (uint32_t)(THREADS * s_per_thread));
+    CHECK_EQ("takes and returns", d.pool_takes, d.pool_returns);
+    CHECK_EQ("allocs and frees", d.heap_allocs, d.heap_frees);
+    printf("%d threads, %" PRIu32 " responses: %" PRIu32 " pool takes, %" PRIu32 " heap allocs, %" PRIu32 " grows\n",
+           THREADS, d.responses, d.pool_takes, d.heap_allocs, d.grows);
+
+    // every slot is free again: the whole pool can be taken without the heap
+    http_sink_t all[HTTP_SINK_SMALL_COUNT + HTTP_SINK_MEDIUM_COUNT + HTTP_SINK_LARGE_COUNT];
+    int n = 0;
+    mark();
+    for (int i = 0; i < HTTP_SINK_SMALL_COUNT; i++, n++) {
+        http_sink_init(&all[n], 0);
+        http_sink_begin(&all[n], 10);
+    }
+    for (int i = 0; i < HTTP_SINK_MEDIUM_COUNT; i++, n++) {
+        http_sink_init(&all[n], 0);
+        http_sink_begin(&all[n], 1000);
+    }
+    for (int i = 0; i < HTTP_SINK_LARGE_COUNT; i++, n++) {
+        http_sink_init(&all[n], 0);
+        http_sink_begin(&all[n], 5000);
+    }
+    d = delta();
+    CHECK_EQ("pool whole again", d.heap_allocs, 0);
+    for (int i = 0; i < n; i++) {
+        http_sink_release(&all[i]);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    if (argc > 1) {
+        s_per_thread = atoi(argv[1]);
+    }
+    test_sized();
+    test_chunked_growth();
+    test_reserve_commit();
+    test_reuse();
+    test_heap_fallback();
+    test_threads();
+
+    printf("http_sink: %s\n", failures ? "FAIL" : "ok");
+    return failures ? 1 : 0;
+}
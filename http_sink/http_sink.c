@@ -0,0 +1,210 @@
+#include <stdlib.h>
+#include <string.h>
+#include "http_sink.h"
+
+#define CLASSES 3
+
+static char s_small[HTTP_SINK_SMALL_COUNT][HTTP_SINK_SMALL_LEN];
+static char s_medium[HTTP_SINK_MEDIUM_COUNT][HTTP_SINK_MEDIUM_LEN];
+static char s_large[HTTP_SINK_LARGE_COUNT][HTTP_SINK_LARGE_LEN];
+
+static char *const s_base[CLASSES] = { s_small[0], s_medium[0], s_large[0] };
+static const size_t s_len[CLASSES] = { HTTP_SINK_SMALL_LEN, HTTP_SINK_MEDIUM_LEN, HTTP_SINK_LARGE_LEN };
+static const uint32_t s_all[CLASSES] = {
+    (1u << HTTP_SINK_SMALL_COUNT) - 1,
+    (1u << HTTP_SINK_MEDIUM_COUNT) - 1,
+    (1u << HTTP_SINK_LARGE_COUNT) - 1,
+};
+
+static uint32_t s_used[CLASSES];        // bit per slot, set while a sink holds it
+static http_sink_stats_t s_stats;
+
+#define STAT_ADD(field, n) __atomic_fetch_add(&s_stats.field, (n), __ATOMIC_RELAXED)
+
+// Smallest class whose buffers hold len body bytes and the NUL
+static int class_for(size_t len)
+{
+    for (int c = 0; c < CLASSES; c++) {
+        if (len < s_len[c]) {
+            return c;
+        }
+    }
+    return CLASSES - 1;
+}
+
+static int take_slot(int cls)
+{
+    uint32_t used = __atomic_load_n(&s_used[cls], __ATOMIC_RELAXED);
+
+    while ((used & s_all[cls]) != s_all[cls]) {
+        int slot = __builtin_ctz(~used);
+        if (__atomic_compare_exchange_n(&s_used[cls], &used, used | (1u << slot), true,
+                                        __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            return slot;
+        }
+    }
+    return -1;
+}
+
+static bool acquire(int cls, char **data, int8_t *slot)
+{
+    int k = take_slot(cls);
+
+    if (k >= 0) {
+        *data = s_base[cls] + k * s_len[cls];
+        STAT_ADD(pool_takes, 1);
+    } else {
+        *data = malloc(s_len[cls]);
+        if (*data == NULL) {
+            return false;
+        }
+        STAT_ADD(heap_allocs, 1);
+    }
+    *slot = k;
+    return true;
+}
+
+static void give_back(int cls, char *data, int slot)
+{
+    if (slot >= 0) {
+        __atomic_fetch_and(&s_used[cls], ~(1u << slot), __ATOMIC_RELEASE);
+        STAT_ADD(pool_returns, 1);
+    } else {
+        free(data);
+        STAT_ADD(heap_frees, 1);
+    }
+}
+
+// Makes room for len body bytes, moving the body to a larger buffer if needed
+static bool ensure(http_sink_t *s, size_t len)
+{
+    char *data;
+    int8_t slot;
+
+    if (s->data != NULL && len <= s->cap) {
+        return true;
+    }
+    int cls = class_for(len);
+    if (!acquire(cls, &data, &slot)) {
+        return false;
+    }
+    if (s->data != NULL) {
+        memcpy(data, s->data, s->len);
+        STAT_ADD(grows, 1);
+        STAT_ADD(bytes_moved, s->len);
+        give_back(s->cls, s->data, s->slot);
+    }
+    data[s->len] = '\0';
+    s->data = data;
+    s->cls = cls;
+    s->slot = slot;
+    s->cap = s_len[cls] - 1;
+    return true;
+}
+
+static void mark_truncated(http_sink_t *s)
+{
+    if (!s->truncated) {
+        s->truncated = true;
+        STAT_ADD(truncated, 1);
+    }
+}
+
+void http_sink_init(http_sink_t *s, size_t limit)
+{
+    memset(s, 0, sizeof(*s));
+    s->limit = limit == 0 || limit > HTTP_SINK_MAX_LEN ? HTTP_SINK_MAX_LEN : limit;
+    s->expected = -1;
+    s->cls = -1;
+    s->slot = -1;
+}
+
+void http_sink_reset(http_sink_t *s)
+{
+    s->len = 0;
+    s->expected = -1;
+    s->started = false;
+    s->truncated = false;
+    if (s->data != NULL) {
+        s->data[0] = '\0';
+    }
+}
+
+void http_sink_begin(http_sink_t *s, int64_t content_length)
+{
+    http_sink_reset(s);
+    s->started = true;
+    s->expected = content_length;
+    STAT_ADD(responses, 1);
+
+    size_t want = content_length > 0 ? (size_t)content_length : 0;
+    if (want > s->limit) {
+        want = s->limit;
+    }
+    // a buffer that already fits is kept, even if larger than needed
+    if (s->data != NULL && s->cls < class_for(want)) {
+        give_back(s->cls, s->data, s->slot);
+        s->data = NULL;
+        s->cls = -1;
+    }
+    ensure(s, want);
+}
+
+size_t http_sink_append(http_sink_t *s, const void *data, size_t len)
+{
+    if (!s->started) {
+        http_sink_begin(s, -1);
+    }
+    size_t n = len < s->limit - s->len ? len : s->limit - s->len;
+    if (n > 0 && !ensure(s, s->len + n)) {
+        n = 0;
+    }
+    if (n < len) {
+        mark_truncated(s);
+    }
+    if (n > 0) {
+        memcpy(s->data + s->len, data, n);
+        s->len += n;
+        s->data[s->len] = '\0';
+        STAT_ADD(bytes_copied, n);
+    }
+    return n;
+}
+
+char *http_sink_reserve(http_sink_t *s, size_t min, size_t *avail)
+{
+    if (!s->started) {
+        http_sink_begin(s, -1);
+    }
+    size_t room = s->limit - s->len;
+    if (room == 0 || !ensure(s, s->len + (min < room ? min : room))) {
+        *avail = 0;
+        return NULL;
+    }
+    *avail = s->cap - s->len < room ? s->cap - s->len : room;
+    return s->data + s->len;
+}
+
+void http_sink_commit(http_sink_t *s, size_t n)
+{
+    s->len += n;
+    s->data[s->len] = '\0';
+}
+
+void http_sink_release(http_sink_t *s)
+{
+    if (s->data != NULL) {
+        give_back(s->cls, s->data, s->slot);
+    }
+    http_sink_init(s, s->limit);
+}
+
+void http_sink_get_stats(http_sink_stats_t *out)
+{
+    const uint32_t *from = (const uint32_t *)&s_stats;
+    uint32_t *to = (uint32_t *)out;
+
+    for (size_t i = 0; i < sizeof(*out) / sizeof(uint32_t); i++) {
+        to[i] = __atomic_load_n(&from[i], __ATOMIC_RELAXED);
+    }
+}
@@ -0,0 +1,79 @@
+#ifndef _HTTP_SINK_H_
+#define _HTTP_SINK_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Collects an HTTP response body into a buffer from a fixed pool.
+ *
+ * The pool has three size classes. A body starts in the smallest class
+ * that fits its Content-Length. A chunked body, or one without a length,
+ * starts small and moves up a class when it outgrows its buffer. Nothing
+ * grows past the sink's limit: the rest of the body is dropped and
+ * truncated is set. Buffers are claimed lock-free, so sinks are safe to
+ * use from several tasks. Only when a class has no free buffer does the
+ * sink fall back to malloc. heap_allocs in the stats counts those
+ * fallbacks and stays flat once the pool is sized right.
+ *
+ * A sink keeps its buffer across responses (http_sink_begin() reuses it),
+ * so a client polling the same URL takes nothing from the pool after the
+ * first response. http_sink_release() gives the buffer back. */
+
+// buffer sizes and how many of each the pool holds (at most 31), 14 KB in all
+#define HTTP_SINK_SMALL_LEN      512
+#define HTTP_SINK_SMALL_COUNT    4
+#define HTTP_SINK_MEDIUM_LEN     2048
+#define HTTP_SINK_MEDIUM_COUNT   2
+#define HTTP_SINK_LARGE_LEN      8192
+#define HTTP_SINK_LARGE_COUNT    1
+#define HTTP_SINK_MAX_LEN        (HTTP_SINK_LARGE_LEN - 1)  // one byte for the terminating NUL
+
+typedef struct {
+    char *data;             // NUL-terminated body, NULL until the first byte
+    size_t len;
+    size_t cap;             // body bytes the current buffer holds
+    size_t limit;           // body bytes kept at most, up to HTTP_SINK_MAX_LEN
+    int64_t expected;       // Content-Length, -1 for chunked or unknown
+    int8_t cls;             // size class of data, -1 without a buffer
+    int8_t slot;            // pool slot, -1 if data is from the heap
+    bool started;           // http_sink_begin() since the last reset
+    bool truncated;
+} http_sink_t;
+
+typedef struct {
+    uint32_t responses;
+    uint32_t pool_takes;
+    uint32_t pool_returns;
+    uint32_t heap_allocs;   // class was empty, nonzero in steady state means the pool is too small
+    uint32_t heap_frees;
+    uint32_t grows;         // body moved to a larger buffer
+    uint32_t bytes_moved;   // copied by grows
+    uint32_t bytes_copied;  // copied in by http_sink_append(), not counting reserve/commit
+    uint32_t truncated;
+} http_sink_stats_t;
+
+// limit 0 means HTTP_SINK_MAX_LEN
+void http_sink_init(http_sink_t *s, size_t limit);
+
+// Forgets the body, keeps the buffer; the next response starts empty
+void http_sink_reset(http_sink_t *s);
+
+/* Starts a response of content_length bytes (-1 if unknown), picking the
+ * buffer it needs; the current one is kept if it is big enough. */
+void http_sink_begin(http_sink_t *s, int64_t content_length);
+
+// Returns the bytes kept, fewer than len once the limit is reached
+size_t http_sink_append(http_sink_t *s, const void *data, size_t len);
+
+/* Zero-copy filling, e.g. from esp_http_client_read(): room for at least
+ * min bytes if the limit allows, *avail says how much. NULL when full. */
+char *http_sink_reserve(http_sink_t *s, size_t min, size_t *avail);
+void http_sink_commit(http_sink_t *s, size_t n);
+
+// Gives the buffer back to the pool, the sink can be used again
+void http_sink_release(http_sink_t *s);
+
+void http_sink_get_stats(http_sink_stats_t *out);
+
+#endif
@@ -0,0 +1,73 @@
+#ifndef _TELEMETRY_H_
+#define _TELEMETRY_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* Binary GPIO telemetry frame, all fields little-endian:
+ *
+ *   0  u8   magic (0xA5)
+ *   1  u8   version
+ *   2  u8   type
+ *   3  u8   record count
+ *   4  u32  device id
+ *   8  u32  frame sequence number
+ *  12  u64  timestamp of the frame, microseconds since boot
+ *  20  count x { u32 offset_us from the frame timestamp, u32 pin bitmap }
+ *
+ * An ACK frame (type TELEMETRY_TYPE_ACK, count 0) carries the cumulative
+ * ack in the sequence field (every frame before it was received) and is
+ * followed by a u32 selective-ack bitmap: bit i set means frame
+ * seq + 1 + i was received as well. Only frames whose type has
+ * TELEMETRY_FLAG_ACK_REQ set are acknowledged.
+ *
+ * Keep in sync with Laboratory 2/telemetry.py. */
+
+#define TELEMETRY_MAGIC        0xA5
+#define TELEMETRY_VERSION      1
+#define TELEMETRY_HEADER_LEN   20
+#define TELEMETRY_RECORD_LEN   8
+#define TELEMETRY_MAX_RECORDS  64
+#define TELEMETRY_MAX_LEN      (TELEMETRY_HEADER_LEN + TELEMETRY_MAX_RECORDS * TELEMETRY_RECORD_LEN)
+
+#define TELEMETRY_TYPE_STATE   1
+#define TELEMETRY_TYPE_ACK     2
+#define TELEMETRY_TYPE_MASK    0x7F
+#define TELEMETRY_FLAG_ACK_REQ 0x80
+#define TELEMETRY_ACK_LEN      (TELEMETRY_HEADER_LEN + 4)
+
+#define TELEMETRY_ERR_SHORT    -1
+#define TELEMETRY_ERR_MAGIC    -2
+#define TELEMETRY_ERR_VERSION  -3
+#define TELEMETRY_ERR_COUNT    -4
+
+typedef struct {
+    uint8_t version;
+    uint8_t type;
+    uint8_t count;
+    uint32_t device_id;
+    uint32_t seq;
+    uint64_t ts_us;
+} telemetry_header_t;
+
+typedef struct {
+    uint32_t offset_us;
+    uint32_t pins;
+} telemetry_record_t;
+
+// Returns the encoded length, or 0 if buf is too small
+size_t telemetry_encode(uint8_t *buf, size_t cap, const telemetry_header_t *hdr,
+                        const telemetry_record_t *recs);
+
+// Returns the number of records decoded, or a TELEMETRY_ERR_* value
+int telemetry_decode(const uint8_t *buf, size_t len, telemetry_header_t *hdr,
+                     telemetry_record_t *recs, size_t max_recs);
+
+size_t telemetry_encode_ack(uint8_t *buf, size_t cap, uint32_t device_id,
+                            uint32_t cum_ack, uint32_t sack);
+
+// Returns 0, or a TELEMETRY_ERR_* value if buf is not an ACK frame
+int telemetry_decode_ack(const uint8_t *buf, size_t len, uint32_t *device_id,
+                         uint32_t *cum_ack, uint32_t *sack);
+
+#endif
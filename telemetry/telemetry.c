@@ -0,0 +1,112 @@
+#include "telemetry.h"
+
+static void put_u32(uint8_t *p, uint32_t v)
+{
+    p[0] = v;
+    p[1] = v >> 8;
+    p[2] = v >> 16;
+    p[3] = v >> 24;
+}
+
+static uint32_t get_u32(const uint8_t *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+size_t telemetry_encode(uint8_t *buf, size_t cap, const telemetry_header_t *hdr,
+                        const telemetry_record_t *recs)
+{
+    size_t len = TELEMETRY_HEADER_LEN + (size_t)hdr->count * TELEMETRY_RECORD_LEN;
+    if (hdr->count > TELEMETRY_MAX_RECORDS || len > cap) {
+        return 0;
+    }
+
+    buf[0] = TELEMETRY_MAGIC;
+    buf[1] = hdr->version;
+    buf[2] = hdr->type;
+    buf[3] = hdr->count;
+    put_u32(buf + 4, hdr->device_id);
+    put_u32(buf + 8, hdr->seq);
+    put_u32(buf + 12, (uint32_t)hdr->ts_us);
+    put_u32(buf + 16, (uint32_t)(hdr->ts_us >> 32));
+
+    uint8_t *p = buf + TELEMETRY_HEADER_LEN;
+    for (uint8_t i = 0; i < hdr->count; i++) {
+        put_u32(p, recs[i].offset_us);
+        put_u32(p + 4, recs[i].pins);
+        p += TELEMETRY_RECORD_LEN;
+    }
+    return len;
+}
+
+int telemetry_decode(const uint8_t *buf, size_t len, telemetry_header_t *hdr,
+                     telemetry_record_t *recs, size_t max_recs)
+{
+    if (len < TELEMETRY_HEADER_LEN) {
+        return TELEMETRY_ERR_SHORT;
+    }
+    if (buf[0] != TELEMETRY_MAGIC) {
+        return TELEMETRY_ERR_MAGIC;
+    }
+    if (buf[1] != TELEMETRY_VERSION) {
+        return TELEMETRY_ERR_VERSION;
+    }
+
+    hdr->version = buf[1];
+    hdr->type = buf[2];
+    hdr->count = buf[3];
+    hdr->device_id = get_u32(buf + 4);
+    hdr->seq = get_u32(buf + 8);
+    hdr->ts_us = (uint64_t)get_u32(buf + 12) | ((uint64_t)get_u32(buf + 16) << 32);
+
+    if (len < TELEMETRY_HEADER_LEN + (size_t)hdr->count * TELEMETRY_RECORD_LEN) {
+        return TELEMETRY_ERR_SHORT;
+    }
+    if (hdr->count > max_recs) {
+        return TELEMETRY_ERR_COUNT;
+    }
+
+    const uint8_t *p = buf + TELEMETRY_HEADER_LEN;
+    for (uint8_t i = 0; i < hdr->count; i++) {
+        recs[i].offset_us = get_u32(p);
+        recs[i].pins = get_u32(p + 4);
+        p += TELEMETRY_RECORD_LEN;
+    }
+    return hdr->count;
+}
+
+size_t telemetry_encode_ack(uint8_t *buf, size_t cap, uint32_t device_id,
+                            uint32_t cum_ack, uint32_t sack)
+{
+    telemetry_header_t hdr = {
+        .version = TELEMETRY_VERSION,
+        .type = TELEMETRY_TYPE_ACK,
+        .count = 0,
+        .device_id = device_id,
+        .seq = cum_ack,
+        .ts_us = 0,
+    };
+    if (cap < TELEMETRY_ACK_LEN) {
+        return 0;
+    }
+    telemetry_encode(buf, cap, &hdr, NULL);
+    put_u32(buf + TELEMETRY_HEADER_LEN, sack);
+    return TELEMETRY_ACK_LEN;
+}
+
+int telemetry_decode_ack(const uint8_t *buf, size_t len, uint32_t *device_id,
+                         uint32_t *cum_ack, uint32_t *sack)
+{
+    telemetry_header_t hdr;
+    int ret = telemetry_decode(buf, len, &hdr, NULL, 0);
+    if (ret < 0) {
+        return ret;
+    }
+    if ((hdr.type & TELEMETRY_TYPE_MASK) != TELEMETRY_TYPE_ACK || len < TELEMETRY_ACK_LEN) {
+        return TELEMETRY_ERR_SHORT;
+    }
+    *device_id = hdr.device_id;
+    *cum_ack = hdr.seq;
+    *sack = get_u32(buf + TELEMETRY_HEADER_LEN);
+    return 0;
+}